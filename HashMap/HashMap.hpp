@@ -5,8 +5,18 @@
 #include <istream>
 #include <ostream>
 #include <vector>
+#include <algorithm>
 #include <iterator>
 #include <utility>
+#include <new>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #define INITIAL_CAP 16UL
 #define LOWER_FACTOR 0.25
@@ -14,6 +24,34 @@
 #define INCREASE 1
 #define DECREASE 0
 #define MIN_CAP 1
+#define MERGE_SAMPLE_BUCKETS 256
+// the huge page size when /proc/meminfo does not tell it, that of x86-64 and most arm64 kernels
+#define DEFAULT_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define MEMINFO_PATH "/proc/meminfo"
+#define MEMINFO_HUGE_PAGE_SIZE "Hugepagesize:"
+#define MPOL_BIND_MODE 2
+#define MPOL_INTERLEAVE_MODE 3
+
+
+/**
+ * the ways in which the bucket table of a hashmap can be allocated. Tables smaller than a huge
+ * page always live on the regular heap.
+ */
+enum TableAllocation
+{
+    HEAP_TABLE,
+    HUGE_PAGE_TABLE
+};
+
+/**
+ * the NUMA placement of a bucket table which is allocated with mmap
+ */
+enum NumaPolicy
+{
+    NUMA_DEFAULT,
+    NUMA_INTERLEAVE,
+    NUMA_BIND
+};
 
 
 /**
@@ -28,9 +66,121 @@ class HashMap
 
 private:
 
+    typedef std::vector<std::pair<KeyT, ValueT>> Bucket;
+
     size_t _capacity;
     size_t _size;
     std::vector<std::pair<KeyT, ValueT>> * _data;
+    TableAllocation _allocation = HEAP_TABLE;
+    NumaPolicy _numaPolicy = NUMA_DEFAULT;
+    unsigned long _numaNodeMask = 0;
+    size_t _mappedBytes = 0;
+
+    /**
+     * reads the default huge page size of the system once, from the Hugepagesize line of
+     * /proc/meminfo, as kernels configured with 1 GiB or 512 MiB default pages do not use 2 MiB
+     * @return the huge page size in bytes, a power of 2, DEFAULT_HUGE_PAGE_SIZE if it is unknown
+     */
+    static size_t _hugePageSize()
+    {
+        static const size_t size = []() -> size_t
+        {
+            std::ifstream meminfo(MEMINFO_PATH);
+            std::string field;
+            while (meminfo >> field)
+            {
+                size_t kilobytes;
+                if (field == MEMINFO_HUGE_PAGE_SIZE && meminfo >> kilobytes)
+                {
+                    size_t bytes = kilobytes * 1024;
+                    if (bytes != 0 && (bytes & (bytes - 1)) == 0)
+                    {
+                        return bytes;
+                    }
+                    break;
+                }
+            }
+            return DEFAULT_HUGE_PAGE_SIZE;
+        }();
+        return size;
+    }
+
+    /**
+     * allocates a table of empty buckets according to the allocation mode of the hashmap. Large
+     * tables are mapped with explicit huge pages when the system has them reserved, and with
+     * transparent huge pages otherwise, then placed on the requested NUMA nodes.
+     * @param capacity the number of buckets in the table
+     * @param mappedBytes set to the length of the mapping, or 0 if the table is on the heap
+     * @return the new table, or nullptr if the allocation failed
+     */
+    Bucket *_allocTable(size_t capacity, size_t &mappedBytes) const
+    {
+        mappedBytes = 0;
+#ifdef __linux__
+        size_t bytes = capacity * sizeof(Bucket);
+        size_t hugePage = _hugePageSize();
+        if ((_allocation == HUGE_PAGE_TABLE || _numaPolicy != NUMA_DEFAULT) && bytes >= hugePage)
+        {
+            // a huge page mapping must be a whole number of huge pages long
+            size_t length = (bytes + hugePage - 1) & ~(hugePage - 1);
+            void *mem = MAP_FAILED;
+            if (_allocation == HUGE_PAGE_TABLE)
+            {
+                mem = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, - 1, 0);
+            }
+            if (mem == MAP_FAILED)
+            {
+                mem = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                           - 1, 0);
+                if (mem != MAP_FAILED && _allocation == HUGE_PAGE_TABLE)
+                {
+                    madvise(mem, length, MADV_HUGEPAGE);
+                }
+            }
+            if (mem != MAP_FAILED)
+            {
+                if (_numaPolicy != NUMA_DEFAULT && _numaNodeMask != 0)
+                {
+                    int mode = (_numaPolicy == NUMA_BIND) ? MPOL_BIND_MODE : MPOL_INTERLEAVE_MODE;
+                    // best effort: without NUMA support the table keeps the default placement
+                    syscall(SYS_mbind, mem, length, mode, &_numaNodeMask,
+                            sizeof(_numaNodeMask) * 8, 0);
+                }
+                auto table = static_cast<Bucket *>(mem);
+                for (size_t i = 0; i < capacity; ++ i)
+                {
+                    new(table + i) Bucket();
+                }
+                mappedBytes = length;
+                return table;
+            }
+        }
+#endif
+        return new(std::nothrow) Bucket[capacity];
+    }
+
+    /**
+     * releases a table allocated by _allocTable
+     * @param table the table to release
+     * @param capacity the number of buckets in the table
+     * @param mappedBytes the length of the mapping, or 0 if the table is on the heap
+     */
+    static void _freeTable(Bucket *table, size_t capacity, size_t mappedBytes)
+    {
+        if (mappedBytes == 0)
+        {
+            delete[] table;
+            return;
+        }
+#ifdef __linux__
+        for (size_t i = 0; i < capacity; ++ i)
+        {
+            table[i].~Bucket();
+        }
+        munmap(table, mappedBytes);
+#endif
+    }
 
     /**
      * Increases or decreases the hashmap when the upper/ lower factor is reached and updates the
@@ -39,19 +189,29 @@ private:
      */
     void _rehash(int sizeChange)
     {
-        size_t tempCapacity = _capacity;
         if (sizeChange == INCREASE)
         {
-            _capacity *= 2;
+            _resize(_capacity * 2);
         }
         else
         {
-            _capacity /= 2;
+            _resize(_capacity / 2);
         }
-        auto tempData = new(std::nothrow) std::vector<std::pair<KeyT, ValueT>>[_capacity];
+    }
+
+    /**
+     * moves every pair of the hashmap into a new table of the given capacity
+     * @param newCapacity the capacity of the new table, a power of 2
+     */
+    void _resize(size_t newCapacity)
+    {
+        size_t tempCapacity = _capacity;
+        _capacity = newCapacity;
+        size_t tempBytes;
+        auto tempData = _allocTable(_capacity, tempBytes);
         if (tempData == nullptr)
         {
-            delete[] this->_data;
+            _freeTable(this->_data, tempCapacity, _mappedBytes);
             throw std::exception();
         }
 
@@ -60,24 +220,67 @@ private:
             for (size_t j = 0; j < _data[i].size(); ++ j)
             {
                 size_t cell = _findIndex((_data[i][j]).first);
-                KeyT key = (_data[i][j]).first;
-                ValueT value = (_data[i][j]).second;
                 try
                 {
-                    tempData[cell].push_back(std::pair<KeyT, ValueT>(key, value));
+                    tempData[cell].push_back(std::move(_data[i][j]));
                 }
                 catch (std::exception &e)
                 {
-                    delete [] tempData;
-                    delete [] this->_data;
+                    _freeTable(tempData, _capacity, tempBytes);
+                    _freeTable(this->_data, tempCapacity, _mappedBytes);
                     throw std::exception();
                 }
             }
         }
-        delete[] this->_data;
+        _freeTable(this->_data, tempCapacity, _mappedBytes);
         this->_data = tempData;
+        _mappedBytes = tempBytes;
     }
 
+    /**
+     * grows the hashmap in a single rehash so it can hold a given number of pairs without
+     * passing the upper factor
+     * @param size the number of pairs the hashmap should be able to hold
+     */
+    void _reserve(size_t size)
+    {
+        size_t newCapacity = _capacity;
+        while ((double) size / (double) newCapacity > UPPER_FACTOR)
+        {
+            newCapacity *= 2;
+        }
+        if (newCapacity != _capacity)
+        {
+            _resize(newCapacity);
+        }
+    }
+
+
+    /**
+     * estimates how many keys of source are not in the hashmap, from the keys of about
+     * MERGE_SAMPLE_BUCKETS evenly spread buckets of source
+     * @param source the hashmap to be merged into this one
+     * @return the estimated number of new keys
+     */
+    size_t _newKeys(const HashMap<KeyT, ValueT> &source) const
+    {
+        size_t step = std::max(source._capacity / MERGE_SAMPLE_BUCKETS, (size_t) 1);
+        size_t sampled = 0;
+        size_t found = 0;
+        for (size_t i = 0; i < source._capacity; i += step)
+        {
+            for (auto it = source._data[i].begin(); it != source._data[i].end(); it ++)
+            {
+                ++ sampled;
+                found += contains_key(it->first) ? 1 : 0;
+            }
+        }
+        if (sampled == 0)
+        {
+            return source._size;
+        }
+        return (size_t) ((double) source._size * (double) (sampled - found) / (double) sampled);
+    }
 
     /**
      * calculates the index of a given key
@@ -326,7 +529,7 @@ public:
      */
     HashMap() : _capacity(INITIAL_CAP), _size(0)
     {
-        _data = new(std::nothrow) std::vector<std::pair<KeyT, ValueT>>[_capacity];
+        _data = _allocTable(_capacity, _mappedBytes);
         if (_data == nullptr)
         {
             throw std::exception();
@@ -349,7 +552,7 @@ public:
     {
         _capacity = INITIAL_CAP;
         _size = 0;
-        _data = new(std::nothrow) std::vector<std::pair<KeyT, ValueT>>[_capacity];
+        _data = _allocTable(_capacity, _mappedBytes);
         if (_data == nullptr)
         {
             throw std::exception();
@@ -372,7 +575,7 @@ public:
                 }
                 catch (std::exception &e)
                 {
-                    delete [] this->_data;
+                    _freeTable(this->_data, _capacity, _mappedBytes);
                     throw std::exception();
                 }
             }
@@ -385,7 +588,7 @@ public:
         }
         if (itVal != valuesEnd)
         {
-            delete [] this->_data;
+            _freeTable(this->_data, _capacity, _mappedBytes);
             throw std::exception();
         }
     }
@@ -398,7 +601,10 @@ public:
     {
         _capacity = other._capacity;
         _size = other._size;
-        _data = new(std::nothrow) std::vector<std::pair<KeyT, ValueT>>[_capacity];
+        _allocation = other._allocation;
+        _numaPolicy = other._numaPolicy;
+        _numaNodeMask = other._numaNodeMask;
+        _data = _allocTable(_capacity, _mappedBytes);
         if (_data == nullptr)
         {
             throw std::exception();
@@ -413,7 +619,7 @@ public:
                 }
                 catch (std::exception &e)
                 {
-                    delete [] this->_data;
+                    _freeTable(this->_data, _capacity, _mappedBytes);
                     throw std::exception();
                 }
             }
@@ -426,7 +632,7 @@ public:
      */
     ~HashMap()
     {
-        delete [] this->_data;
+        _freeTable(this->_data, _capacity, _mappedBytes);
     }
 
     /**
@@ -465,6 +671,31 @@ public:
         return (double )_size / (double) _capacity;
     }
 
+    /**
+     * chooses how the bucket table is allocated and moves the current table accordingly. The
+     * choice is kept by later rehashes and given to copies of the hashmap.
+     * @param allocation whether large tables are backed by huge pages
+     * @param numaPolicy how large tables are placed across NUMA nodes
+     * @param numaNodeMask a bit per NUMA node the table may be placed on
+     */
+    void set_table_allocation(TableAllocation allocation, NumaPolicy numaPolicy = NUMA_DEFAULT,
+                              unsigned long numaNodeMask = 0) noexcept(false)
+    {
+        _allocation = allocation;
+        _numaPolicy = numaPolicy;
+        _numaNodeMask = numaNodeMask;
+        _resize(_capacity);
+    }
+
+    /**
+     * checks whether the bucket table is currently memory mapped rather than on the heap
+     * @return true if the table is mapped, false otherwise
+     */
+    bool table_mapped() const
+    {
+        return (_mappedBytes != 0);
+    }
+
     /**
      * inserts a new pair of key and value to the hashmap
      * @param key the key variable
@@ -494,6 +725,163 @@ public:
         return true;
     }
 
+    /**
+     * updates the value of a key in place, or inserts it if it is not in the hashmap yet. The
+     * bucket of the key is searched only once.
+     * @tparam Function a callable receiving a ValueT& to update
+     * @param key the key to update or insert
+     * @param init the value given to key if it is not in the hashmap
+     * @param fn the update applied to the value of key if it is already in the hashmap
+     * @return true if key was inserted, false if its' value was updated
+     */
+    template<typename Function>
+    bool upsert(const KeyT &key, const ValueT &init, Function fn) noexcept(false)
+    {
+        size_t cell = _findIndex(key);
+        for (auto it = _data[cell].begin(); it != _data[cell].end(); it ++)
+        {
+            if (it->first == key)
+            {
+                fn(it->second);
+                return false;
+            }
+        }
+        try
+        {
+            _data[cell].push_back(std::pair<KeyT, ValueT>(key, init));
+            _size++;
+        }
+        catch (std::exception &e)
+        {
+            throw std::exception();
+        }
+        if (load_factor() > UPPER_FACTOR)
+        {
+            this->_rehash(INCREASE);
+        }
+        return true;
+    }
+
+    /**
+     * inserts every pair of other into *this. When a key is in both hashmaps its' value becomes
+     * combiner(value in *this, value in other)
+     * @tparam Combiner a callable receiving two values and returning a ValueT
+     * @param other the hashmap to merge into *this
+     * @param combiner combines the values of keys found in both hashmaps
+     */
+    template<typename Combiner>
+    void merge(const HashMap<KeyT, ValueT> &other, Combiner combiner) noexcept(false)
+    {
+        if (this == &other)
+        {
+            for (size_t i = 0; i < _capacity; ++ i)
+            {
+                for (auto it = _data[i].begin(); it != _data[i].end(); it ++)
+                {
+                    it->second = combiner(it->second, it->second);
+                }
+            }
+            return;
+        }
+        // the keys may overlap, so *this is grown for the larger of the two and upsert grows it
+        // further as the new keys come
+        _reserve(std::max(_size, other._size));
+        for (size_t i = 0; i < other._capacity; ++ i)
+        {
+            for (auto it = other._data[i].begin(); it != other._data[i].end(); it ++)
+            {
+                const ValueT &value = it->second;
+                upsert(it->first, value, [&](ValueT &cur)
+                {
+                    cur = combiner(cur, value);
+                });
+            }
+        }
+    }
+
+    /**
+     * moves every pair of source into *this and leaves source empty. Pairs are moved rather
+     * than copied, and a bucket of source whose pairs all belong to a single bucket of *this
+     * which is empty is spliced in as a whole, with no allocation. Both capacities are powers of
+     * 2, so when *this has at least the capacity of source every bucket of source maps into the
+     * buckets of *this of the same low bits, and a bucket of a single pair always qualifies.
+     * *this is therefore grown to the capacity of source first if it is smaller. The keys of the
+     * two hashmaps may overlap, so their sizes do not add up: *this is grown beforehand only for
+     * the number of new keys estimated from a sample of source, which moves fewer pairs than
+     * rehashing the merged table would, and is rehashed once afterwards if the estimate fell
+     * short. When a key is in both hashmaps its' value becomes
+     * combiner(value in *this, value in source)
+     * @tparam Combiner a callable receiving two values and returning a ValueT
+     * @param source the hashmap to move the pairs out of
+     * @param combiner combines the values of keys found in both hashmaps
+     */
+    template<typename Combiner>
+    void merge(HashMap<KeyT, ValueT> &&source, Combiner combiner) noexcept(false)
+    {
+        if (this == &source)
+        {
+            merge(static_cast<const HashMap<KeyT, ValueT> &>(source), combiner);
+            return;
+        }
+        _reserve(_size + _newKeys(source));
+        if (_capacity < source._capacity)
+        {
+            _resize(source._capacity);
+        }
+        for (size_t i = 0; i < source._capacity; ++ i)
+        {
+            Bucket &bucket = source._data[i];
+            if (bucket.empty())
+            {
+                continue;
+            }
+            size_t first = _findIndex(bucket.front().first);
+            if (_data[first].empty())
+            {
+                bool single = true;
+                for (size_t j = 1; j < bucket.size() && single; ++ j)
+                {
+                    single = (_findIndex(bucket[j].first) == first);
+                }
+                if (single)
+                {
+                    _data[first].swap(bucket);
+                    _size += _data[first].size();
+                    continue;
+                }
+            }
+            for (auto it = bucket.begin(); it != bucket.end(); it ++)
+            {
+                size_t cell = _findIndex(it->first);
+                bool found = false;
+                for (auto cur = _data[cell].begin(); cur != _data[cell].end(); cur ++)
+                {
+                    if (cur->first == it->first)
+                    {
+                        cur->second = combiner(cur->second, it->second);
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found)
+                {
+                    try
+                    {
+                        _data[cell].push_back(std::move(*it));
+                        _size++;
+                    }
+                    catch (std::exception &e)
+                    {
+                        throw std::exception();
+                    }
+                }
+            }
+            bucket.clear();
+        }
+        source._size = 0;
+        _reserve(_size);
+    }
+
     /**
      * checks if *this contains a given key
      * @param key the key to look up for
@@ -633,7 +1021,8 @@ public:
     }
 
     /**
-     * gives *this the traits of other
+     * gives *this the traits of other, the way its table is allocated included, as the copy
+     * constructor does
      * @param other the hashmap to give its' traits to *this
      * @return
      */
@@ -643,12 +1032,17 @@ public:
         {
             return *this;
         }
+        size_t oldCapacity = _capacity;
         _size = other._size;
         _capacity = other._capacity;
-        auto tempData = new (std::nothrow)std::vector<std::pair<KeyT, ValueT>>[_capacity];
+        _allocation = other._allocation;
+        _numaPolicy = other._numaPolicy;
+        _numaNodeMask = other._numaNodeMask;
+        size_t tempBytes;
+        auto tempData = _allocTable(_capacity, tempBytes);
         if (tempData == nullptr)
         {
-            delete[] this->_data;
+            _freeTable(this->_data, oldCapacity, _mappedBytes);
             throw std::exception();
         }
         for (size_t i = 0; i < _capacity; ++ i)
@@ -661,14 +1055,15 @@ public:
                 }
                 catch (std::exception &e)
                 {
-                    delete[] tempData;
-                    delete [] this->_data;
+                    _freeTable(tempData, _capacity, tempBytes);
+                    _freeTable(this->_data, oldCapacity, _mappedBytes);
                     throw std::exception();
                 }
             }
         }
-        delete[] this->_data;
+        _freeTable(this->_data, oldCapacity, _mappedBytes);
         this->_data = tempData;
+        _mappedBytes = tempBytes;
         return *this;
     }
 
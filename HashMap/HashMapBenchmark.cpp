@@ -0,0 +1,282 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include "HashMap.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#endif
+
+#define USAGE_MSG "Usage: HashMapBenchmark [<number of keys>] [<number of lookups>] [<numa node mask>]"
+#define DEFAULT_KEYS (1UL << 24)
+#define DEFAULT_LOOKUPS (1UL << 24)
+#define PERF_UNAVAILABLE (- 1)
+// the partial counts merged by the merge runs, as a stream aggregated by that many threads
+#define AGGREGATION_PARTS 8
+
+
+/**
+ * opens a counter of the data TLB read misses of the calling thread
+ * @return the counter's file descriptor, or PERF_UNAVAILABLE if it cannot be opened
+ */
+static int openTlbCounter()
+{
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, - 1, - 1, 0);
+#else
+    return PERF_UNAVAILABLE;
+#endif
+}
+
+/**
+ * fills a hashmap with the given keys, then times random lookups of them
+ * @param name the name of the allocation mode, printed with the results
+ * @param map an empty hashmap configured with the allocation mode to measure
+ * @param keys the keys to insert
+ * @param lookups the keys to look up, in order
+ */
+static void runLookups(const char *name, HashMap<unsigned long, unsigned long> &map,
+                       const std::vector<unsigned long> &keys,
+                       const std::vector<unsigned long> &lookups)
+{
+    for (size_t i = 0; i < keys.size(); ++ i)
+    {
+        map.insert(keys[i], i);
+    }
+    int counter = openTlbCounter();
+#ifdef __linux__
+    if (counter != PERF_UNAVAILABLE)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    unsigned long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long key : lookups)
+    {
+        sum += map.at(key);
+    }
+    auto end = std::chrono::steady_clock::now();
+    long long misses = - 1;
+#ifdef __linux__
+    if (counter != PERF_UNAVAILABLE)
+    {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+        {
+            misses = - 1;
+        }
+        close(counter);
+    }
+#endif
+    double ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << name << "," << keys.size() << "," << (map.table_mapped() ? 1 : 0) << ","
+              << ns / (double) lookups.size() << ",";
+    if (misses >= 0)
+    {
+        std::cout << (double) misses / (double) lookups.size();
+    }
+    else
+    {
+        std::cout << "n/a";
+    }
+    std::cout << "," << sum % 10 << std::endl;
+}
+
+/**
+ * @param start the start of a measured run
+ * @return the nanoseconds since start
+ */
+static double nanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+/**
+ * adds count to the value of a key, or inserts it with count, the way aggregation was written
+ * before upsert: a lookup of the key, then a second search of its bucket to update or insert it
+ * @param map the counts
+ * @param key the key to count
+ * @param count the occurrences to add
+ */
+static void findThenInsert(HashMap<unsigned long, unsigned long> &map, unsigned long key,
+                           unsigned long count)
+{
+    if (map.contains_key(key))
+    {
+        map.at(key) += count;
+    }
+    else
+    {
+        map.insert(key, count);
+    }
+}
+
+/**
+ * prints a CSV line of an aggregation run
+ * @param name the name of the run
+ * @param updates the number of counts added to the map
+ * @param ns the nanoseconds the run took
+ * @param map the counts after the run
+ * @param key a key whose count is printed as a checksum
+ */
+static void printAggregation(const char *name, size_t updates, double ns,
+                             HashMap<unsigned long, unsigned long> &map, unsigned long key)
+{
+    std::cout << name << "," << updates << "," << map.size() << "," << ns / (double) updates
+              << "," << map.at(key) << std::endl;
+}
+
+/**
+ * counts the occurrences of the keys of a stream, first one key at a time with find then insert
+ * and with upsert, then by merging partial counts of AGGREGATION_PARTS slices of the stream with
+ * find then insert and with merge. The partial counts are built before the merge runs start, so
+ * those measure the merge alone.
+ * @param stream the keys to count, with repetitions
+ */
+static void runAggregations(const std::vector<unsigned long> &stream)
+{
+    {
+        HashMap<unsigned long, unsigned long> map;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long key : stream)
+        {
+            findThenInsert(map, key, 1);
+        }
+        printAggregation("find_insert", stream.size(), nanosecondsSince(start), map, stream[0]);
+    }
+    {
+        HashMap<unsigned long, unsigned long> map;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long key : stream)
+        {
+            map.upsert(key, 1, [](unsigned long &count)
+            {
+                ++ count;
+            });
+        }
+        printAggregation("upsert", stream.size(), nanosecondsSince(start), map, stream[0]);
+    }
+
+    // the partial counts of every slice, as pairs for the find then insert loop and as hashmaps
+    // for merge
+    std::vector<std::vector<std::pair<unsigned long, unsigned long>>> pairs(AGGREGATION_PARTS);
+    std::vector<HashMap<unsigned long, unsigned long>> parts(AGGREGATION_PARTS);
+    size_t updates = 0;
+    for (size_t p = 0; p < AGGREGATION_PARTS; ++ p)
+    {
+        std::vector<unsigned long> slice(stream.begin() + stream.size() * p / AGGREGATION_PARTS,
+                                         stream.begin() +
+                                         stream.size() * (p + 1) / AGGREGATION_PARTS);
+        std::sort(slice.begin(), slice.end());
+        for (size_t i = 0; i < slice.size(); ++ i)
+        {
+            if (i == 0 || slice[i] != slice[i - 1])
+            {
+                pairs[p].emplace_back(slice[i], 0);
+            }
+            ++ pairs[p].back().second;
+        }
+        for (auto &pair : pairs[p])
+        {
+            parts[p].insert(pair.first, pair.second);
+        }
+        updates += pairs[p].size();
+    }
+    {
+        HashMap<unsigned long, unsigned long> map;
+        auto start = std::chrono::steady_clock::now();
+        for (auto &part : pairs)
+        {
+            for (auto &pair : part)
+            {
+                findThenInsert(map, pair.first, pair.second);
+            }
+        }
+        printAggregation("merge_find_insert", updates, nanosecondsSince(start), map, stream[0]);
+    }
+    {
+        HashMap<unsigned long, unsigned long> map;
+        auto start = std::chrono::steady_clock::now();
+        for (auto &part : parts)
+        {
+            map.merge(std::move(part), [](unsigned long a, unsigned long b)
+            {
+                return a + b;
+            });
+        }
+        printAggregation("merge", updates, nanosecondsSince(start), map, stream[0]);
+    }
+}
+
+/**
+ * compares lookups on a large hashmap whose table is on the regular heap, on huge pages and
+ * interleaved across NUMA nodes. Prints a CSV line per mode with the ns per lookup and the data
+ * TLB misses per lookup. Then counts the looked up keys with find then insert against upsert and
+ * merge, see runAggregations, and prints a CSV line per run with the ns per update.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc > 4)
+    {
+        std::cerr << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    size_t numKeys = (argc > 1) ? strtoul(argv[1], nullptr, 10) : DEFAULT_KEYS;
+    size_t numLookups = (argc > 2) ? strtoul(argv[2], nullptr, 10) : DEFAULT_LOOKUPS;
+    unsigned long nodeMask = (argc > 3) ? strtoul(argv[3], nullptr, 0) : 1UL;
+    if (numKeys == 0 || numLookups == 0)
+    {
+        std::cerr << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937_64 gen(42);
+    std::vector<unsigned long> keys(numKeys);
+    for (size_t i = 0; i < numKeys; ++ i)
+    {
+        keys[i] = gen();
+    }
+    std::vector<unsigned long> lookups(numLookups);
+    std::uniform_int_distribution<size_t> pick(0, numKeys - 1);
+    for (size_t i = 0; i < numLookups; ++ i)
+    {
+        lookups[i] = keys[pick(gen)];
+    }
+
+    std::cout << "mode,keys,mapped,ns_per_lookup,dtlb_misses_per_lookup,checksum" << std::endl;
+    {
+        HashMap<unsigned long, unsigned long> map;
+        runLookups("heap", map, keys, lookups);
+    }
+    {
+        HashMap<unsigned long, unsigned long> map;
+        map.set_table_allocation(HUGE_PAGE_TABLE);
+        runLookups("huge_pages", map, keys, lookups);
+    }
+    {
+        HashMap<unsigned long, unsigned long> map;
+        map.set_table_allocation(HUGE_PAGE_TABLE, NUMA_INTERLEAVE, nodeMask);
+        runLookups("huge_pages_interleaved", map, keys, lookups);
+    }
+
+    std::cout << "aggregation,updates,distinct_keys,ns_per_update,checksum" << std::endl;
+    runAggregations(lookups);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,433 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <cstdlib>
+#include "Filters.h"
+#include "ShadeTable.h"
+#include "ImageIO.h"
+#include "ThreadPool.h"
+
+#define USAGE_ERR_MSG "Usage: BatchFilter [--memory MB] <filters> <output directory> " \
+                      "<images or @list>...\n" \
+                      "filters: comma separated blur, sobel, quantization:<levels>, " \
+                      "gamma:<gamma>, threshold:<level>\n"
+#define FILTER_ERR_MSG "Invalid filter.\n"
+#define LIST_ERR_MSG "Error opening image list.\n"
+#define OUTPUT_ERR_MSG "Error creating output directory.\n"
+#define DUPLICATE_ERR_MSG "Two images have the same file name, and would overwrite each other's " \
+                          "output.\n"
+// followed by the path of the image
+#define IMAGE_ERR_MSG "Error reading or writing image: "
+// the default bound of the memory of the images in flight
+#define DEFAULT_MEMORY_MB 1024
+// the bytes an image holds in flight per byte of its file: the mapped file, and the float channels
+// read from it and written by the filters, for 8 bit pixels
+#define FLIGHT_BYTES_PER_FILE_BYTE 9
+// the most images in flight per thread of the pool, enough to keep every stage busy
+#define FLIGHT_IMAGES_PER_THREAD 4
+// how long the thread scheduling the images waits for an image to finish when it has no task to
+// help with
+#define ADMIT_WAIT_MS 1
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * the stages of an image, each timed separately
+ */
+enum Stage
+{
+    DECODE,
+    FILTER,
+    ENCODE,
+    // from the image being admitted to it being written, waiting in the queues included
+    TOTAL,
+    STAGES
+};
+
+static const char *const STAGE_NAMES[STAGES] = {"decode", "filter", "encode", "total"};
+
+/**
+ * a single image of the batch on its way through the stages
+ */
+struct Job
+{
+    std::string input;
+    std::string output;
+    // the bytes the image is charged against the memory bound
+    size_t cost;
+    Image image;
+    Clock::time_point admitted;
+};
+
+/**
+ * the state shared by the scheduling thread and the stages
+ */
+struct Batch
+{
+    FilterPipeline pipeline;
+    // the latencies of every image in every stage, in seconds, indexed by the image
+    std::vector<double> latencies[STAGES];
+    // whether every image could not be read or written, set by the stages and reported by the
+    // scheduling thread, since a pool worker must not exit
+    std::vector<char> failed;
+    size_t memoryBound;
+    int imagesBound;
+    size_t inFlightBytes;
+    int inFlight;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+/**
+ * @param start the start of a stage
+ * @return the seconds since start
+ */
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * parses a filter chain into a pipeline
+ * @param spec the filters, comma separated, with the parameter of a filter after a colon
+ * @param pipeline the pipeline to add the filters to
+ */
+static void parseFilters(const std::string &spec, FilterPipeline &pipeline)
+{
+    std::stringstream filters(spec);
+    std::string filter;
+    while (std::getline(filters, filter, ','))
+    {
+        size_t colon = filter.find(':');
+        std::string name = filter.substr(0, colon);
+        std::string parameter = colon == std::string::npos ? "" : filter.substr(colon + 1);
+        if (name == "blur" && parameter.empty())
+        {
+            pipeline.blur();
+        }
+        else if (name == "sobel" && parameter.empty())
+        {
+            pipeline.sobel();
+        }
+        else if (name == "quantization" && !parameter.empty())
+        {
+            int levels = atoi(parameter.c_str());
+            if (levels <= 0 || levels > SHADES)
+            {
+                std::cerr << FILTER_ERR_MSG;
+                exit(1);
+            }
+            pipeline.quantization(levels);
+        }
+        else if (name == "gamma" && !parameter.empty())
+        {
+            pipeline.point(ShadeTable::gamma((float) atof(parameter.c_str())));
+        }
+        else if (name == "threshold" && !parameter.empty())
+        {
+            pipeline.point(ShadeTable::threshold((float) atof(parameter.c_str())));
+        }
+        else
+        {
+            std::cerr << FILTER_ERR_MSG;
+            exit(1);
+        }
+    }
+}
+
+/**
+ * adds the images of an argument to the inputs
+ * @param argument the path of an image, or @ and the path of a file listing an image per line
+ * @param inputs the inputs to add to
+ */
+static void addInputs(const std::string &argument, std::vector<std::string> &inputs)
+{
+    if (argument.empty() || argument[0] != '@')
+    {
+        inputs.push_back(argument);
+        return;
+    }
+    std::ifstream list(argument.substr(1));
+    if (!list)
+    {
+        std::cerr << LIST_ERR_MSG;
+        exit(1);
+    }
+    std::string line;
+    while (std::getline(list, line))
+    {
+        if (!line.empty())
+        {
+            inputs.push_back(line);
+        }
+    }
+}
+
+/**
+ * ends the way of an image through the stages and frees its memory for the next images
+ * @param batch the batch
+ * @param job the image
+ * @param index the index of the image
+ * @param failed whether the image could not be read or written
+ */
+static void finishJob(Batch &batch, const std::shared_ptr<Job> &job, size_t index, bool failed)
+{
+    job->image.channels.clear();
+    batch.latencies[TOTAL][index] = secondsSince(job->admitted);
+    {
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        batch.failed[index] = failed;
+        batch.inFlightBytes -= job->cost;
+        -- batch.inFlight;
+        // notified under the mutex: once the last image is done the scheduling thread returns
+        // and destroys the batch, which it cannot do before the mutex is released
+        batch.finished.notify_all();
+    }
+}
+
+/**
+ * writes the filtered image, the last stage
+ * @param batch the batch
+ * @param job the image
+ * @param index the index of the image
+ */
+static void encodeStage(Batch &batch, const std::shared_ptr<Job> &job, size_t index)
+{
+    Clock::time_point start = Clock::now();
+    bool written = tryWriteImage(job->output, job->image);
+    batch.latencies[ENCODE][index] = secondsSince(start);
+    finishJob(batch, job, index, !written);
+}
+
+/**
+ * runs the filters on every channel of the image, then queues the encoding. The filters work on
+ * 8 bit shades, so the channels of an image of another maxValue, 16 bit ones in particular, are
+ * scaled to [0, 255] for them and back to [0, maxValue] after them, keeping 8 bits of precision,
+ * rather than clamped to 255.
+ * @param batch the batch
+ * @param job the image
+ * @param index the index of the image
+ */
+static void filterStage(Batch &batch, const std::shared_ptr<Job> &job, size_t index)
+{
+    Clock::time_point start = Clock::now();
+    int maxValue = job->image.maxValue;
+    for (Matrix &channel : job->image.channels)
+    {
+        if (maxValue == SHADES - 1)
+        {
+            channel = batch.pipeline.run(channel);
+            continue;
+        }
+        channel *= (float) (SHADES - 1) / (float) maxValue;
+        channel = batch.pipeline.run(channel);
+        channel *= (float) maxValue / (float) (SHADES - 1);
+    }
+    batch.latencies[FILTER][index] = secondsSince(start);
+    ThreadPool::instance().submit([&batch, job, index]()
+    {
+        encodeStage(batch, job, index);
+    });
+}
+
+/**
+ * reads the image, then queues the filters. An image which cannot be read ends here.
+ * @param batch the batch
+ * @param job the image
+ * @param index the index of the image
+ */
+static void decodeStage(Batch &batch, const std::shared_ptr<Job> &job, size_t index)
+{
+    Clock::time_point start = Clock::now();
+    bool read = tryReadImage(job->input, job->image);
+    batch.latencies[DECODE][index] = secondsSince(start);
+    if (!read)
+    {
+        finishJob(batch, job, index, true);
+        return;
+    }
+    ThreadPool::instance().submit([&batch, job, index]()
+    {
+        filterStage(batch, job, index);
+    });
+}
+
+/**
+ * waits on the calling thread until a condition on the batch holds, running tasks of the pool
+ * meanwhile
+ * @param batch the batch
+ * @param done the condition, checked under the mutex of the batch
+ */
+template<class Condition>
+static void helpUntil(Batch &batch, Condition done)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(batch.mutex);
+            if (done())
+            {
+                return;
+            }
+        }
+        if (ThreadPool::instance().runTask())
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.finished.wait_for(lock, std::chrono::milliseconds(ADMIT_WAIT_MS), done);
+    }
+}
+
+/**
+ * @param latencies the latencies of a stage, sorted
+ * @param fraction the fraction of the latencies at or below the percentile
+ * @return the percentile of the latencies, in milliseconds
+ */
+static double percentileMs(const std::vector<double> &latencies, double fraction)
+{
+    if (latencies.empty())
+    {
+        return 0;
+    }
+    size_t rank = (size_t) (fraction * (double) (latencies.size() - 1) + 0.5);
+    return latencies[rank] * 1e3;
+}
+
+/**
+ * runs a filter chain over a batch of PGM and PPM images. Every image goes through decode, filter
+ * and encode as separate tasks of the work stealing pool: a worker queues the next stage of its
+ * image on its own queue and runs it next, while idle workers steal the oldest stages of the
+ * others, so the stages of different images overlap across the threads. Images are admitted only
+ * while the memory they hold in flight is within the bound and there are at most
+ * FLIGHT_IMAGES_PER_THREAD of them per thread, one at least, and the thread scheduling them helps
+ * with the stages while it waits. The pool has MATRIX_THREADS threads.
+ * An image which cannot be read or written is skipped, and reported once the others are done.
+ * Prints the throughput and the percentiles of the latency of every stage as CSV, of the images
+ * which were written.
+ * @param argc the number of arguments
+ * @param argv [--memory MB] filters, output directory, images or @ and a list of images
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if any image was skipped. Exits with a failure on any
+ * invalid argument, or two images of the same file name.
+ */
+int main(int argc, char *argv[])
+{
+    Batch batch;
+    batch.memoryBound = (size_t) DEFAULT_MEMORY_MB << 20;
+    batch.imagesBound = ThreadPool::instance().size() * FLIGHT_IMAGES_PER_THREAD;
+    batch.inFlightBytes = 0;
+    batch.inFlight = 0;
+    int arg = 1;
+    if (arg + 1 < argc && std::string(argv[arg]) == "--memory")
+    {
+        batch.memoryBound = (size_t) std::max(atol(argv[arg + 1]), 1L) << 20;
+        arg += 2;
+    }
+    if (argc - arg < 3)
+    {
+        std::cerr << USAGE_ERR_MSG;
+        exit(1);
+    }
+    parseFilters(argv[arg], batch.pipeline);
+    std::filesystem::path outputDir(argv[arg + 1]);
+    std::error_code error;
+    std::filesystem::create_directories(outputDir, error);
+    if (error)
+    {
+        std::cerr << OUTPUT_ERR_MSG;
+        exit(1);
+    }
+    std::vector<std::string> inputs;
+    for (int i = arg + 2; i < argc; ++ i)
+    {
+        addInputs(argv[i], inputs);
+    }
+    std::vector<std::string> outputs;
+    std::set<std::string> names;
+    for (const std::string &input : inputs)
+    {
+        std::filesystem::path name = std::filesystem::path(input).filename();
+        if (!names.insert(name.string()).second)
+        {
+            std::cerr << DUPLICATE_ERR_MSG;
+            exit(1);
+        }
+        outputs.push_back((outputDir / name).string());
+    }
+    for (std::vector<double> &latencies : batch.latencies)
+    {
+        latencies.assign(inputs.size(), 0);
+    }
+    batch.failed.assign(inputs.size(), 0);
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < inputs.size(); ++ i)
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->input = inputs[i];
+        job->output = outputs[i];
+        std::uintmax_t fileBytes = std::filesystem::file_size(job->input, error);
+        job->cost = error ? 0 : (size_t) fileBytes * FLIGHT_BYTES_PER_FILE_BYTE;
+        helpUntil(batch, [&]()
+        {
+            return batch.inFlight == 0 || (batch.inFlight < batch.imagesBound &&
+                                           batch.inFlightBytes + job->cost <= batch.memoryBound);
+        });
+        {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            batch.inFlightBytes += job->cost;
+            ++ batch.inFlight;
+        }
+        job->admitted = Clock::now();
+        ThreadPool::instance().submit([&batch, job, i]()
+        {
+            decodeStage(batch, job, i);
+        });
+    }
+    helpUntil(batch, [&]()
+    {
+        return batch.inFlight == 0;
+    });
+    double seconds = secondsSince(start);
+
+    size_t failures = 0;
+    for (size_t i = 0; i < inputs.size(); ++ i)
+    {
+        if (batch.failed[i])
+        {
+            std::cerr << IMAGE_ERR_MSG << inputs[i] << std::endl;
+            ++ failures;
+        }
+    }
+    size_t written = inputs.size() - failures;
+    std::cout << "images,failed,threads,seconds,images_s" << std::endl;
+    std::cout << written << "," << failures << "," << ThreadPool::instance().size() << ","
+              << seconds << "," << (double) written / seconds << std::endl;
+    std::cout << "stage,p50_ms,p90_ms,p99_ms,max_ms" << std::endl;
+    for (int stage = 0; stage < STAGES; ++ stage)
+    {
+        std::vector<double> latencies;
+        for (size_t i = 0; i < inputs.size(); ++ i)
+        {
+            if (!batch.failed[i])
+            {
+                latencies.push_back(batch.latencies[stage][i]);
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << STAGE_NAMES[stage] << "," << percentileMs(latencies, 0.5) << ","
+                  << percentileMs(latencies, 0.9) << "," << percentileMs(latencies, 0.99) << ","
+                  << percentileMs(latencies, 1) << std::endl;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
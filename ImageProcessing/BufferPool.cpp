@@ -0,0 +1,228 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "BufferPool.h"
+
+#define POOL_ENV "MATRIX_POOL"
+// the most bytes kept in cached buffers over all the size classes
+#define POOL_MAX_CACHED_BYTES ((size_t) 256 << 20)
+// the most cached buffers of a single size class
+#define POOL_MAX_CLASS_BUFFERS 16
+// the size class of buffers too large to be pooled
+#define UNPOOLED_CLASS (- 1)
+
+/**
+ * the header before every buffer, padded to BUFFER_ALIGNMENT so that the buffer stays aligned
+ */
+struct BufferHeader
+{
+    size_t capacity;
+    int sizeClass;
+};
+
+static_assert(sizeof(BufferHeader) <= BUFFER_ALIGNMENT, "A buffer header must fit its padding.");
+
+
+/**
+ * @param sizeClass a size class
+ * @return the size in bytes of the buffers of the class
+ */
+static size_t classBytes(int sizeClass)
+{
+    int shift = POOL_MIN_SHIFT + sizeClass / POOL_CLASSES_PER_SHIFT;
+    size_t step = ((size_t) 1 << shift) / POOL_CLASSES_PER_SHIFT;
+    return ((size_t) 1 << shift) + (size_t) (sizeClass % POOL_CLASSES_PER_SHIFT) * step;
+}
+
+/**
+ * @param bytes the size of a request
+ * @return the smallest size class which can serve the request, UNPOOLED_CLASS if none can
+ */
+static int classOf(size_t bytes)
+{
+    if (bytes <= ((size_t) 1 << POOL_MIN_SHIFT))
+    {
+        return 0;
+    }
+    if (bytes > ((size_t) 1 << POOL_MAX_SHIFT))
+    {
+        return UNPOOLED_CLASS;
+    }
+    // 2^shift < bytes <= 2^(shift + 1)
+    int shift = 63 - __builtin_clzll((unsigned long long) (bytes - 1));
+    size_t step = ((size_t) 1 << shift) / POOL_CLASSES_PER_SHIFT;
+    int sub = (int) ((bytes - ((size_t) 1 << shift) + step - 1) / step);
+    return (shift - POOL_MIN_SHIFT) * POOL_CLASSES_PER_SHIFT + sub;
+}
+
+/**
+ * @param buffer a buffer returned by acquire
+ * @return the header of the buffer
+ */
+static BufferHeader *headerOf(const void *buffer)
+{
+    return (BufferHeader *) ((char *) buffer - BUFFER_ALIGNMENT);
+}
+
+/**
+ * allocates a buffer and its header
+ * @param capacity the usable size of the buffer
+ * @param sizeClass the size class of the buffer
+ * @return the buffer
+ */
+static void *allocateBuffer(size_t capacity, int sizeClass)
+{
+    // aligned_alloc takes a multiple of the alignment
+    size_t padded = (capacity + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+    void *block = aligned_alloc(BUFFER_ALIGNMENT, BUFFER_ALIGNMENT + padded);
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    BufferHeader *header = (BufferHeader *) block;
+    header->capacity = capacity;
+    header->sizeClass = sizeClass;
+    return (char *) block + BUFFER_ALIGNMENT;
+}
+
+/**
+ * frees a buffer and its header
+ * @param buffer the buffer to free
+ */
+static void freeBuffer(void *buffer)
+{
+    free(headerOf(buffer));
+}
+
+
+/**
+ * constructs the pool, caching unless MATRIX_POOL is 0
+ */
+BufferPool::BufferPool() : _enabled(true), _hits(0), _misses(0), _cachedBytes(0)
+{
+    const char *env = getenv(POOL_ENV);
+    if (env != nullptr && strcmp(env, "0") == 0)
+    {
+        _enabled = false;
+    }
+}
+
+/**
+ * frees the cached buffers
+ */
+BufferPool::~BufferPool()
+{
+    trim();
+}
+
+/**
+ * @return the process wide pool
+ */
+BufferPool &BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+/**
+ * gets a buffer, cached if one of the size class is available and new otherwise
+ * @param bytes the least size of the buffer
+ * @return a BUFFER_ALIGNMENT aligned buffer, its content is unspecified
+ */
+void *BufferPool::acquire(size_t bytes)
+{
+    int sizeClass = classOf(bytes);
+    if (sizeClass == UNPOOLED_CLASS)
+    {
+        _misses++;
+        return allocateBuffer(bytes, UNPOOLED_CLASS);
+    }
+    SizeClass &cached = _classes[sizeClass];
+    {
+        std::lock_guard<std::mutex> lock(cached.mutex);
+        if (!cached.buffers.empty())
+        {
+            void *buffer = cached.buffers.back();
+            cached.buffers.pop_back();
+            _cachedBytes -= classBytes(sizeClass);
+            _hits++;
+            return buffer;
+        }
+    }
+    _misses++;
+    return allocateBuffer(classBytes(sizeClass), sizeClass);
+}
+
+/**
+ * gives a buffer back to the pool
+ * @param buffer a buffer returned by acquire, or nullptr
+ */
+void BufferPool::release(void *buffer)
+{
+    if (buffer == nullptr)
+    {
+        return;
+    }
+    int sizeClass = headerOf(buffer)->sizeClass;
+    if (sizeClass != UNPOOLED_CLASS && _enabled)
+    {
+        size_t bytes = classBytes(sizeClass);
+        SizeClass &cached = _classes[sizeClass];
+        std::lock_guard<std::mutex> lock(cached.mutex);
+        if (cached.buffers.size() < POOL_MAX_CLASS_BUFFERS &&
+            _cachedBytes + bytes <= POOL_MAX_CACHED_BYTES)
+        {
+            cached.buffers.push_back(buffer);
+            _cachedBytes += bytes;
+            return;
+        }
+    }
+    freeBuffer(buffer);
+}
+
+/**
+ * @param buffer a buffer returned by acquire
+ * @return the usable size of the buffer in bytes, at least the size requested
+ */
+size_t BufferPool::capacity(const void *buffer)
+{
+    return headerOf(buffer)->capacity;
+}
+
+/**
+ * turns caching on or off
+ * @param enabled whether to cache released buffers
+ */
+void BufferPool::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+    if (!enabled)
+    {
+        trim();
+    }
+}
+
+/**
+ * frees every cached buffer
+ */
+void BufferPool::trim()
+{
+    for (int c = 0; c < POOL_CLASSES; ++ c)
+    {
+        std::lock_guard<std::mutex> lock(_classes[c].mutex);
+        for (void *buffer : _classes[c].buffers)
+        {
+            freeBuffer(buffer);
+            _cachedBytes -= classBytes(c);
+        }
+        _classes[c].buffers.clear();
+    }
+}
+
+/**
+ * @return the counters of the pool
+ */
+BufferPool::Stats BufferPool::stats() const
+{
+    return Stats{_hits, _misses, _cachedBytes};
+}
@@ -0,0 +1,111 @@
+#ifndef EX5_BUFFERPOOL_H
+#define EX5_BUFFERPOOL_H
+
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// the alignment of every buffer: a cache line, and the width of an AVX-512 register
+#define BUFFER_ALIGNMENT 64
+// size classes are kept for buffers of up to 2^POOL_MAX_SHIFT bytes, larger ones are not pooled
+#define POOL_MIN_SHIFT 6
+#define POOL_MAX_SHIFT 30
+// every power of two is split into this many size classes, so a buffer wastes at most a quarter
+#define POOL_CLASSES_PER_SHIFT 4
+#define POOL_CLASSES ((POOL_MAX_SHIFT - POOL_MIN_SHIFT) * POOL_CLASSES_PER_SHIFT + 1)
+
+/**
+ * a process wide pool of BUFFER_ALIGNMENT aligned buffers. Requests are rounded up to a size class,
+ * and a released buffer is kept for the next request of its class rather than freed, so that
+ * temporaries of the same size, such as those of a filter applied to image after image, cost no
+ * call to the allocator. Every class is guarded by its own mutex. The pool keeps a bounded number
+ * of bytes and frees whatever is released beyond that.
+ * Caching can be turned off with the MATRIX_POOL=0 environment variable.
+ */
+class BufferPool
+{
+public:
+    /**
+     * counters of the pool since it was created
+     */
+    struct Stats
+    {
+        // requests served by a cached buffer
+        long hits;
+        // requests which called the allocator
+        long misses;
+        // bytes held by cached buffers
+        size_t cachedBytes;
+    };
+
+private:
+    /**
+     * the cached buffers of a single size class
+     */
+    struct SizeClass
+    {
+        std::vector<void *> buffers;
+        std::mutex mutex;
+    };
+
+    SizeClass _classes[POOL_CLASSES];
+    std::atomic<bool> _enabled;
+    std::atomic<long> _hits;
+    std::atomic<long> _misses;
+    std::atomic<size_t> _cachedBytes;
+
+    BufferPool();
+
+public:
+    /**
+     * frees the cached buffers
+     */
+    ~BufferPool();
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    /**
+     * @return the process wide pool
+     */
+    static BufferPool &instance();
+
+    /**
+     * gets a buffer, cached if one of the size class is available and new otherwise
+     * @param bytes the least size of the buffer
+     * @return a BUFFER_ALIGNMENT aligned buffer, its content is unspecified
+     */
+    void *acquire(size_t bytes);
+
+    /**
+     * gives a buffer back to the pool
+     * @param buffer a buffer returned by acquire, or nullptr
+     */
+    void release(void *buffer);
+
+    /**
+     * @param buffer a buffer returned by acquire
+     * @return the usable size of the buffer in bytes, at least the size requested
+     */
+    static size_t capacity(const void *buffer);
+
+    /**
+     * turns caching on or off. While it is off every buffer comes from the allocator and goes
+     * back to it.
+     * @param enabled whether to cache released buffers
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * frees every cached buffer
+     */
+    void trim();
+
+    /**
+     * @return the counters of the pool
+     */
+    Stats stats() const;
+};
+
+#endif //EX5_BUFFERPOOL_H
@@ -0,0 +1,559 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "Convolution.h"
+#include "ThreadPool.h"
+#include "Kernels.h"
+#include "Fft.h"
+#include "RowRing.h"
+
+#define KERNEL_ERR_MSG "Invalid Matrix dimensions.\n"
+// the largest error, relative to the largest tap, with which a kernel still counts as rank 1
+#define SEPARABLE_TOLERANCE 1e-6f
+// the gaussian taps reach this many standard deviations to each side
+#define GAUSSIAN_RADIUS_SIGMAS 3
+// the costs of the methods relative to a tap of the direct method, measured by MatrixBenchmark:
+// a tap of the separable method, and an FFT point times the log2 of the points of its block.
+// A direct tap took about 0.1ns, a separable one 0.15ns to 0.2ns and an FFT point log 3.5ns, so
+// on a 1024 x 1024 image the FFT overtakes the direct method at about 31 x 31 and the separable
+// method only well past 45 x 45.
+#define SEPARABLE_TAP_COST 1.6
+#define FFT_POINT_COST 35.0
+
+
+/**
+ * exits if a kernel has no taps
+ * @param kernel the kernel to check
+ */
+static void checkKernel(ConstMatrixView kernel)
+{
+    if (kernel.getRows() <= 0 || kernel.getCols() <= 0)
+    {
+        std::cerr << KERNEL_ERR_MSG;
+        exit(1);
+    }
+}
+
+/**
+ * maps an index outside of [0, n) into it according to a border mode
+ * @param i the index
+ * @param n the length of the image along the axis of the index, positive
+ * @param border the border mode
+ * @return the index of the pixel read at i, or -1 if the pixel is 0
+ */
+int borderIndex(int i, int n, BorderMode border)
+{
+    if (i >= 0 && i < n)
+    {
+        return i;
+    }
+    switch (border)
+    {
+        case BORDER_CLAMP:
+            return (i < 0) ? 0 : n - 1;
+        case BORDER_REFLECT:
+        {
+            if (n == 1)
+            {
+                return 0;
+            }
+            // reflecting about both edges repeats every 2 (n - 1) pixels
+            int period = 2 * (n - 1);
+            i %= period;
+            if (i < 0)
+            {
+                i += period;
+            }
+            return (i < n) ? i : period - i;
+        }
+        case BORDER_WRAP:
+            i %= n;
+            return (i < 0) ? i + n : i;
+        default:
+            return - 1;
+    }
+}
+
+/**
+ * copies a span of an image row with padding on both sides for a 1-D kernel. Only the pixels
+ * outside of the image go through the border mode, so the taps over the span read it with plain
+ * pointer arithmetic.
+ * @param image the image
+ * @param y the row index
+ * @param left the first column of the span
+ * @param width the number of columns of the span
+ * @param before the number of elements to pad before the span
+ * @param after the number of elements to pad after the span
+ * @param border how to read the pixels outside of the image
+ * @param padded the row to write into, before + width + after elements
+ */
+static void loadPaddedRow(ConstMatrixView image, int y, int left, int width, int before,
+                          int after, BorderMode border, float *padded)
+{
+    int cols = image.getCols();
+    int first = left - before;
+    int last = left + width + after;
+    // the columns inside of the image, copied as they are
+    int lo = std::max(first, 0);
+    int hi = std::min(last, cols);
+    if (lo < hi && image.contiguousRows())
+    {
+        std::copy(&image.at(y, lo), &image.at(y, lo) + (hi - lo), padded + (lo - first));
+    }
+    else
+    {
+        for (int x = lo; x < hi; ++ x)
+        {
+            padded[x - first] = image.at(y, x);
+        }
+    }
+    // the columns before and after the image, the whole span if it is outside of the image
+    for (int x = first; x < std::min(lo, last); ++ x)
+    {
+        int index = borderIndex(x, cols, border);
+        padded[x - first] = (index < 0) ? 0.f : image.at(y, index);
+    }
+    for (int x = std::max(hi, lo); x < last; ++ x)
+    {
+        int index = borderIndex(x, cols, border);
+        padded[x - first] = (index < 0) ? 0.f : image.at(y, index);
+    }
+}
+
+/**
+ * adds a padded row times a 1-D kernel to an accumulator row. The taps are added in their order,
+ * so with a zero border every output element sums its taps in the same order as the per pixel
+ * loop of the original convolution, the zeros of the padding adding nothing.
+ * @param acc the accumulator row, cols elements
+ * @param padded the padded image row, cols + count - 1 elements
+ * @param cols the number of columns
+ * @param taps the kernel
+ * @param count the number of taps
+ */
+static void accumulateRow(float *acc, const float *padded, int cols, const float *taps, int count)
+{
+    for (int b = 0; b < count; ++ b)
+    {
+        kernels::addScaled(acc, padded + b, taps[b], (size_t) cols);
+    }
+}
+
+/**
+ * writes an accumulator row into a result row
+ * @param dst the result row
+ * @param acc the accumulator row
+ * @param cols the number of columns
+ * @param round whether to round every element to the nearest integer
+ */
+static void storeRow(float *dst, const float *acc, int cols, bool round)
+{
+    for (int x = 0; x < cols; ++ x)
+    {
+        dst[x] = round ? rintf(acc[x]) : acc[x];
+    }
+}
+
+/**
+ * checks whether a kernel has rank 1, and if so splits it into a column and a row
+ * @param kernel the kernel to split
+ * @param separable set to the column and the row of the kernel if it is separable
+ * @return true if the kernel is separable, false otherwise
+ */
+bool separateKernel(ConstMatrixView kernel, SeparableKernel &separable)
+{
+    checkKernel(kernel);
+    int pivotRow = 0;
+    int pivotCol = 0;
+    for (int a = 0; a < kernel.getRows(); ++ a)
+    {
+        for (int b = 0; b < kernel.getCols(); ++ b)
+        {
+            if (std::fabs(kernel.at(a, b)) > std::fabs(kernel.at(pivotRow, pivotCol)))
+            {
+                pivotRow = a;
+                pivotCol = b;
+            }
+        }
+    }
+    float pivot = kernel.at(pivotRow, pivotCol);
+    if (pivot == 0)
+    {
+        return false;
+    }
+    // a rank 1 kernel is its pivot column times its pivot row divided by the pivot
+    std::vector<float> column((size_t) kernel.getRows());
+    std::vector<float> row((size_t) kernel.getCols());
+    for (int a = 0; a < kernel.getRows(); ++ a)
+    {
+        column[a] = kernel.at(a, pivotCol);
+    }
+    for (int b = 0; b < kernel.getCols(); ++ b)
+    {
+        row[b] = kernel.at(pivotRow, b) / pivot;
+    }
+    float tolerance = SEPARABLE_TOLERANCE * std::fabs(pivot);
+    for (int a = 0; a < kernel.getRows(); ++ a)
+    {
+        for (int b = 0; b < kernel.getCols(); ++ b)
+        {
+            if (std::fabs(column[a] * row[b] - kernel.at(a, b)) > tolerance)
+            {
+                return false;
+            }
+        }
+    }
+    separable.column = std::move(column);
+    separable.row = std::move(row);
+    return true;
+}
+
+/**
+ * @param length the length of the image along an axis
+ * @param taps the length of the kernel along the axis
+ * @return the length of the FFT blocks along the axis
+ */
+static int fftBlock(int length, int taps)
+{
+    return fastFftSize(std::min(length + taps - 1, std::max(FFT_MIN_BLOCK,
+                                                            FFT_BLOCK_KERNELS * taps)));
+}
+
+/**
+ * chooses the cheapest way to convolve, see Convolution.h
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param kernelRows the rows number of the kernel
+ * @param kernelCols the columns number of the kernel
+ * @param separable whether the kernel is separable
+ * @return the method convolve() uses
+ */
+ConvolutionMethod chooseConvolution(int rows, int cols, int kernelRows, int kernelCols,
+                                    bool separable)
+{
+    double direct = (double) kernelRows * kernelCols;
+    double separated = separable ? SEPARABLE_TAP_COST * (kernelRows + kernelCols) : direct;
+    int blockRows = fftBlock(rows, kernelRows);
+    int blockCols = fftBlock(cols, kernelCols);
+    double points = (double) blockRows * blockCols;
+    // a block outputs the pixels its margin leaves, or the whole image if that is smaller
+    double outputs = (double) std::min(blockRows - kernelRows + 1, rows) *
+                     std::min(blockCols - kernelCols + 1, cols);
+    double fft = FFT_POINT_COST * points * std::log2(points) / outputs;
+    if (fft < std::min(direct, separated))
+    {
+        return CONVOLUTION_FFT;
+    }
+    return (separated < direct) ? CONVOLUTION_SEPARABLE : CONVOLUTION_DIRECT;
+}
+
+/**
+ * convolves an image with a kernel of any size, see Convolution.h
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolve(ConstMatrixView image, ConstMatrixView kernel, BorderMode border, bool round)
+{
+    SeparableKernel separable;
+    bool isSeparable = kernel.getRows() > 1 && kernel.getCols() > 1 &&
+                       separateKernel(kernel, separable);
+    switch (chooseConvolution(image.getRows(), image.getCols(), kernel.getRows(),
+                              kernel.getCols(), isSeparable))
+    {
+        case CONVOLUTION_FFT:
+            return convolveFft(image, kernel, border, round);
+        case CONVOLUTION_SEPARABLE:
+            return convolveSeparable(image, separable, border, round);
+        default:
+            return convolveDirect(image, kernel, border, round);
+    }
+}
+
+/**
+ * convolves an image with a kernel, every output pixel summing all of its taps. The image is cut
+ * into cache sized tiles, see parallelTiles, and every tile keeps the padded spans of the image
+ * rows under the kernel in a ring, so each span is padded once per tile.
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolveDirect(ConstMatrixView image, ConstMatrixView kernel, BorderMode border,
+                      bool round)
+{
+    checkKernel(kernel);
+    int rows = image.getRows();
+    int cols = image.getCols();
+    int kernelRows = kernel.getRows();
+    int kernelCols = kernel.getCols();
+    int anchor = kernelCols / 2;
+    Matrix taps(kernel);
+    Matrix result(rows, cols, Matrix::NO_INIT);
+    // a tile keeps the padded rows under the kernel and an accumulator row
+    size_t columnBytes = (kernelRows + 1) * sizeof(float);
+    parallelTiles(rows, cols, kernelRows / 2, anchor, columnBytes, kernelRows * kernelCols,
+                  [&](const Tile &tile)
+    {
+        int width = tile.right - tile.left;
+        RowRing padded(kernelRows, width + kernelCols - 1);
+        std::vector<float> acc((size_t) width);
+        for (int i = tile.top; i < tile.bottom; ++ i)
+        {
+            std::fill(acc.begin(), acc.end(), 0.f);
+            for (int a = 0; a < kernelRows; ++ a)
+            {
+                int virtualRow = i + a - kernelRows / 2;
+                int y = borderIndex(virtualRow, rows, border);
+                if (y < 0)
+                {
+                    continue;
+                }
+                const float *row = padded.get(virtualRow, [&](float *dst)
+                {
+                    loadPaddedRow(image, y, tile.left, width, anchor, kernelCols - 1 - anchor,
+                                  border, dst);
+                });
+                accumulateRow(acc.data(), row, width, taps.rowData(a), kernelCols);
+            }
+            storeRow(result.rowData(i) + tile.left, acc.data(), width, round);
+        }
+    });
+    return result;
+}
+
+/**
+ * convolves an image with a separable kernel as a row pass and a column pass. The image is cut
+ * into cache sized tiles, see parallelTiles, and every tile keeps the row pass results of the
+ * image rows under the column in a ring, so each is computed once per tile.
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolveSeparable(ConstMatrixView image, const SeparableKernel &kernel, BorderMode border,
+                         bool round)
+{
+    int rows = image.getRows();
+    int cols = image.getCols();
+    int kernelRows = (int) kernel.column.size();
+    int kernelCols = (int) kernel.row.size();
+    if (kernelRows == 0 || kernelCols == 0)
+    {
+        std::cerr << KERNEL_ERR_MSG;
+        exit(1);
+    }
+    int anchor = kernelCols / 2;
+    Matrix result(rows, cols, Matrix::NO_INIT);
+    // a tile keeps the row passes under the column, a padded row and an accumulator row
+    size_t columnBytes = (kernelRows + 2) * sizeof(float);
+    parallelTiles(rows, cols, kernelRows / 2, anchor, columnBytes, kernelRows + kernelCols,
+                  [&](const Tile &tile)
+    {
+        int width = tile.right - tile.left;
+        RowRing passes(kernelRows, width);
+        std::vector<float> padded((size_t) width + kernelCols - 1);
+        std::vector<float> acc((size_t) width);
+        for (int i = tile.top; i < tile.bottom; ++ i)
+        {
+            std::fill(acc.begin(), acc.end(), 0.f);
+            for (int a = 0; a < kernelRows; ++ a)
+            {
+                int virtualRow = i + a - kernelRows / 2;
+                int y = borderIndex(virtualRow, rows, border);
+                if (y < 0)
+                {
+                    continue;
+                }
+                const float *pass = passes.get(virtualRow, [&](float *dst)
+                {
+                    loadPaddedRow(image, y, tile.left, width, anchor, kernelCols - 1 - anchor,
+                                  border, padded.data());
+                    std::fill(dst, dst + width, 0.f);
+                    accumulateRow(dst, padded.data(), width, kernel.row.data(), kernelCols);
+                });
+                kernels::addScaled(acc.data(), pass, kernel.column[a], (size_t) width);
+            }
+            storeRow(result.rowData(i) + tile.left, acc.data(), width, round);
+        }
+    });
+    return result;
+}
+
+/**
+ * transforms the rows of a block, the first step of a 2-D real transform
+ * @tparam Fill a callable (r, row) which writes the blockCols elements of block row r into row
+ * @param rowFft the plan of the rows
+ * @param blockRows the rows number of the block
+ * @param usedRows the rows of the block which are not all zeros, the first ones
+ * @param fill reads a block row
+ * @param spectrum set to the blockRows x (blockCols / 2 + 1) row spectra
+ */
+template<class Fill>
+static void rowSpectra(const RealFft &rowFft, int blockRows, int usedRows, Fill fill,
+                       Complex *spectrum)
+{
+    int width = rowFft.size() / 2 + 1;
+    std::vector<double> row((size_t) rowFft.size());
+    for (int r = 0; r < blockRows; ++ r)
+    {
+        Complex *out = spectrum + (size_t) r * width;
+        if (r >= usedRows)
+        {
+            std::fill(out, out + width, Complex());
+            continue;
+        }
+        fill(r, row.data());
+        rowFft.forward(row.data(), out);
+    }
+}
+
+/**
+ * convolves an image with a kernel by overlap-save, see Convolution.h
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolveFft(ConstMatrixView image, ConstMatrixView kernel, BorderMode border, bool round)
+{
+    checkKernel(kernel);
+    int rows = image.getRows();
+    int cols = image.getCols();
+    // an empty image has no tiles, and its blocks would be too short for a tile of the kernel
+    if (rows == 0 || cols == 0)
+    {
+        return Matrix(rows, cols);
+    }
+    int kernelRows = kernel.getRows();
+    int kernelCols = kernel.getCols();
+    int blockRows = fftBlock(rows, kernelRows);
+    int blockCols = fftBlock(cols, kernelCols);
+    int tileRows = blockRows - kernelRows + 1;
+    int tileCols = blockCols - kernelCols + 1;
+    int width = blockCols / 2 + 1;
+    RealFft rowFft(blockCols);
+    Fft columnFft(blockRows);
+
+    // the correlation with the kernel is the product with the conjugate of its spectrum, which is
+    // scaled here for the unnormalized inverse transforms
+    std::vector<Complex> kernelSpectrum((size_t) blockRows * width);
+    rowSpectra(rowFft, blockRows, kernelRows, [&](int r, double *row)
+    {
+        std::fill(row, row + blockCols, 0.0);
+        for (int b = 0; b < kernelCols; ++ b)
+        {
+            row[b] = kernel.at(r, b);
+        }
+    }, kernelSpectrum.data());
+    std::vector<Complex> column((size_t) blockRows);
+    double scale = 1.0 / ((double) blockRows * blockCols);
+    for (int c = 0; c < width; ++ c)
+    {
+        for (int r = 0; r < blockRows; ++ r)
+        {
+            column[r] = kernelSpectrum[(size_t) r * width + c];
+        }
+        columnFft.forward(column.data());
+        for (int r = 0; r < blockRows; ++ r)
+        {
+            kernelSpectrum[(size_t) r * width + c] = std::conj(column[r]) * scale;
+        }
+    }
+
+    Matrix result(rows, cols, Matrix::NO_INIT);
+    int tilesDown = (rows + tileRows - 1) / tileRows;
+    int tilesAcross = (cols + tileCols - 1) / tileCols;
+    ThreadPool::instance().parallelFor(0, tilesDown * tilesAcross, 1, [&](int lo, int hi)
+    {
+        std::vector<Complex> spectrum((size_t) blockRows * width);
+        std::vector<Complex> line((size_t) blockRows);
+        std::vector<double> out((size_t) blockCols);
+        for (int t = lo; t < hi; ++ t)
+        {
+            int top = (t / tilesAcross) * tileRows;
+            int left = (t % tilesAcross) * tileCols;
+            int outRows = std::min(tileRows, rows - top);
+            int outCols = std::min(tileCols, cols - left);
+            // the block starts at the first pixel the kernel reaches from the tile
+            int y0 = top - kernelRows / 2;
+            int x0 = left - kernelCols / 2;
+            int usedCols = outCols + kernelCols - 1;
+            bool inside = x0 >= 0 && x0 + usedCols <= cols;
+            rowSpectra(rowFft, blockRows, outRows + kernelRows - 1, [&](int r, double *row)
+            {
+                std::fill(row + usedCols, row + blockCols, 0.0);
+                int y = borderIndex(y0 + r, rows, border);
+                if (y < 0)
+                {
+                    std::fill(row, row + usedCols, 0.0);
+                    return;
+                }
+                for (int c = 0; c < usedCols; ++ c)
+                {
+                    int x = inside ? x0 + c : borderIndex(x0 + c, cols, border);
+                    row[c] = (x < 0) ? 0.0 : image.at(y, x);
+                }
+            }, spectrum.data());
+            for (int c = 0; c < width; ++ c)
+            {
+                for (int r = 0; r < blockRows; ++ r)
+                {
+                    line[r] = spectrum[(size_t) r * width + c];
+                }
+                columnFft.forward(line.data());
+                for (int r = 0; r < blockRows; ++ r)
+                {
+                    line[r] *= kernelSpectrum[(size_t) r * width + c];
+                }
+                columnFft.inverse(line.data());
+                for (int r = 0; r < outRows; ++ r)
+                {
+                    spectrum[(size_t) r * width + c] = line[r];
+                }
+            }
+            for (int r = 0; r < outRows; ++ r)
+            {
+                rowFft.inverse(spectrum.data() + (size_t) r * width, out.data());
+                float *dst = result.rowData(top + r) + left;
+                for (int x = 0; x < outCols; ++ x)
+                {
+                    dst[x] = round ? rintf((float) out[x]) : (float) out[x];
+                }
+            }
+        }
+    });
+    return result;
+}
+
+/**
+ * the taps of a normalized gaussian, 3 sigma to each side of the center
+ * @param sigma the standard deviation of the gaussian, positive
+ * @return the taps
+ */
+std::vector<float> gaussianTaps(float sigma)
+{
+    if (!(sigma > 0))
+    {
+        std::cerr << KERNEL_ERR_MSG;
+        exit(1);
+    }
+    int radius = std::max(1, (int) std::ceil(GAUSSIAN_RADIUS_SIGMAS * sigma));
+    std::vector<float> taps((size_t) 2 * radius + 1);
+    double sum = 0;
+    for (int t = - radius; t <= radius; ++ t)
+    {
+        double value = std::exp(- (double) t * t / (2.0 * sigma * sigma));
+        taps[t + radius] = (float) value;
+        sum += value;
+    }
+    for (float &tap : taps)
+    {
+        tap = (float) (tap / sum);
+    }
+    return taps;
+}
@@ -0,0 +1,145 @@
+#ifndef EX5_CONVOLUTION_H
+#define EX5_CONVOLUTION_H
+
+#include <vector>
+#include "Matrix.h"
+#include "MatrixView.h"
+
+// an FFT block spans this many kernels along each axis, but at least FFT_MIN_BLOCK pixels, so
+// that most of every block is output rather than margin. The length is then rounded up by
+// fastFftSize.
+#define FFT_BLOCK_KERNELS 4
+#define FFT_MIN_BLOCK 64
+
+/**
+ * how a convolution reads the pixels outside of the image, for an image "abcd"
+ */
+enum BorderMode
+{
+    // 0000|abcd|0000
+    BORDER_ZERO,
+    // aaaa|abcd|dddd
+    BORDER_CLAMP,
+    // dcb|abcd|cba, mirrored about the edge pixels
+    BORDER_REFLECT,
+    // abcd|abcd|abcd
+    BORDER_WRAP
+};
+
+/**
+ * maps an index outside of [0, n) into it according to a border mode
+ * @param i the index
+ * @param n the length of the image along the axis of the index, positive
+ * @param border the border mode
+ * @return the index of the pixel read at i, or -1 if the pixel is 0
+ */
+int borderIndex(int i, int n, BorderMode border);
+
+/**
+ * the ways convolve() can compute a convolution
+ */
+enum ConvolutionMethod
+{
+    // every output pixel sums all of its taps
+    CONVOLUTION_DIRECT,
+    // a row pass and a column pass, for kernels of rank 1
+    CONVOLUTION_SEPARABLE,
+    // products of spectra over overlapping blocks of the image
+    CONVOLUTION_FFT
+};
+
+/**
+ * a kernel written as the outer product of a column and a row, kernel(a, b) = column[a] * row[b]
+ */
+struct SeparableKernel
+{
+    std::vector<float> column;
+    std::vector<float> row;
+};
+
+/**
+ * checks whether a kernel has rank 1, and if so splits it into a column and a row. The pivot of
+ * the split is the largest element of the kernel, so a kernel of powers of two, such as those of
+ * blur and sobel, splits exactly.
+ * @param kernel the kernel to split
+ * @param separable set to the column and the row of the kernel if it is separable
+ * @return true if the kernel is separable, false otherwise
+ */
+bool separateKernel(ConstMatrixView kernel, SeparableKernel &separable);
+
+/**
+ * chooses the cheapest way to convolve by a cost model of each method per output pixel: the taps
+ * of the direct and the separable methods, and the transforms of the FFT blocks, whose relative
+ * costs were measured by MatrixBenchmark
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param kernelRows the rows number of the kernel
+ * @param kernelCols the columns number of the kernel
+ * @param separable whether the kernel is separable
+ * @return the method convolve() uses
+ */
+ConvolutionMethod chooseConvolution(int rows, int cols, int kernelRows, int kernelCols,
+                                    bool separable);
+
+/**
+ * convolves an image with a kernel of any size. As in convolution() the kernel is not flipped:
+ * result(i, j) is the sum of kernel(a, b) * image(i + a - ay, j + b - ax) where
+ * (ay, ax) = (kernel rows / 2, kernel columns / 2) is the anchor of the kernel, and the pixels
+ * outside of the image are read according to the border mode.
+ * The method is chosen by chooseConvolution: small kernels run directly, separable ones as a row
+ * pass and a column pass, and large ones through the FFT.
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer, as convolution() does
+ * @return the convolved image
+ */
+Matrix convolve(ConstMatrixView image, ConstMatrixView kernel, BorderMode border = BORDER_ZERO,
+                bool round = false);
+
+/**
+ * convolves an image with a kernel, every output pixel summing all of its taps
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolveDirect(ConstMatrixView image, ConstMatrixView kernel,
+                      BorderMode border = BORDER_ZERO, bool round = false);
+
+/**
+ * convolves an image with a separable kernel as a pass of the row over every image row and a pass
+ * of the column over the results, so a K x K kernel costs 2K rather than K^2 taps per pixel
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolveSeparable(ConstMatrixView image, const SeparableKernel &kernel,
+                         BorderMode border = BORDER_ZERO, bool round = false);
+
+/**
+ * convolves an image with a kernel by overlap-save: the image is cut into blocks, every block
+ * with the margin the kernel reaches into is transformed, multiplied by the spectrum of the kernel
+ * and transformed back, and the part of the block the circular wrap did not reach is kept.
+ * The transforms are in double, so the results are those of the direct method up to the rounding
+ * of its float sums.
+ * @param image the image, or a view of one, to convolve
+ * @param kernel the kernel to convolve with
+ * @param border how to read the pixels outside of the image
+ * @param round whether to round every result to the nearest integer
+ * @return the convolved image
+ */
+Matrix convolveFft(ConstMatrixView image, ConstMatrixView kernel,
+                   BorderMode border = BORDER_ZERO, bool round = false);
+
+/**
+ * the taps of a normalized gaussian, 3 sigma to each side of the center
+ * @param sigma the standard deviation of the gaussian, positive
+ * @return the taps
+ */
+std::vector<float> gaussianTaps(float sigma);
+
+#endif //EX5_CONVOLUTION_H
@@ -0,0 +1,338 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "Fft.h"
+
+#define FFT_SIZE_ERR_MSG "Invalid FFT length.\n"
+// the generic butterfly keeps radixes up to this one on the stack
+#define FFT_MAX_SMALL_RADIX 7
+
+
+/**
+ * multiplies two complex numbers. std::complex checks its product for NaN and infinities, which
+ * the transforms never produce from finite data, so the plain formula is used instead.
+ * @param a the lhs number
+ * @param b the rhs number
+ * @return a * b
+ */
+static inline Complex multiply(Complex a, Complex b)
+{
+    return Complex(a.real() * b.real() - a.imag() * b.imag(),
+                   a.real() * b.imag() + a.imag() * b.real());
+}
+
+/**
+ * @param n a length, positive
+ * @return true if the prime factors of n are 2, 3 and 5 only
+ */
+static bool isFastSize(int n)
+{
+    for (int p : {2, 3, 5})
+    {
+        while (n % p == 0)
+        {
+            n /= p;
+        }
+    }
+    return n == 1;
+}
+
+/**
+ * @param n a length, positive
+ * @return the smallest even length of at least n whose prime factors are 2, 3 and 5 only
+ */
+int fastFftSize(int n)
+{
+    int size = std::max(n, 2);
+    size += size % 2;
+    while (!isFastSize(size))
+    {
+        size += 2;
+    }
+    return size;
+}
+
+
+/**
+ * plans a transform
+ * @param n the length of the transform, positive
+ */
+Fft::Fft(int n) : _n(n)
+{
+    if (n <= 0)
+    {
+        std::cerr << FFT_SIZE_ERR_MSG;
+        exit(1);
+    }
+    int remaining = n;
+    int p = 4;
+    while (remaining > 1)
+    {
+        while (remaining % p != 0)
+        {
+            // 4, then 2, then the odd numbers, the first to divide being a prime
+            p = (p == 4) ? 2 : ((p == 2) ? 3 : p + 2);
+            if ((long) p * p > remaining)
+            {
+                p = remaining;
+            }
+        }
+        remaining /= p;
+        _factors.push_back(p);
+        _factors.push_back(remaining);
+    }
+    _twiddles.resize((size_t) n);
+    for (int k = 0; k < n; ++ k)
+    {
+        double angle = - 2 * M_PI * k / n;
+        _twiddles[k] = Complex(std::cos(angle), std::sin(angle));
+    }
+}
+
+/**
+ * one level of the recursion: transforms the p * m elements read from in with the given stride
+ * into out. The p interleaved subsequences of length m are transformed first, then combined by
+ * the butterflies of radix p.
+ * @param out the p * m transformed elements
+ * @param in the elements to transform, stride apart
+ * @param stride the distance between two elements of in, and the step of the twiddles
+ * @param factors the (radix, remaining length) pair of this level and those of the levels below
+ */
+void Fft::_transform(Complex *out, const Complex *in, int stride, const int *factors) const
+{
+    int p = factors[0];
+    int m = factors[1];
+    if (m == 1)
+    {
+        for (int q = 0; q < p; ++ q)
+        {
+            out[q] = in[q * stride];
+        }
+    }
+    else
+    {
+        for (int q = 0; q < p; ++ q)
+        {
+            _transform(out + q * m, in + q * stride, stride * p, factors + 2);
+        }
+    }
+    const Complex *twiddles = _twiddles.data();
+    if (p == 2)
+    {
+        for (int u = 0; u < m; ++ u)
+        {
+            Complex t = multiply(out[u + m], twiddles[u * stride]);
+            out[u + m] = out[u] - t;
+            out[u] += t;
+        }
+        return;
+    }
+    if (p == 4)
+    {
+        for (int u = 0; u < m; ++ u)
+        {
+            Complex s0 = multiply(out[u + m], twiddles[u * stride]);
+            Complex s1 = multiply(out[u + 2 * m], twiddles[2 * u * stride]);
+            Complex s2 = multiply(out[u + 3 * m], twiddles[3 * u * stride]);
+            Complex s5 = out[u] - s1;
+            Complex f0 = out[u] + s1;
+            Complex s3 = s0 + s2;
+            Complex s4 = s0 - s2;
+            out[u] = f0 + s3;
+            out[u + 2 * m] = f0 - s3;
+            // s5 - i s4 and s5 + i s4
+            out[u + m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+            out[u + 3 * m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+        }
+        return;
+    }
+    if (p == 3)
+    {
+        // exp(-2 pi i / 3)
+        double sine = twiddles[stride * m].imag();
+        for (int u = 0; u < m; ++ u)
+        {
+            Complex s1 = multiply(out[u + m], twiddles[u * stride]);
+            Complex s2 = multiply(out[u + 2 * m], twiddles[2 * u * stride]);
+            Complex sum = s1 + s2;
+            Complex difference = (s1 - s2) * sine;
+            Complex middle = out[u] - sum * 0.5;
+            out[u] += sum;
+            out[u + m] = Complex(middle.real() - difference.imag(),
+                                 middle.imag() + difference.real());
+            out[u + 2 * m] = Complex(middle.real() + difference.imag(),
+                                     middle.imag() - difference.real());
+        }
+        return;
+    }
+    if (p == 5)
+    {
+        // exp(-2 pi i / 5) and exp(-4 pi i / 5)
+        Complex ya = twiddles[stride * m];
+        Complex yb = twiddles[2 * stride * m];
+        for (int u = 0; u < m; ++ u)
+        {
+            Complex s0 = out[u];
+            Complex s1 = multiply(out[u + m], twiddles[u * stride]);
+            Complex s2 = multiply(out[u + 2 * m], twiddles[2 * u * stride]);
+            Complex s3 = multiply(out[u + 3 * m], twiddles[3 * u * stride]);
+            Complex s4 = multiply(out[u + 4 * m], twiddles[4 * u * stride]);
+            Complex s7 = s1 + s4;
+            Complex s10 = s1 - s4;
+            Complex s8 = s2 + s3;
+            Complex s9 = s2 - s3;
+            out[u] = s0 + s7 + s8;
+            Complex s5 = s0 + s7 * ya.real() + s8 * yb.real();
+            Complex s6(s10.imag() * ya.imag() + s9.imag() * yb.imag(),
+                       - s10.real() * ya.imag() - s9.real() * yb.imag());
+            out[u + m] = s5 - s6;
+            out[u + 4 * m] = s5 + s6;
+            Complex s11 = s0 + s7 * yb.real() + s8 * ya.real();
+            Complex s12(- s10.imag() * yb.imag() + s9.imag() * ya.imag(),
+                        s10.real() * yb.imag() - s9.real() * ya.imag());
+            out[u + 2 * m] = s11 + s12;
+            out[u + 3 * m] = s11 - s12;
+        }
+        return;
+    }
+    // the generic butterfly, a direct DFT of length p over every group
+    Complex small[FFT_MAX_SMALL_RADIX];
+    std::vector<Complex> large;
+    Complex *scratch = small;
+    if (p > FFT_MAX_SMALL_RADIX)
+    {
+        large.resize((size_t) p);
+        scratch = large.data();
+    }
+    for (int u = 0; u < m; ++ u)
+    {
+        for (int q = 0; q < p; ++ q)
+        {
+            scratch[q] = out[u + q * m];
+        }
+        for (int q = 0; q < p; ++ q)
+        {
+            int k = u + q * m;
+            Complex sum = scratch[0];
+            // stride * k < n, so the index of the twiddle of r * k wraps at most once a step
+            int step = stride * k;
+            int index = 0;
+            for (int r = 1; r < p; ++ r)
+            {
+                index += step;
+                if (index >= _n)
+                {
+                    index -= _n;
+                }
+                sum += multiply(scratch[r], twiddles[index]);
+            }
+            out[k] = sum;
+        }
+    }
+}
+
+/**
+ * transforms in place, X[k] = sum of x[j] exp(-2 pi i jk / n)
+ * @param data the n elements to transform
+ */
+void Fft::forward(Complex *data) const
+{
+    if (_n == 1)
+    {
+        return;
+    }
+    thread_local std::vector<Complex> scratch;
+    scratch.assign(data, data + _n);
+    _transform(data, scratch.data(), 1, _factors.data());
+}
+
+/**
+ * transforms back in place, x[j] = sum of X[k] exp(2 pi i jk / n), n times the original
+ * @param data the n elements to transform
+ */
+void Fft::inverse(Complex *data) const
+{
+    // the inverse is the conjugate of the forward transform of the conjugate
+    for (int k = 0; k < _n; ++ k)
+    {
+        data[k] = std::conj(data[k]);
+    }
+    forward(data);
+    for (int k = 0; k < _n; ++ k)
+    {
+        data[k] = std::conj(data[k]);
+    }
+}
+
+
+/**
+ * plans a transform
+ * @param n the length of the transform, even and positive
+ */
+RealFft::RealFft(int n) : _n(n), _half(std::max(n / 2, 1))
+{
+    if (n <= 0 || n % 2 != 0)
+    {
+        std::cerr << FFT_SIZE_ERR_MSG;
+        exit(1);
+    }
+    _twiddles.resize((size_t) n / 2 + 1);
+    for (int k = 0; k <= n / 2; ++ k)
+    {
+        double angle = - 2 * M_PI * k / n;
+        _twiddles[k] = Complex(std::cos(angle), std::sin(angle));
+    }
+}
+
+/**
+ * transforms a real sequence. The even and the odd elements are packed as the real and the
+ * imaginary parts of a half length sequence, and the spectra of both are separated from its
+ * transform by the conjugate symmetry.
+ * @param in the n elements to transform
+ * @param out set to the first n / 2 + 1 elements of the spectrum
+ */
+void RealFft::forward(const double *in, Complex *out) const
+{
+    int half = _n / 2;
+    thread_local std::vector<Complex> packed;
+    packed.resize((size_t) half);
+    for (int k = 0; k < half; ++ k)
+    {
+        packed[k] = Complex(in[2 * k], in[2 * k + 1]);
+    }
+    _half.forward(packed.data());
+    for (int k = 0; k <= half; ++ k)
+    {
+        Complex z = packed[k % half];
+        Complex mirrored = std::conj(packed[(half - k) % half]);
+        Complex even = (z + mirrored) * 0.5;
+        Complex odd = multiply(z - mirrored, Complex(0, - 0.5));
+        out[k] = even + multiply(_twiddles[k], odd);
+    }
+}
+
+/**
+ * transforms the first half of a conjugate symmetric spectrum back to n times the real sequence
+ * @param in the n / 2 + 1 elements of the spectrum
+ * @param out set to the n elements of the sequence
+ */
+void RealFft::inverse(const Complex *in, double *out) const
+{
+    int half = _n / 2;
+    thread_local std::vector<Complex> packed;
+    packed.resize((size_t) half);
+    for (int k = 0; k < half; ++ k)
+    {
+        Complex mirrored = std::conj(in[half - k]);
+        Complex even = in[k] + mirrored;
+        Complex odd = multiply(in[k] - mirrored, std::conj(_twiddles[k]));
+        // twice the spectrum of the packed sequence, so the result comes out n times the original
+        packed[k] = even + Complex(- odd.imag(), odd.real());
+    }
+    _half.inverse(packed.data());
+    for (int k = 0; k < half; ++ k)
+    {
+        out[2 * k] = packed[k].real();
+        out[2 * k + 1] = packed[k].imag();
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef EX5_FFT_H
+#define EX5_FFT_H
+
+#include <complex>
+#include <vector>
+
+typedef std::complex<double> Complex;
+
+/**
+ * @param n a length, positive
+ * @return the smallest even length of at least n whose prime factors are 2, 3 and 5 only, for
+ * which the transforms are fastest
+ */
+int fastFftSize(int n);
+
+/**
+ * a plan for the discrete Fourier transform of a fixed length, as a mixed radix Cooley-Tukey
+ * transform. The length is split into factors of 4, 2, 3 and 5 first and any other prime last,
+ * so lengths of other primes work but are slower. The transforms are unnormalized: an inverse
+ * after a forward multiplies by the length. A plan is not changed by a transform, so threads may
+ * share it.
+ */
+class Fft
+{
+private:
+    int _n;
+    // pairs of (radix, remaining length), outermost first
+    std::vector<int> _factors;
+    // exp(-2 pi i k / n) for every k < n
+    std::vector<Complex> _twiddles;
+
+    /**
+     * one level of the recursion: transforms the p * m elements read from in with the given
+     * stride into out
+     */
+    void _transform(Complex *out, const Complex *in, int stride, const int *factors) const;
+
+public:
+    /**
+     * plans a transform
+     * @param n the length of the transform, positive
+     */
+    explicit Fft(int n);
+
+    /**
+     * @return the length of the transform
+     */
+    int size() const
+    {
+        return _n;
+    }
+
+    /**
+     * transforms in place, X[k] = sum of x[j] exp(-2 pi i jk / n)
+     * @param data the n elements to transform
+     */
+    void forward(Complex *data) const;
+
+    /**
+     * transforms back in place, x[j] = sum of X[k] exp(2 pi i jk / n), n times the original
+     * @param data the n elements to transform
+     */
+    void inverse(Complex *data) const;
+};
+
+/**
+ * a plan for the transform of a real sequence of even length n, computed as a complex transform
+ * of length n / 2. The spectrum of a real sequence is conjugate symmetric, so only its first
+ * n / 2 + 1 elements are kept.
+ */
+class RealFft
+{
+private:
+    int _n;
+    Fft _half;
+    // exp(-2 pi i k / n) for every k <= n / 2
+    std::vector<Complex> _twiddles;
+
+public:
+    /**
+     * plans a transform
+     * @param n the length of the transform, even and positive
+     */
+    explicit RealFft(int n);
+
+    /**
+     * @return the length of the transform
+     */
+    int size() const
+    {
+        return _n;
+    }
+
+    /**
+     * transforms a real sequence
+     * @param in the n elements to transform
+     * @param out set to the first n / 2 + 1 elements of the spectrum
+     */
+    void forward(const double *in, Complex *out) const;
+
+    /**
+     * transforms the first half of a conjugate symmetric spectrum back to n times the real
+     * sequence
+     * @param in the n / 2 + 1 elements of the spectrum
+     * @param out set to the n elements of the sequence
+     */
+    void inverse(const Complex *in, double *out) const;
+};
+
+#endif //EX5_FFT_H
@@ -1,171 +1,862 @@
-#include <iostream>
-#include <fstream>
-#include <cmath>
-#include <ostream>
-#include <istream>
-#include "Matrix.h"
-
-#define SHADES 256
-
-
-/**
- * applies quantization filter on an image represented as a matrix
- * @param image a matrix representing the image to apply the filter on
- * @param levels the wanted level of shades
- * @return a matrix representing the image after quantization
- */
-Matrix quantization(Matrix &image, int const levels)
-{
-    Matrix newMatrix(image.getRows(), image.getCols());
-    newMatrix = image;
-    int scaleRange = (SHADES / levels) ;
-    for (int i = 0; i < newMatrix.getCols() * newMatrix.getRows(); ++ i)
-    {
-        float curVal = newMatrix[i];
-        int j = 0;
-        int destRange = 0;
-        while ((j + scaleRange - 1) < SHADES)
-        {
-            if (curVal >= (float )j && curVal <= (float )j + (float )scaleRange-1)
-            {
-                destRange = j;
-                break;
-            }
-            j += scaleRange ;
-        }
-        newMatrix[i] = floorf(((float )destRange + (float )(destRange + scaleRange - 1)) / 2);
-    }
-    return newMatrix;
-}
-
-
-/**
- * calculates the convolution of two given matrices
- * @param matrix the matrix to apply convolution on
- * @param convolutionMat the matrix to apply convolution with
- * @return the matrix after convolution
- */
-Matrix convolution(Matrix const &matrix, Matrix &convolutionMat)
-{
-    Matrix newMat(matrix.getRows(), matrix.getCols());
-    for (int i = 0; i < matrix.getCols() * matrix.getRows(); ++ i)
-    {
-        float val = 0;
-        for (int j = 0; j < 3; ++ j)
-        {
-            for (int k = 0; k < 3; ++ k)
-            {
-                int index = i - (matrix.getCols() + 1) + (j * (matrix.getRows()) + k );
-                int indCol = index % (matrix.getCols());
-                int indRow = (index - indCol) / matrix.getCols();
-                int iCol = i % (matrix.getCols());
-                int iRow = (i - iCol) / matrix.getCols();
-                if (index >= 0 && index < matrix.getCols() * matrix.getRows() && indCol >= iCol -
-                    1 && indCol <= iCol + 1 && indRow >= iRow - 1 && indRow <= iRow + 1)
-                {
-                    val += (convolutionMat(j, k) * matrix[index]);
-                }
-                else
-                {
-                    val += 0;
-                }
-            }
-        }
-        (newMat)[i] = rintf(val);
-    }
-    return newMat;
-
-}
-
-/**
- * applies blurring affect on a given image represented as a matrix
- * @param image a matrix representing the image to apply the filter on
- * @return a matrix representing the image after blurring
- */
-Matrix blur(const Matrix &image)
-{
-    Matrix convolutionMat(3, 3);
-    // concatenate values using the >> operator and then multiple by 1/16 using *= operator
-    // the values are: {{1, 2, 1}, {2, 4, 2}, {1, 2, 1}} * 1/16
-    convolutionMat[0] = 1.f;
-    convolutionMat[1] = 2.f;
-    convolutionMat[2] = 1.f;
-    convolutionMat[3] = 2.f;
-    convolutionMat[4] = 4.f;
-    convolutionMat[5] = 2.f;
-    convolutionMat[6] = 1.f;
-    convolutionMat[7] = 2.f;
-    convolutionMat[8] = 1.f;
-    convolutionMat /= 16;
-    Matrix newMatrix = convolution(image, convolutionMat); // HOW DOES T WORK IF "CONVOLUTION"
-    // FUNCTION RETURNS A VALUE AND NOT A REFERENCE;
-    for (int i = 0; i < newMatrix.getCols()*newMatrix.getRows(); ++ i)
-    {
-        if (newMatrix[i] > 255)
-        {
-            newMatrix[i] = 255;
-        }
-        if (newMatrix[i] < 0)
-        {
-            newMatrix[i] = 0;
-        }
-    }
-
-    return newMatrix;
-}
-
-/**
- * applies sobel affect on a given image
- * @param image the matrix representing the image to apply the filter on
- * @return the matrix after the application of the filter
- */
-Matrix sobel(const Matrix &image)
-{
-    Matrix Gx(3, 3);
-    // concatenate values using the >> operator and then multiple by 1/8 using *= operator
-    // the values are: {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}} * 1/8
-    Gx[0] = 1.f;
-    Gx[1] = 0.f;
-    Gx[2] = - 1.f;
-    Gx[3] = 2.f;
-    Gx[4] = 0.f;
-    Gx[5] = - 2.f;
-    Gx[6] = 1.f;
-    Gx[7] = 0.f;
-    Gx[8] = - 1.f;
-    Gx /= 8;
-    Matrix newMatrix1(image.getRows(), image.getCols());
-    newMatrix1 = convolution(image, Gx);
-
-
-    Matrix Gy(3, 3);
-    // concatenate values using the >> operator and then multiple by 1/8 using *= operator
-    // the values are: {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}} * 1/8
-    Gy[0] = 1.f;
-    Gy[1] = 2.f;
-    Gy[2] = 1.f;
-    Gy[3] = 0.f;
-    Gy[4] = 0.f;
-    Gy[5] = 0.f;
-    Gy[6] = - 1.f;
-    Gy[7] = - 2.f;
-    Gy[8] = - 1.f;
-    Gy /= 8;
-    Matrix newMatrix2(image.getRows(), image.getCols());
-    newMatrix2 = convolution(image, Gy);
-
-    newMatrix1 += newMatrix2;
-    for (int i = 0; i < newMatrix1.getCols()*newMatrix2.getRows(); ++ i)
-    {
-        if (newMatrix1[i] > 255)
-        {
-            newMatrix1[i] = 255;
-        }
-        if (newMatrix1[i] < 0)
-        {
-            newMatrix1[i] = 0;
-        }
-    }
-
-    return newMatrix1;
-}
\ No newline at end of file
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <ostream>
+#include <istream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "Filters.h"
+#include "ThreadPool.h"
+#include "Convolution.h"
+#include "Kernels.h"
+#include "RowRing.h"
+#include "SummedAreaTable.h"
+#include "Trace.h"
+
+#define STREAM_SIZE_ERR_MSG "Invalid image dimensions.\n"
+#define STREAM_READ_ERR_MSG "Error loading from input stream.\n"
+#define RADIUS_ERR_MSG "Invalid filter radius.\n"
+// the floating point operations of a pixel, for the trace: the nine taps of the blur, and the six
+// taps of each gradient of sobel and their sum
+#define BLUR_FLOPS 17
+#define SOBEL_FLOPS 25
+// and of the box filters: the four corners of the box and its area, and for the local contrast
+// those of the squares, the variance and the stretch
+#define BOX_FLOPS 5
+#define CONTRAST_FLOPS 14
+// the least rows of a band of a box filter, which builds the summed area table of the band and of
+// the radius above and below it
+#define BOX_BAND_ROWS 64
+// the standard deviation below which the local contrast filter stops stretching, so that the
+// noise of flat areas is amplified at most deviation / CONTRAST_MIN_DEVIATION times
+#define CONTRAST_MIN_DEVIATION 8.0
+// 1.5 * 2^52: adding and subtracting it rounds a double below 2^51 in magnitude to an integer,
+// halves to even as rint does, in a loop the compiler vectorizes rather than a call per pixel
+#define ROUNDING_MAGIC 6755399441055744.0
+
+// the blur kernel {{1, 2, 1}, {2, 4, 2}, {1, 2, 1}} / 16
+static const float BLUR_TAPS[9] = {1.f / 16, 2.f / 16, 1.f / 16,
+                                   2.f / 16, 4.f / 16, 2.f / 16,
+                                   1.f / 16, 2.f / 16, 1.f / 16};
+// the horizontal gradient {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}} / 8
+static const float SOBEL_X_TAPS[9] = {1.f / 8, 0.f, - 1.f / 8,
+                                      2.f / 8, 0.f, - 2.f / 8,
+                                      1.f / 8, 0.f, - 1.f / 8};
+// the vertical gradient {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}} / 8
+static const float SOBEL_Y_TAPS[9] = {1.f / 8, 2.f / 8, 1.f / 8,
+                                      0.f, 0.f, 0.f,
+                                      - 1.f / 8, - 2.f / 8, - 1.f / 8};
+
+
+/**
+ * applies quantization filter on an image represented as a matrix. Every shade is quantized once
+ * into a table, so the filter is a single lookup per pixel, see ShadeTable.
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param levels the wanted level of shades
+ * @return a matrix representing the image after quantization
+ */
+Matrix quantization(ConstMatrixView image, int const levels)
+{
+    TRACE_SPAN("quantization");
+    TRACE_COUNT("quantization", 0, 2LL * image.getRows() * image.getCols(), 0);
+    return ShadeTable::quantization(levels).apply(image);
+}
+
+/**
+ * applies quantization filter on a byte image, as a lookup per pixel
+ * @param image the byte image to apply the filter on
+ * @param levels the wanted level of shades
+ * @return the byte image after quantization
+ */
+ByteMatrix quantization(const ByteMatrix &image, int const levels)
+{
+    TRACE_SPAN("quantization");
+    TRACE_COUNT("quantization", 0, 2LL * image.getRows() * image.getCols(), 0);
+    return ShadeTable::quantization(levels).apply(image);
+}
+
+
+/**
+ * calculates the convolution of two given matrices. The kernel may be of any size, its anchor is
+ * its center element, and every result is rounded to an integer.
+ * @param matrix the matrix, or a view of one, to apply convolution on
+ * @param convolutionMat the matrix to apply convolution with
+ * @param border how to read the pixels outside of the matrix
+ * @return the matrix after convolution
+ */
+Matrix convolution(ConstMatrixView matrix, ConstMatrixView convolutionMat, BorderMode border)
+{
+    TRACE_SPAN("convolution");
+    TRACE_COUNT("convolution", 0, 2LL * matrix.getRows() * matrix.getCols(),
+                2LL * matrix.getRows() * matrix.getCols() * convolutionMat.getRows() *
+                convolutionMat.getCols());
+    return convolve(matrix, convolutionMat, border, true);
+}
+
+/**
+ * runs a 3 x 3 stencil over an image which is zero padded at its borders. The image is cut into
+ * cache sized tiles, see parallelTiles, and every tile keeps just the three spans of image rows
+ * around its current row, with the column on each side that the stencil reads, so the stencil
+ * reads the neighbours of a whole span with shifted loads rather than per pixel bounds checks.
+ * @tparam T the element type of the rows
+ * @tparam Load a callable (r, x0, x1, dst) which writes the elements of image row r in columns
+ * [x0, x1) into dst
+ * @tparam Stencil a callable (above, center, below, r, tile) which writes the span of result row
+ * r in the columns of the tile, the spans may be read one element before their start and one
+ * after their end
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param load reads a span of an image row
+ * @param stencil computes a span of a result row
+ */
+template<class T, class Load, class Stencil>
+static void stencilRows(int rows, int cols, Load load, Stencil stencil)
+{
+    // three padded spans and the output span
+    size_t columnBytes = 3 * sizeof(T) + sizeof(float);
+    parallelTiles(rows, cols, 1, 1, columnBytes, 1, [&](const Tile &tile)
+    {
+        int width = tile.right - tile.left;
+        std::vector<T> window(3 * (size_t) (width + 2), T());
+        T *padded[3] = {window.data() + 1, window.data() + width + 3,
+                        window.data() + 2 * (width + 2) + 1};
+        // the columns of the padded span which are inside of the image
+        int x0 = std::max(tile.left - 1, 0);
+        int x1 = std::min(tile.right + 1, cols);
+        auto fill = [&](int r, T *dst)
+        {
+            if (r < 0 || r >= rows)
+            {
+                std::fill(dst - 1, dst + width + 1, T());
+                return;
+            }
+            load(r, x0, x1, dst + (x0 - tile.left));
+        };
+        fill(tile.top - 1, padded[0]);
+        fill(tile.top, padded[1]);
+        for (int r = tile.top; r < tile.bottom; ++ r)
+        {
+            fill(r + 1, padded[2]);
+            stencil(padded[0], padded[1], padded[2], r, tile);
+            std::swap(padded[0], padded[1]);
+            std::swap(padded[1], padded[2]);
+        }
+    });
+}
+
+/**
+ * reads a span of an image row
+ * @param image the image
+ * @param r the index of the row
+ * @param x0 the first column of the span
+ * @param x1 the column after the last of the span
+ * @param dst the elements of the span
+ */
+static void loadSpan(ConstMatrixView image, int r, int x0, int x1, float *dst)
+{
+    if (image.contiguousRows())
+    {
+        std::copy(&image.at(r, x0), &image.at(r, x0) + (x1 - x0), dst);
+        return;
+    }
+    for (int x = x0; x < x1; ++ x)
+    {
+        dst[x - x0] = image.at(r, x);
+    }
+}
+
+/**
+ * runs a 3 x 3 float stencil over an image, see stencilRows
+ * @tparam Stencil a callable (above, center, below, out, width), out being the span of the
+ * result row
+ * @param image the image to run the stencil over
+ * @param stencil the stencil
+ * @return the matrix of the results
+ */
+template<class Stencil>
+static Matrix floatStencil(ConstMatrixView image, Stencil stencil)
+{
+    Matrix result(image.getRows(), image.getCols(), Matrix::NO_INIT);
+    stencilRows<float>(image.getRows(), image.getCols(), [&](int r, int x0, int x1, float *dst)
+    {
+        loadSpan(image, r, x0, x1, dst);
+    }, [&](const float *a, const float *b, const float *c, int r, const Tile &tile)
+    {
+        stencil(a, b, c, result.rowData(r) + tile.left, tile.right - tile.left);
+    });
+    return result;
+}
+
+/**
+ * runs a 3 x 3 byte stencil over a byte image, see stencilRows
+ * @tparam Stencil a callable (above, center, below, out, width), out being the span of the
+ * result row
+ * @param image the image to run the stencil over
+ * @param stencil the stencil
+ * @return the byte image of the results
+ */
+template<class Stencil>
+static ByteMatrix byteStencil(const ByteMatrix &image, Stencil stencil)
+{
+    ByteMatrix result(image.getRows(), image.getCols());
+    stencilRows<uint8_t>(image.getRows(), image.getCols(),
+                         [&](int r, int x0, int x1, uint8_t *dst)
+    {
+        std::copy(image.rowData(r) + x0, image.rowData(r) + x1, dst);
+    }, [&](const uint8_t *a, const uint8_t *b, const uint8_t *c, int r, const Tile &tile)
+    {
+        stencil(a, b, c, result.rowData(r) + tile.left, tile.right - tile.left);
+    });
+    return result;
+}
+
+/**
+ * clamps the elements of a row to the shades
+ * @param row the row
+ * @param cols the number of elements of the row
+ */
+static void clampShades(float *row, int cols)
+{
+    kernels::clamp(row, row, 0.f, (float) (SHADES - 1), (size_t) cols);
+}
+
+/**
+ * blurs a span of a row, see blur()
+ * @param a the span of the row above, readable one element beyond each end
+ * @param b the span of the row itself, readable one element beyond each end
+ * @param c the span of the row below, readable one element beyond each end
+ * @param out the span of the result row
+ * @param width the number of elements of the spans
+ */
+static void blurSpan(const float *a, const float *b, const float *c, float *out, int width)
+{
+    kernels::stencil3x3(out, a, b, c, BLUR_TAPS, true, (size_t) width);
+    clampShades(out, width);
+}
+
+/**
+ * applies sobel on a span of a row, see sobel()
+ * @param a the span of the row above, readable one element beyond each end
+ * @param b the span of the row itself, readable one element beyond each end
+ * @param c the span of the row below, readable one element beyond each end
+ * @param out the span of the result row
+ * @param width the number of elements of the spans
+ */
+static void sobelSpan(const float *a, const float *b, const float *c, float *out, int width)
+{
+    // a span of the vertical gradient per thread, the horizontal one goes straight to out
+    thread_local std::vector<float> gy;
+    gy.resize((size_t) width);
+    kernels::stencilPair3x3(out, gy.data(), a, b, c, SOBEL_X_TAPS, SOBEL_Y_TAPS, true,
+                            (size_t) width);
+    kernels::addClamped(out, out, gy.data(), 0.f, (float) (SHADES - 1), (size_t) width);
+}
+
+/**
+ * applies blurring affect on a given image represented as a matrix. The result is that of
+ * convolution() with the blur kernel, clamped to the shades, computed by a vector stencil.
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @return a matrix representing the image after blurring
+ */
+Matrix blur(ConstMatrixView image)
+{
+    TRACE_SPAN("blur");
+    TRACE_COUNT("blur", 0, 2LL * image.getRows() * image.getCols(),
+                (long long) BLUR_FLOPS * image.getRows() * image.getCols());
+    return floatStencil(image, blurSpan);
+}
+
+/**
+ * applies blurring affect on a byte image. The result is the same as that of the float blur on the
+ * same shades, computed in 16 bit integers.
+ * @param image the byte image to apply the filter on
+ * @return the byte image after blurring
+ */
+ByteMatrix blur(const ByteMatrix &image)
+{
+    TRACE_SPAN("blur");
+    TRACE_COUNT("blur", 0, 2LL * image.getRows() * image.getCols(), 0);
+    return byteStencil(image, [](const uint8_t *a, const uint8_t *b, const uint8_t *c,
+                                 uint8_t *out, int width)
+    {
+        kernels::blur3x3Bytes(out, a, b, c, (size_t) width);
+    });
+}
+
+/**
+ * applies a gaussian blur of any radius on a given image represented as a matrix. The gaussian is
+ * separable, so the cost per pixel grows linearly with sigma.
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param sigma the standard deviation of the gaussian in pixels, positive
+ * @param border how to read the pixels outside of the image
+ * @return a matrix representing the image after blurring
+ */
+Matrix gaussianBlur(ConstMatrixView image, float sigma, BorderMode border)
+{
+    TRACE_SPAN("gaussian_blur");
+    SeparableKernel gaussian;
+    gaussian.column = gaussianTaps(sigma);
+    gaussian.row = gaussian.column;
+    TRACE_COUNT("gaussian_blur", 0, 2LL * image.getRows() * image.getCols(),
+                4LL * image.getRows() * image.getCols() * (long long) gaussian.row.size());
+    Matrix newMatrix = convolveSeparable(image, gaussian, border, true);
+    for (int i = 0; i < newMatrix.getCols()*newMatrix.getRows(); ++ i)
+    {
+        newMatrix[i] = std::min(std::max(newMatrix[i], 0.f), 255.f);
+    }
+    return newMatrix;
+}
+
+/**
+ * runs a filter of the boxes around the pixels of an image through summed area tables. The image
+ * is cut into tiles, see parallelTiles, and every tile into bands of rows. A band builds the table
+ * of its pixels and of the radius around them, in the memory of the table of the band before it,
+ * so that no table is larger than a few bands and a tile allocates a single one, and
+ * sums the boxes of a span of every row from two rows of it. The cost of a pixel is the same for
+ * any radius, but for the halo every band sums again, which the bands are tall enough to keep
+ * small.
+ * @tparam Span a callable (r, x0, x1, sums, squares, dst) which writes the span of result row r in
+ * the columns [x0, x1) into dst, from the sums of the boxes of the span and of their squares
+ * @param image the matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of a box to each side of its center, 0 or more
+ * @param squares whether to sum the squares of the boxes too, passed as nullptr otherwise
+ * @param span computes a span of a result row
+ * @return the matrix after the application of the filter
+ */
+template<class Span>
+static Matrix boxTables(ConstMatrixView image, int radius, bool squares, Span span)
+{
+    if (radius < 0)
+    {
+        std::cerr << RADIUS_ERR_MSG;
+        exit(1);
+    }
+    int rows = image.getRows();
+    int cols = image.getCols();
+    Matrix result(rows, cols, Matrix::NO_INIT);
+    int bandRows = std::max(BOX_BAND_ROWS, 2 * TILE_HALO_RATIO * radius);
+    // the tables of a band, the sums of a span and the output span
+    size_t columnBytes = (squares ? 2 : 1) * sizeof(double) * ((size_t) bandRows + 2 * radius + 2) +
+                         sizeof(float);
+    parallelTiles(rows, cols, radius, radius, columnBytes, 1, [&](const Tile &tile)
+    {
+        int left = std::max(tile.left - radius, 0);
+        int right = std::min(tile.right + radius, cols);
+        int width = tile.right - tile.left;
+        std::vector<double> sums((size_t) width);
+        std::vector<double> squareSums(squares ? (size_t) width : 0);
+        SummedAreaTable table;
+        for (int top = tile.top; top < tile.bottom; top += bandRows)
+        {
+            int bottom = std::min(top + bandRows, tile.bottom);
+            int first = std::max(top - radius, 0);
+            int last = std::min(bottom + radius, rows);
+            table.build(image.submatrix(first, left, last - first, right - left), squares);
+            for (int r = top; r < bottom; ++ r)
+            {
+                table.boxSums(r - first, tile.left - left, tile.right - left, radius, sums.data(),
+                              squares ? squareSums.data() : nullptr);
+                span(r, tile.left, tile.right, sums.data(), squares ? squareSums.data() : nullptr,
+                     result.rowData(r) + tile.left);
+            }
+        }
+    });
+    return result;
+}
+
+/**
+ * @param x a double
+ * @return x rounded to the nearest integer, halves to even
+ */
+static double roundHalfEven(double x)
+{
+    return std::fabs(x) < ROUNDING_MAGIC / 3 ? (x + ROUNDING_MAGIC) - ROUNDING_MAGIC : x;
+}
+
+/**
+ * @param x a row or a column of an image
+ * @param n the rows or the columns number of the image
+ * @param radius the pixels of a box to each side of its center
+ * @return the rows or the columns of the box around x inside of the image
+ */
+static int boxExtent(int x, int n, int radius)
+{
+    return std::min(x + radius + 1, n) - std::max(x - radius, 0);
+}
+
+/**
+ * applies a box blur of any radius on a given image: the mean of the box around every pixel, with
+ * zeros outside of the image, rounded. For integer shades the sums are exact and a mean is never
+ * close enough to a half for the scaling to round it the other way, so every pixel is the exact
+ * mean rounded, which convolution() with a kernel of equal taps matches for 8 bit shades up to
+ * radius 32. Every pixel costs the same for any radius, see boxTables.
+ * @param image the matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of the box to each side of its center, 0 or more
+ * @return the matrix after the application of the filter
+ */
+Matrix boxFilter(ConstMatrixView image, int radius)
+{
+    TRACE_SPAN("box_filter");
+    TRACE_COUNT("box_filter", 0, 2LL * image.getRows() * image.getCols(),
+                (long long) BOX_FLOPS * image.getRows() * image.getCols());
+    double scale = 1.0 / ((2.0 * radius + 1) * (2.0 * radius + 1));
+    return boxTables(image, radius, false, [&](int, int x0, int x1, const double *sums,
+                                               const double *, float *dst)
+    {
+        for (int x = 0; x < x1 - x0; ++ x)
+        {
+            dst[x] = (float) roundHalfEven(sums[x] * scale);
+        }
+    });
+}
+
+/**
+ * applies a mean filter of any radius on a given image: every pixel becomes the mean of the box
+ * around it, of just the pixels inside of the image, so the borders are not darkened. Every pixel
+ * costs the same for any radius, see boxTables.
+ * @param image the matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of the box to each side of its center, 0 or more
+ * @return the matrix after the application of the filter, not rounded
+ */
+Matrix meanFilter(ConstMatrixView image, int radius)
+{
+    TRACE_SPAN("mean_filter");
+    TRACE_COUNT("mean_filter", 0, 2LL * image.getRows() * image.getCols(),
+                (long long) BOX_FLOPS * image.getRows() * image.getCols());
+    int rows = image.getRows();
+    int cols = image.getCols();
+    return boxTables(image, radius, false, [&](int r, int x0, int x1, const double *sums,
+                                               const double *, float *dst)
+    {
+        int height = boxExtent(r, rows, radius);
+        for (int x = x0; x < x1; ++ x)
+        {
+            dst[x - x0] = (float) (sums[x - x0] / ((double) height * boxExtent(x, cols, radius)));
+        }
+    });
+}
+
+/**
+ * applies a local contrast filter on a given image, the filter of Wallis: every pixel is stretched
+ * about the mean of the box around it by deviation over the standard deviation of the box, and
+ * moved to the middle shade, so that every region of the image gets about the same contrast. The
+ * mean and the variance come from summed area tables, so every pixel costs the same for any
+ * radius, see boxTables.
+ * @param image the matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of the box to each side of its center, 0 or more
+ * @param deviation the standard deviation of the shades of every box after the filter
+ * @return the matrix after the application of the filter, rounded and clamped to the shades
+ */
+Matrix localContrast(ConstMatrixView image, int radius, float deviation)
+{
+    TRACE_SPAN("local_contrast");
+    TRACE_COUNT("local_contrast", 0, 2LL * image.getRows() * image.getCols(),
+                (long long) CONTRAST_FLOPS * image.getRows() * image.getCols());
+    int rows = image.getRows();
+    int cols = image.getCols();
+    return boxTables(image, radius, true, [&](int r, int x0, int x1, const double *sums,
+                                              const double *squares, float *dst)
+    {
+        int height = boxExtent(r, rows, radius);
+        for (int x = x0; x < x1; ++ x)
+        {
+            double area = (double) height * boxExtent(x, cols, radius);
+            double mean = sums[x - x0] / area;
+            double variance = std::max(squares[x - x0] / area - mean * mean, 0.0);
+            double spread = std::max(std::sqrt(variance), CONTRAST_MIN_DEVIATION);
+            double shade = SHADES / 2 + (image.at(r, x) - mean) * deviation / spread;
+            dst[x - x0] = std::min(std::max((float) roundHalfEven(shade), 0.f),
+                                   (float) (SHADES - 1));
+        }
+    });
+}
+
+/**
+ * applies sobel affect on a given image. The result is that of convolution() with each of the
+ * two gradient kernels, summed and clamped to the shades. Both gradients are computed by a vector
+ * stencil from a single load of every neighbourhood.
+ * @param image the matrix, or a view of one, representing the image to apply the filter on
+ * @return the matrix after the application of the filter
+ */
+Matrix sobel(ConstMatrixView image)
+{
+    TRACE_SPAN("sobel");
+    TRACE_COUNT("sobel", 0, 2LL * image.getRows() * image.getCols(),
+                (long long) SOBEL_FLOPS * image.getRows() * image.getCols());
+    return floatStencil(image, sobelSpan);
+}
+
+/**
+ * computes the sobel gradients of an image and the images derived from them in a single sweep:
+ * both gradients come from one load of every neighbourhood, and the magnitude and the orientation
+ * from the gradients of a span while they are in the cache
+ * @param image the matrix, or a view of one, representing the image
+ * @param outputs the images to compute, GradientOutput values combined with |
+ * @param norm the norm of the magnitude
+ * @return the images asked for, the others are left 1 x 1
+ */
+Gradients gradients(ConstMatrixView image, int outputs, GradientNorm norm)
+{
+    TRACE_SPAN("gradients");
+    int rows = image.getRows();
+    int cols = image.getCols();
+    TRACE_COUNT("gradients", 0, (long long) rows * cols * (1 + __builtin_popcount(outputs)),
+                (long long) SOBEL_FLOPS * rows * cols);
+    Gradients result;
+    Matrix *images[] = {&result.x, &result.y, &result.magnitude, &result.orientation};
+    for (int i = 0; i < 4; ++ i)
+    {
+        if (outputs & (1 << i))
+        {
+            *images[i] = Matrix(rows, cols, Matrix::NO_INIT);
+        }
+    }
+    stencilRows<float>(rows, cols, [&](int r, int x0, int x1, float *dst)
+    {
+        loadSpan(image, r, x0, x1, dst);
+    }, [&](const float *a, const float *b, const float *c, int r, const Tile &tile)
+    {
+        int width = tile.right - tile.left;
+        // the spans of the gradients which are not asked for
+        thread_local std::vector<float> spans;
+        spans.resize(2 * (size_t) width);
+        float *gx = (outputs & GRADIENT_X) ? result.x.rowData(r) + tile.left : spans.data();
+        float *gy = (outputs & GRADIENT_Y) ? result.y.rowData(r) + tile.left
+                                           : spans.data() + width;
+        // the orientation is taken before the gradients are rounded, which would snap small
+        // gradients to a few directions, and the gradients are then rounded as the kernel does
+        bool orient = (outputs & GRADIENT_ORIENTATION) != 0;
+        kernels::stencilPair3x3(gx, gy, a, b, c, SOBEL_X_TAPS, SOBEL_Y_TAPS, !orient,
+                                (size_t) width);
+        if (orient)
+        {
+            float *orientation = result.orientation.rowData(r) + tile.left;
+            for (int x = 0; x < width; ++ x)
+            {
+                orientation[x] = atan2f(gy[x], gx[x]);
+                gx[x] = rintf(gx[x]);
+                gy[x] = rintf(gy[x]);
+            }
+        }
+        if (outputs & GRADIENT_MAGNITUDE)
+        {
+            float *magnitude = result.magnitude.rowData(r) + tile.left;
+            for (int x = 0; x < width; ++ x)
+            {
+                magnitude[x] = (norm == GRADIENT_L1) ? fabsf(gx[x]) + fabsf(gy[x])
+                                                     : rintf(sqrtf(gx[x] * gx[x] + gy[x] * gy[x]));
+            }
+            clampShades(magnitude, width);
+        }
+    });
+    return result;
+}
+
+/**
+ * applies sobel affect on a byte image. The result is the same as that of the float sobel on the
+ * same shades, computed in 16 bit integers.
+ * @param image the byte image to apply the filter on
+ * @return the byte image after the application of the filter
+ */
+ByteMatrix sobel(const ByteMatrix &image)
+{
+    TRACE_SPAN("sobel");
+    TRACE_COUNT("sobel", 0, 2LL * image.getRows() * image.getCols(), 0);
+    return byteStencil(image, [](const uint8_t *a, const uint8_t *b, const uint8_t *c,
+                                 uint8_t *out, int width)
+    {
+        kernels::sobel3x3Bytes(out, a, b, c, (size_t) width);
+    });
+}
+
+
+/**
+ * appends blur(), see there
+ * @return this pipeline
+ */
+FilterPipeline &FilterPipeline::blur()
+{
+    return stencil(blurSpan);
+}
+
+/**
+ * appends sobel(), see there
+ * @return this pipeline
+ */
+FilterPipeline &FilterPipeline::sobel()
+{
+    return stencil(sobelSpan);
+}
+
+/**
+ * appends quantization(), see there
+ * @param levels the wanted level of shades
+ * @return this pipeline
+ */
+FilterPipeline &FilterPipeline::quantization(int const levels)
+{
+    return point(ShadeTable::quantization(levels));
+}
+
+/**
+ * appends a 3 x 3 filter
+ * @param stencil the filter
+ * @return this pipeline
+ */
+FilterPipeline &FilterPipeline::stencil(const RowStencil &stencil)
+{
+    _stages.push_back(Stage{stencil, ShadeTable()});
+    return *this;
+}
+
+/**
+ * appends a filter of every shade on its own. It runs on the rows of the 3 x 3 filter before it,
+ * or on the rows of the image if there is none, composed with the shade filters already there.
+ * @param table the filter
+ * @return this pipeline
+ */
+FilterPipeline &FilterPipeline::point(const ShadeTable &table)
+{
+    ShadeTable &last = _stages.empty() ? _leading : _stages.back().points;
+    last = last.then(table);
+    return *this;
+}
+
+/**
+ * runs the pipeline over a tile of an image of any element type. The tile keeps a ring of three
+ * rows of the input of every 3 x 3 filter, the input of filter s spanning the columns of the tile
+ * and radius() - s more on each side. A row of a ring is computed from the three rows of the ring
+ * below it when first asked for, so every row of every filter is computed once per tile, and the
+ * columns and rows outside of the image stay zero, as they are for a single filter. The rows of
+ * the image are loaded top to bottom, each once.
+ * @param tile the tile of the result to compute
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param load a callable (r, x0, x1, dst) which writes the elements of image row r in columns
+ * [x0, x1) into dst as floats
+ * @param store a callable (r, x0, src, width) which writes the span of result row r starting at
+ * column x0
+ */
+template<class Load, class Store>
+void FilterPipeline::_runTile(const Tile &tile, int rows, int cols, Load &load,
+                              Store &store) const
+{
+    int halo = radius();
+    int width = tile.right - tile.left;
+    std::vector<float> out((size_t) width);
+    auto points = [&](const ShadeTable &table, float *span, int n)
+    {
+        if (!table.isIdentity())
+        {
+            table.apply(span, span, n);
+        }
+    };
+    if (_stages.empty())
+    {
+        for (int r = tile.top; r < tile.bottom; ++ r)
+        {
+            load(r, tile.left, tile.right, out.data());
+            points(_leading, out.data(), width);
+            store(r, tile.left, out.data(), width);
+        }
+        return;
+    }
+    // column x of a ring row is at x - origin, which leaves one zero before column
+    // tile.left - halo for the stencil to read
+    int origin = tile.left - halo - 1;
+    int length = width + 2 * halo + 2;
+    std::vector<RowRing> rings;
+    rings.reserve(_stages.size());
+    for (size_t s = 0; s < _stages.size(); ++ s)
+    {
+        rings.emplace_back(3, length);
+    }
+    std::function<const float *(int, int)> input = [&](int s, int y) -> const float *
+    {
+        return rings[s].get(y, [&](float *row)
+        {
+            if (y < 0 || y >= rows)
+            {
+                std::fill(row, row + length, 0.f);
+                return;
+            }
+            int reach = halo - s;
+            int x0 = std::max(tile.left - reach, 0);
+            int x1 = std::min(tile.right + reach, cols);
+            float *span = row + (x0 - origin);
+            if (s == 0)
+            {
+                load(y, x0, x1, span);
+                points(_leading, span, x1 - x0);
+                return;
+            }
+            const float *above = input(s - 1, y - 1) + (x0 - origin);
+            const float *center = input(s - 1, y) + (x0 - origin);
+            const float *below = input(s - 1, y + 1) + (x0 - origin);
+            const Stage &stage = _stages[s - 1];
+            stage.stencil(above, center, below, span, x1 - x0);
+            points(stage.points, span, x1 - x0);
+        });
+    };
+    int last = (int) _stages.size() - 1;
+    int offset = tile.left - origin;
+    for (int r = tile.top; r < tile.bottom; ++ r)
+    {
+        const float *above = input(last, r - 1) + offset;
+        const float *center = input(last, r) + offset;
+        const float *below = input(last, r + 1) + offset;
+        _stages[last].stencil(above, center, below, out.data(), width);
+        points(_stages[last].points, out.data(), width);
+        store(r, tile.left, out.data(), width);
+    }
+}
+
+/**
+ * runs the pipeline over an image of any element type, cut into cache sized tiles which run in
+ * parallel, see _runTile
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param load a callable (r, x0, x1, dst) which writes the elements of image row r in columns
+ * [x0, x1) into dst as floats
+ * @param store a callable (r, x0, src, width) which writes the span of result row r starting at
+ * column x0
+ */
+template<class Load, class Store>
+void FilterPipeline::_run(int rows, int cols, Load load, Store store) const
+{
+    // the rings and the output span
+    size_t columnBytes = 3 * sizeof(float) * _stages.size() + sizeof(float);
+    int pixelWork = (int) _stages.size() + 1;
+    parallelTiles(rows, cols, radius(), radius(), columnBytes, pixelWork, [&](const Tile &tile)
+    {
+        TRACE_SPAN("pipeline_tile");
+        _runTile(tile, rows, cols, load, store);
+    });
+}
+
+/**
+ * applies the filters on an image
+ * @param image a matrix, or a view of one, representing the image to apply the filters on
+ * @return the image after all of the filters
+ */
+Matrix FilterPipeline::run(ConstMatrixView image) const
+{
+    TRACE_SPAN("pipeline");
+    TRACE_COUNT("pipeline", 0, 2LL * image.getRows() * image.getCols(), 0);
+    Matrix result(image.getRows(), image.getCols(), Matrix::NO_INIT);
+    _run(image.getRows(), image.getCols(), [&](int r, int x0, int x1, float *dst)
+    {
+        loadSpan(image, r, x0, x1, dst);
+    }, [&](int r, int x0, const float *src, int width)
+    {
+        std::copy(src, src + width, result.rowData(r) + x0);
+    });
+    return result;
+}
+
+/**
+ * applies the filters on a byte image, with the result of the float filters saturated to bytes
+ * @param image the byte image to apply the filters on
+ * @return the byte image after all of the filters
+ */
+ByteMatrix FilterPipeline::run(const ByteMatrix &image) const
+{
+    TRACE_SPAN("pipeline");
+    TRACE_COUNT("pipeline", 0, 2LL * image.getRows() * image.getCols(), 0);
+    ByteMatrix result(image.getRows(), image.getCols());
+    _run(image.getRows(), image.getCols(), [&](int r, int x0, int x1, float *dst)
+    {
+        std::copy(image.rowData(r) + x0, image.rowData(r) + x1, dst);
+    }, [&](int r, int x0, const float *src, int width)
+    {
+        uint8_t *dst = result.rowData(r) + x0;
+        for (int x = 0; x < width; ++ x)
+        {
+            dst[x] = saturateCast<uint8_t>(src[x]);
+        }
+    });
+    return result;
+}
+
+/**
+ * applies the filters on an image streamed row by row. The whole width is a single tile, see
+ * _runTile, whose rows are read top to bottom, each once, and written as soon as the rings hold
+ * the rows they need, so the memory the pipeline takes is three rows per 3 x 3 filter whatever
+ * the height of the image.
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param read writes the next row of the image into the cols floats it is given
+ * @param write takes the next row of the result, top to bottom
+ */
+void FilterPipeline::stream(int rows, int cols, const std::function<void(float *)> &read,
+                            const std::function<void(const float *)> &write) const
+{
+    if (rows <= 0 || cols <= 0)
+    {
+        std::cerr << STREAM_SIZE_ERR_MSG;
+        exit(1);
+    }
+    TRACE_SPAN("pipeline_stream");
+    TRACE_COUNT("pipeline_stream", 0, 2LL * rows * cols, 0);
+    // a whole row is read at once, and the part of it the tile asks for is copied out
+    std::vector<float> row((size_t) cols);
+    int next = 0;
+    auto load = [&](int r, int x0, int x1, float *dst)
+    {
+        while (next <= r)
+        {
+            read(row.data());
+            ++ next;
+        }
+        std::copy(row.data() + x0, row.data() + x1, dst);
+    };
+    auto store = [&](int, int, const float *src, int)
+    {
+        write(src);
+    };
+    _runTile(Tile{0, rows, 0, cols}, rows, cols, load, store);
+}
+
+/**
+ * applies the filters on an image streamed in the text format of operator>> and operator<<,
+ * see stream(). Exits if the stream fails before the last row, the rows above it already written.
+ * @param in the stream of the image
+ * @param out the stream to write the result to
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ */
+void FilterPipeline::stream(std::istream &in, std::ostream &out, int rows, int cols) const
+{
+    if (!in)
+    {
+        std::cerr << STREAM_READ_ERR_MSG;
+        exit(1);
+    }
+    int written = 0;
+    stream(rows, cols, [&](float *row)
+    {
+        for (int x = 0; x < cols; ++ x)
+        {
+            in >> row[x];
+        }
+        // a row cut short or holding something else than a float would be filtered as garbage
+        if (!in)
+        {
+            std::cerr << STREAM_READ_ERR_MSG;
+            exit(1);
+        }
+    }, [&](const float *row)
+    {
+        for (int x = 0; x < cols - 1; ++ x)
+        {
+            out << row[x] << " ";
+        }
+        out << row[cols - 1];
+        // a line break between rows, none after the last one, as operator<< writes them
+        if (++ written < rows)
+        {
+            out << "\n";
+        }
+    });
+}
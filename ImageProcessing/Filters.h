@@ -0,0 +1,307 @@
+#ifndef EX5_FILTERS_H
+#define EX5_FILTERS_H
+
+#include <functional>
+#include <iosfwd>
+#include <vector>
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "TypedMatrix.h"
+#include "Convolution.h"
+#include "ShadeTable.h"
+
+// the standard deviation localContrast gives the shades of every box by default
+#define LOCAL_CONTRAST_DEVIATION 48.f
+
+struct Tile;
+
+/**
+ * applies quantization filter on an image represented as a matrix
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param levels the wanted level of shades
+ * @return a matrix representing the image after quantization
+ */
+Matrix quantization(ConstMatrixView image, int levels);
+
+/**
+ * calculates the convolution of two given matrices. The kernel may be of any size, its anchor is
+ * its center element, and every result is rounded to an integer.
+ * Separable kernels run as two 1-D passes and large kernels through the FFT, see convolve().
+ * @param matrix the matrix, or a view of one, to apply convolution on
+ * @param convolutionMat the matrix to apply convolution with
+ * @param border how to read the pixels outside of the matrix, zeros by default
+ * @return the matrix after convolution
+ */
+Matrix convolution(ConstMatrixView matrix, ConstMatrixView convolutionMat,
+                   BorderMode border = BORDER_ZERO);
+
+/**
+ * applies blurring affect on a given image represented as a matrix
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @return a matrix representing the image after blurring
+ */
+Matrix blur(ConstMatrixView image);
+
+/**
+ * applies a gaussian blur of any radius on a given image represented as a matrix
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param sigma the standard deviation of the gaussian in pixels, positive
+ * @param border how to read the pixels outside of the image. Reflecting by default, as zeros
+ * would darken the edges over the whole radius of the blur.
+ * @return a matrix representing the image after blurring
+ */
+Matrix gaussianBlur(ConstMatrixView image, float sigma, BorderMode border = BORDER_REFLECT);
+
+/**
+ * applies a box blur of any radius on a given image: every pixel becomes the mean of the
+ * (2 radius + 1) x (2 radius + 1) box around it with zeros outside of the image, rounded to the
+ * nearest integer, halves to even. The boxes are summed from summed area tables, see
+ * SummedAreaTable, so a large radius costs as much per pixel as radius 1.
+ * For integer shades the sums are exact, so every pixel is the exact mean rounded. convolution()
+ * with a kernel of equal taps computes the same blur in float, and gives the same pixels for 8 bit
+ * shades up to radius 32. Above that it may round a pixel within its float error of a half the
+ * other way, the blur of its FFT path more so.
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of the box to each side of its center, 0 or more
+ * @return a matrix representing the image after blurring
+ */
+Matrix boxFilter(ConstMatrixView image, int radius);
+
+/**
+ * applies a mean filter of any radius on a given image: every pixel becomes the mean of the box
+ * around it, of just the pixels inside of the image. Costs the same per pixel for any radius.
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of the box to each side of its center, 0 or more
+ * @return a matrix representing the image after the filter, not rounded
+ */
+Matrix meanFilter(ConstMatrixView image, int radius);
+
+/**
+ * applies a local contrast filter on a given image: every pixel is stretched about the mean of the
+ * box around it so that the shades of every box get the same standard deviation, around the
+ * middle shade. Costs the same per pixel for any radius.
+ * @param image a matrix, or a view of one, representing the image to apply the filter on
+ * @param radius the pixels of the box to each side of its center, 0 or more
+ * @param deviation the standard deviation of the shades of every box after the filter
+ * @return a matrix representing the image after the filter, rounded and clamped to the shades
+ */
+Matrix localContrast(ConstMatrixView image, int radius, float deviation = LOCAL_CONTRAST_DEVIATION);
+
+/**
+ * applies sobel affect on a given image
+ * @param image the matrix, or a view of one, representing the image to apply the filter on
+ * @return the matrix after the application of the filter
+ */
+Matrix sobel(ConstMatrixView image);
+
+/**
+ * the images gradients() computes, combined with |
+ */
+enum GradientOutput
+{
+    // the horizontal sobel gradient, {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}} / 8 rounded
+    GRADIENT_X = 1,
+    // the vertical sobel gradient, {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}} / 8 rounded
+    GRADIENT_Y = 2,
+    // the norm of the two gradients, rounded and clamped to the shades
+    GRADIENT_MAGNITUDE = 4,
+    // the direction of the gradient, atan2(y, x) in radians of the gradients before rounding
+    GRADIENT_ORIENTATION = 8
+};
+
+/**
+ * the norms of the gradient magnitude
+ */
+enum GradientNorm
+{
+    // |x| + |y|
+    GRADIENT_L1,
+    // sqrt(x^2 + y^2)
+    GRADIENT_L2
+};
+
+/**
+ * the images computed by gradients()
+ */
+struct Gradients
+{
+    Matrix x;
+    Matrix y;
+    Matrix magnitude;
+    Matrix orientation;
+};
+
+/**
+ * computes the sobel gradients of an image, and optionally their magnitude and orientation, in a
+ * single sweep over the image. Sobel itself is the sum of the two gradients, clamped.
+ * @param image the matrix, or a view of one, representing the image
+ * @param outputs the images to compute, GradientOutput values combined with |
+ * @param norm the norm of the magnitude
+ * @return the images asked for, the others are left 1 x 1
+ */
+Gradients gradients(ConstMatrixView image, int outputs, GradientNorm norm = GRADIENT_L1);
+
+/**
+ * applies quantization filter on a byte image, with the result of the float filter
+ * @param image the byte image to apply the filter on
+ * @param levels the wanted level of shades
+ * @return the byte image after quantization
+ */
+ByteMatrix quantization(const ByteMatrix &image, int levels);
+
+/**
+ * applies blurring affect on a byte image, with the result of the float filter
+ * @param image the byte image to apply the filter on
+ * @return the byte image after blurring
+ */
+ByteMatrix blur(const ByteMatrix &image);
+
+/**
+ * applies sobel affect on a byte image, with the result of the float filter
+ * @param image the byte image to apply the filter on
+ * @return the byte image after the application of the filter
+ */
+ByteMatrix sobel(const ByteMatrix &image);
+
+/**
+ * a chain of filters declared up front and run in a single pass over the image. Every 3 x 3
+ * filter keeps a ring of the three rows of its input it reads, the shade filters after it run as a
+ * single ShadeTable on a row as soon as it is computed, and the image is cut into tiles whose
+ * rings fit the cache, so the image is read once and the result written once, with no matrix
+ * between the filters.
+ * The result is the same as that of the filters applied one after the other, e.g.
+ * FilterPipeline().blur().sobel().quantization(8).run(image) is
+ * quantization(sobel(blur(image)), 8).
+ */
+class FilterPipeline
+{
+public:
+    /**
+     * a 3 x 3 filter on a span of a row: (above, row, below, out, width), the input spans being
+     * readable one element before their start and one after their end
+     */
+    typedef std::function<void(const float *, const float *, const float *, float *, int)>
+            RowStencil;
+
+private:
+    /**
+     * a 3 x 3 filter and the shade filters which follow it, composed into one table
+     */
+    struct Stage
+    {
+        RowStencil stencil;
+        ShadeTable points;
+    };
+
+    // the shade filters before the first 3 x 3 filter
+    ShadeTable _leading;
+    std::vector<Stage> _stages;
+
+    /**
+     * runs the pipeline over a tile of an image of any element type, loading the rows of the
+     * image top to bottom, each once
+     * @param tile the tile of the result to compute
+     * @param rows the rows number of the image
+     * @param cols the columns number of the image
+     * @param load a callable (r, x0, x1, dst) which writes the elements of image row r in columns
+     * [x0, x1) into dst as floats
+     * @param store a callable (r, x0, src, width) which writes the span of result row r starting
+     * at column x0
+     */
+    template<class Load, class Store>
+    void _runTile(const Tile &tile, int rows, int cols, Load &load, Store &store) const;
+
+    /**
+     * runs the pipeline over an image of any element type, in parallel tiles
+     * @param rows the rows number of the image
+     * @param cols the columns number of the image
+     * @param load a callable (r, x0, x1, dst) which writes the elements of image row r in columns
+     * [x0, x1) into dst as floats
+     * @param store a callable (r, x0, src, width) which writes the span of result row r starting
+     * at column x0
+     */
+    template<class Load, class Store>
+    void _run(int rows, int cols, Load load, Store store) const;
+
+public:
+    /**
+     * appends blur(), see there
+     * @return this pipeline
+     */
+    FilterPipeline &blur();
+
+    /**
+     * appends sobel(), see there
+     * @return this pipeline
+     */
+    FilterPipeline &sobel();
+
+    /**
+     * appends quantization(), see there
+     * @param levels the wanted level of shades
+     * @return this pipeline
+     */
+    FilterPipeline &quantization(int levels);
+
+    /**
+     * appends a 3 x 3 filter
+     * @param stencil the filter
+     * @return this pipeline
+     */
+    FilterPipeline &stencil(const RowStencil &stencil);
+
+    /**
+     * appends a filter of every shade on its own. Consecutive ones compose into a single table.
+     * @param table the filter
+     * @return this pipeline
+     */
+    FilterPipeline &point(const ShadeTable &table);
+
+    /**
+     * @return the number of 3 x 3 filters, which is the number of pixels each tile reads beyond
+     * each of its sides
+     */
+    int radius() const
+    {
+        return (int) _stages.size();
+    }
+
+    /**
+     * applies the filters on an image
+     * @param image a matrix, or a view of one, representing the image to apply the filters on
+     * @return the image after all of the filters
+     */
+    Matrix run(ConstMatrixView image) const;
+
+    /**
+     * applies the filters on a byte image, with the result of the float filters saturated to
+     * bytes, which for blur, sobel and quantization is that of the byte filters
+     * @param image the byte image to apply the filters on
+     * @return the byte image after all of the filters
+     */
+    ByteMatrix run(const ByteMatrix &image) const;
+
+    /**
+     * applies the filters on an image streamed row by row, for images too large to be held in
+     * memory. The rows are read top to bottom and the result rows written as soon as they are
+     * computed, so the pipeline holds just three rows for each 3 x 3 filter.
+     * @param rows the rows number of the image
+     * @param cols the columns number of the image
+     * @param read writes the next row of the image into the cols floats it is given
+     * @param write takes the next row of the result, top to bottom
+     */
+    void stream(int rows, int cols, const std::function<void(float *)> &read,
+                const std::function<void(const float *)> &write) const;
+
+    /**
+     * applies the filters on an image streamed in the text format of operator>> and
+     * operator<<, see the other stream(). Exits if the stream fails before the last row.
+     * @param in the stream of the image
+     * @param out the stream to write the result to
+     * @param rows the rows number of the image
+     * @param cols the columns number of the image
+     */
+    void stream(std::istream &in, std::ostream &out, int rows, int cols) const;
+};
+
+#endif //EX5_FILTERS_H
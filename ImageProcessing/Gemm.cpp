@@ -0,0 +1,176 @@
+#include <vector>
+#include <algorithm>
+#include "Gemm.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+
+#define MR GEMM_MR
+#define NR GEMM_NR
+// rows of A packed at once, sized so the packed panel stays in L2
+#define MC 128
+// depth of the packed panels, sized so a sliver of B stays in L1
+#define KC 256
+// columns of B packed at once, sized so the packed panel stays in L3
+#define NC 2048
+
+
+/**
+ * packs an mc x kc block of A into slivers of MR rows. Inside a sliver the MR elements of each
+ * column are contiguous. Rows past the end of A are padded with zeros.
+ * @param mc the number of rows to pack
+ * @param kc the number of columns to pack
+ * @param a the first element of the block
+ * @param lda the distance between two rows of A
+ * @param packed the buffer to pack into
+ */
+static void packA(int mc, int kc, const float *a, int lda, float *packed)
+{
+    for (int i = 0; i < mc; i += MR)
+    {
+        int rows = std::min(MR, mc - i);
+        for (int p = 0; p < kc; ++ p)
+        {
+            for (int r = 0; r < rows; ++ r)
+            {
+                packed[r] = a[(size_t) (i + r) * lda + p];
+            }
+            for (int r = rows; r < MR; ++ r)
+            {
+                packed[r] = 0;
+            }
+            packed += MR;
+        }
+    }
+}
+
+/**
+ * packs a kc x nc block of B into slivers of NR columns. Inside a sliver the NR elements of each
+ * row are contiguous. Columns past the end of B are padded with zeros.
+ * @param kc the number of rows to pack
+ * @param nc the number of columns to pack
+ * @param b the first element of the block
+ * @param ldb the distance between two rows of B
+ * @param packed the buffer to pack into
+ */
+static void packB(int kc, int nc, const float *b, int ldb, float *packed)
+{
+    for (int j = 0; j < nc; j += NR)
+    {
+        int cols = std::min(NR, nc - j);
+        for (int p = 0; p < kc; ++ p)
+        {
+            const float *row = b + (size_t) p * ldb + j;
+            for (int c = 0; c < cols; ++ c)
+            {
+                packed[c] = row[c];
+            }
+            for (int c = cols; c < NR; ++ c)
+            {
+                packed[c] = 0;
+            }
+            packed += NR;
+        }
+    }
+}
+
+/**
+ * multiplies a packed MR x kc sliver of A by a packed kc x NR sliver of B into an MR x NR tile
+ * of C, using the dispatched register tiled kernel. Only the mr x nr top left part of the tile
+ * is written back.
+ * @param kc the depth of the slivers
+ * @param a the packed sliver of A
+ * @param b the packed sliver of B
+ * @param c the top left element of the tile of C
+ * @param ldc the distance between two rows of C
+ * @param mr the number of valid rows in the tile
+ * @param nr the number of valid columns in the tile
+ * @param accumulate whether to add to C rather than overwrite it
+ */
+static void microKernel(int kc, const float *a, const float *b, float *c, int ldc, int mr,
+                        int nr, bool accumulate)
+{
+    if (mr == MR && nr == NR && accumulate)
+    {
+        kernels::gemmTile(kc, a, b, c, ldc);
+        return;
+    }
+    float tile[MR * NR] = {};
+    if (accumulate)
+    {
+        for (int i = 0; i < mr; ++ i)
+        {
+            for (int j = 0; j < nr; ++ j)
+            {
+                tile[i * NR + j] = c[(size_t) i * ldc + j];
+            }
+        }
+    }
+    kernels::gemmTile(kc, a, b, tile, NR);
+    for (int i = 0; i < mr; ++ i)
+    {
+        for (int j = 0; j < nr; ++ j)
+        {
+            c[(size_t) i * ldc + j] = tile[i * NR + j];
+        }
+    }
+}
+
+/**
+ * computes C = A * B for a block of rows of A and C, on the calling thread
+ */
+static void gemmSerial(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+                       float *c, int ldc)
+{
+    if (k == 0)
+    {
+        for (int i = 0; i < m; ++ i)
+        {
+            std::fill(c + (size_t) i * ldc, c + (size_t) i * ldc + n, 0.f);
+        }
+        return;
+    }
+    std::vector<float> packedA((size_t) ((MC + MR - 1) / MR) * MR * KC);
+    std::vector<float> packedB((size_t) ((NC + NR - 1) / NR) * NR * KC);
+    for (int jc = 0; jc < n; jc += NC)
+    {
+        int nc = std::min(NC, n - jc);
+        for (int pc = 0; pc < k; pc += KC)
+        {
+            int kc = std::min(KC, k - pc);
+            packB(kc, nc, b + (size_t) pc * ldb + jc, ldb, packedB.data());
+            for (int ic = 0; ic < m; ic += MC)
+            {
+                int mc = std::min(MC, m - ic);
+                packA(mc, kc, a + (size_t) ic * lda + pc, lda, packedA.data());
+                for (int jr = 0; jr < nc; jr += NR)
+                {
+                    for (int ir = 0; ir < mc; ir += MR)
+                    {
+                        microKernel(kc, packedA.data() + (size_t) ir * kc,
+                                    packedB.data() + (size_t) jr * kc,
+                                    c + (size_t) (ic + ir) * ldc + jc + jr, ldc,
+                                    std::min(MR, mc - ir), std::min(NR, nc - jr), pc > 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * computes C = A * B for row major matrices, see Gemm.h. Large products are split into blocks
+ * of MC rows which run on the thread pool.
+ */
+void gemm(int m, int n, int k, const float *a, int lda, const float *b, int ldb, float *c,
+          int ldc)
+{
+    if ((long long) m * n * k < (long long) MC * PARALLEL_MIN_ELEMENTS || m < 2 * MC)
+    {
+        gemmSerial(m, n, k, a, lda, b, ldb, c, ldc);
+        return;
+    }
+    ThreadPool::instance().parallelFor(0, m, MC, [=](int lo, int hi)
+    {
+        gemmSerial(hi - lo, n, k, a + (size_t) lo * lda, lda, b, ldb, c + (size_t) lo * ldc, ldc);
+    });
+}
@@ -0,0 +1,22 @@
+#ifndef EX5_GEMM_H
+#define EX5_GEMM_H
+
+/**
+ * computes C = A * B for row major matrices. A is m x k, B is k x n and C is m x n.
+ * The product is blocked for the cache: panels of A and B are packed into contiguous buffers
+ * and multiplied by a register tiled micro kernel. Every element of C is accumulated in the same
+ * order as the naive i-j-k loop, so the results are identical to it.
+ * @param m the number of rows of A and C
+ * @param n the number of columns of B and C
+ * @param k the number of columns of A and rows of B
+ * @param a the data of A
+ * @param lda the distance between two rows of A
+ * @param b the data of B
+ * @param ldb the distance between two rows of B
+ * @param c the data of C, overwritten with the product
+ * @param ldc the distance between two rows of C
+ */
+void gemm(int m, int n, int k, const float *a, int lda, const float *b, int ldb, float *c,
+          int ldc);
+
+#endif //EX5_GEMM_H
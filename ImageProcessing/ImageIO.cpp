@@ -0,0 +1,400 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include "ImageIO.h"
+#include "MatrixIO.h"
+#include "ThreadPool.h"
+#include "TypedMatrix.h"
+
+#define IMAGE_FORMAT_ERR_MSG "Invalid PGM or PPM image.\n"
+#define IMAGE_CHANNELS_ERR_MSG "Invalid image channels.\n"
+#define IMAGE_WRITE_ERR_MSG "Error writing to output stream.\n"
+// the weights of red, green and blue in gray, in 1 / 65536, as PIL converts images to gray
+#define RED_WEIGHT 19595
+#define GREEN_WEIGHT 38470
+#define BLUE_WEIGHT 7471
+// the largest encoded image whose buffer a thread keeps for its next image
+#define ENCODE_KEEP_BYTES ((size_t) 64 << 20)
+
+
+/**
+ * the header of a PGM or PPM image
+ */
+struct ImageHeader
+{
+    int rows;
+    int cols;
+    int channels;
+    int maxValue;
+    // the bytes of a single value of a channel
+    int sampleBytes;
+    // the offset of the pixels in the file
+    size_t offset;
+};
+
+/**
+ * @param c a character of the header
+ * @return true if it is whitespace of the format
+ */
+static bool headerSpace(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * reads a positive number of the header, skipping the whitespace and the comments before it
+ * @param data the file
+ * @param size the size of the file
+ * @param pos the position to read from, set to the position after the number
+ * @return the number, 0 if there is none or it is too large
+ */
+static int headerNumber(const unsigned char *data, size_t size, size_t &pos)
+{
+    while (pos < size && (headerSpace(data[pos]) || data[pos] == '#'))
+    {
+        if (data[pos] == '#')
+        {
+            while (pos < size && data[pos] != '\n')
+            {
+                ++ pos;
+            }
+        }
+        else
+        {
+            ++ pos;
+        }
+    }
+    long value = 0;
+    size_t first = pos;
+    while (pos < size && data[pos] >= '0' && data[pos] <= '9')
+    {
+        value = value * 10 + (data[pos] - '0');
+        if (value > INT_MAX)
+        {
+            return 0;
+        }
+        ++ pos;
+    }
+    return pos == first ? 0 : (int) value;
+}
+
+/**
+ * parses the header of a mapped image and checks the pixels fit in the file
+ * @param file the mapped image
+ * @param header set to the header
+ * @return false if it is not a valid image
+ */
+static bool parseImageHeader(const MappedFile &file, ImageHeader &header)
+{
+    const unsigned char *data = file.data();
+    size_t size = file.size();
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+    {
+        return false;
+    }
+    header.channels = data[1] == '5' ? GRAY_CHANNELS : RGB_CHANNELS;
+    size_t pos = 2;
+    header.cols = headerNumber(data, size, pos);
+    header.rows = headerNumber(data, size, pos);
+    header.maxValue = headerNumber(data, size, pos);
+    // a single whitespace character separates the header from the pixels
+    if (header.cols == 0 || header.rows == 0 || header.maxValue == 0 ||
+        header.maxValue > MAX_PIXEL_VALUE || pos >= size || !headerSpace(data[pos]))
+    {
+        return false;
+    }
+    header.offset = pos + 1;
+    header.sampleBytes = header.maxValue < 256 ? 1 : 2;
+    size_t pixels = (size_t) header.rows * header.cols * header.channels * header.sampleBytes;
+    return size - header.offset >= pixels;
+}
+
+/**
+ * parses the header of a mapped image and checks the pixels fit in the file
+ * @param file the mapped image
+ * @return the header, exits if it is not a valid image
+ */
+static ImageHeader checkedImageHeader(const MappedFile &file)
+{
+    ImageHeader header;
+    if (!parseImageHeader(file, header))
+    {
+        std::cerr << IMAGE_FORMAT_ERR_MSG;
+        exit(1);
+    }
+    return header;
+}
+
+/**
+ * decodes a channel of a row of pixels
+ * @param dst the row of the channel
+ * @param src the row of pixels
+ * @param header the header of the image
+ * @param channel the channel to decode
+ */
+static void decodeChannel(float *dst, const unsigned char *src, const ImageHeader &header,
+                          int channel)
+{
+    int step = header.channels;
+    if (header.sampleBytes == 1)
+    {
+        for (int x = 0; x < header.cols; ++ x)
+        {
+            dst[x] = (float) src[x * step + channel];
+        }
+        return;
+    }
+    // 16 bit values are stored most significant byte first
+    for (int x = 0; x < header.cols; ++ x)
+    {
+        const unsigned char *sample = src + 2 * (x * step + channel);
+        dst[x] = (float) ((sample[0] << 8) | sample[1]);
+    }
+}
+
+/**
+ * @param src a pixel of an RGB image
+ * @param sampleBytes the bytes of a single value of a channel
+ * @return the gray of the pixel
+ */
+static float grayPixel(const unsigned char *src, int sampleBytes)
+{
+    uint64_t rgb[RGB_CHANNELS];
+    for (int c = 0; c < RGB_CHANNELS; ++ c)
+    {
+        rgb[c] = sampleBytes == 1 ? src[c] : (uint64_t) ((src[2 * c] << 8) | src[2 * c + 1]);
+    }
+    uint64_t gray = rgb[0] * RED_WEIGHT + rgb[1] * GREEN_WEIGHT + rgb[2] * BLUE_WEIGHT;
+    return (float) ((gray + (1 << 15)) >> 16);
+}
+
+/**
+ * decodes a mapped PGM or PPM image straight into the matrices, a band of rows per thread
+ * @param file the mapped image
+ * @param image set to the image
+ * @return false if it is not a valid image
+ */
+static bool decodeImage(const MappedFile &file, Image &image)
+{
+    ImageHeader header;
+    if (!parseImageHeader(file, header))
+    {
+        return false;
+    }
+    image.maxValue = header.maxValue;
+    image.channels.clear();
+    for (int c = 0; c < header.channels; ++ c)
+    {
+        image.channels.emplace_back(header.rows, header.cols, Matrix::NO_INIT);
+    }
+    size_t rowBytes = (size_t) header.cols * header.channels * header.sampleBytes;
+    const unsigned char *pixels = file.data() + header.offset;
+    parallelRows(header.rows, header.cols * header.channels, [&](int lo, int hi)
+    {
+        for (int r = lo; r < hi; ++ r)
+        {
+            for (int c = 0; c < header.channels; ++ c)
+            {
+                decodeChannel(image.channels[c].rowData(r), pixels + r * rowBytes, header, c);
+            }
+        }
+    });
+    return true;
+}
+
+/**
+ * reads a binary PGM or PPM image. The file is mapped and decoded straight into the matrices, a
+ * band of rows per thread.
+ * @param path the path of the image
+ * @return the image
+ */
+Image readImage(const std::string &path)
+{
+    MappedFile file(path);
+    Image image;
+    if (!decodeImage(file, image))
+    {
+        std::cerr << IMAGE_FORMAT_ERR_MSG;
+        exit(1);
+    }
+    return image;
+}
+
+/**
+ * reads a binary PGM or PPM image as readImage() does, but returns rather than exits if the file
+ * cannot be opened or is not a valid image
+ * @param path the path of the image
+ * @param image set to the image
+ * @return false if the image could not be read
+ */
+bool tryReadImage(const std::string &path, Image &image)
+{
+    MappedFile file(path, false);
+    return file.isOpen() && decodeImage(file, image);
+}
+
+/**
+ * reads a binary PGM or PPM image as a single channel of shades. The channels of a PPM are
+ * converted to gray the way helpers/image2file.py does, pixel by pixel, so the channels are never
+ * held.
+ * @param path the path of the image
+ * @return the shades of the image, of the range of its maxValue
+ */
+Matrix readGray(const std::string &path)
+{
+    MappedFile file(path);
+    ImageHeader header = checkedImageHeader(file);
+    Matrix image(header.rows, header.cols, Matrix::NO_INIT);
+    size_t rowBytes = (size_t) header.cols * header.channels * header.sampleBytes;
+    size_t pixelBytes = (size_t) header.channels * header.sampleBytes;
+    const unsigned char *pixels = file.data() + header.offset;
+    parallelRows(header.rows, header.cols * header.channels, [&](int lo, int hi)
+    {
+        for (int r = lo; r < hi; ++ r)
+        {
+            const unsigned char *src = pixels + r * rowBytes;
+            float *dst = image.rowData(r);
+            if (header.channels == GRAY_CHANNELS)
+            {
+                decodeChannel(dst, src, header, 0);
+                continue;
+            }
+            for (int x = 0; x < header.cols; ++ x)
+            {
+                dst[x] = grayPixel(src + x * pixelBytes, header.sampleBytes);
+            }
+        }
+    });
+    return image;
+}
+
+/**
+ * encodes a channel of a row of pixels, rounded and clamped to [0, maxValue]
+ * @param dst the row of pixels
+ * @param src the channel
+ * @param row the row to encode
+ * @param channels the number of channels of the image
+ * @param channel the channel to encode
+ * @param maxValue the value of white
+ */
+static void encodeChannel(unsigned char *dst, ConstMatrixView src, int row, int channels,
+                          int channel, int maxValue)
+{
+    int cols = src.getCols();
+    for (int x = 0; x < cols; ++ x)
+    {
+        int value = std::min((int) saturateCast<uint16_t>(src.at(row, x)), maxValue);
+        if (maxValue < 256)
+        {
+            dst[x * channels + channel] = (unsigned char) value;
+        }
+        else
+        {
+            dst[2 * (x * channels + channel)] = (unsigned char) (value >> 8);
+            dst[2 * (x * channels + channel) + 1] = (unsigned char) value;
+        }
+    }
+}
+
+/**
+ * writes the channels of an image as a binary PGM or PPM image. The pixels are encoded into a
+ * single buffer, a band of rows per thread, and written at once. The buffer belongs to the calling
+ * thread and is kept for its next image, so a thread writing image after image allocates it once.
+ * @param path the path of the image
+ * @param channels the channels of the image, a single one or three of the same dimensions
+ * @param maxValue the value of white
+ * @return false if the file could not be written, exits if the channels are not an image
+ */
+static bool writeChannels(const std::string &path, const std::vector<ConstMatrixView> &channels,
+                          int maxValue)
+{
+    int count = (int) channels.size();
+    if ((count != GRAY_CHANNELS && count != RGB_CHANNELS) || maxValue < 1 ||
+        maxValue > MAX_PIXEL_VALUE)
+    {
+        std::cerr << IMAGE_CHANNELS_ERR_MSG;
+        exit(1);
+    }
+    int rows = channels[0].getRows();
+    int cols = channels[0].getCols();
+    for (const ConstMatrixView &channel : channels)
+    {
+        if (channel.getRows() != rows || channel.getCols() != cols)
+        {
+            std::cerr << IMAGE_CHANNELS_ERR_MSG;
+            exit(1);
+        }
+    }
+    size_t rowBytes = (size_t) cols * count * (maxValue < 256 ? 1 : 2);
+    // taken rather than used in place, since this thread may write another image while it waits
+    // for the bands, and that image finds no buffer to share
+    static thread_local std::vector<unsigned char> spare;
+    std::vector<unsigned char> pixels;
+    pixels.swap(spare);
+    pixels.resize(rows * rowBytes);
+    parallelRows(rows, cols * count, [&](int lo, int hi)
+    {
+        for (int r = lo; r < hi; ++ r)
+        {
+            for (int c = 0; c < count; ++ c)
+            {
+                encodeChannel(pixels.data() + r * rowBytes, channels[c], r, count, c, maxValue);
+            }
+        }
+    });
+    std::ofstream file(path, std::ios::binary);
+    file << (count == GRAY_CHANNELS ? "P5" : "P6") << "\n" << cols << " " << rows << "\n"
+         << maxValue << "\n";
+    file.write((const char *) pixels.data(), (std::streamsize) pixels.size());
+    file.close();
+    if (pixels.capacity() <= ENCODE_KEEP_BYTES)
+    {
+        spare.swap(pixels);
+    }
+    return !file.fail();
+}
+
+/**
+ * writes a binary PGM or PPM image, by the number of its channels. The values are rounded and
+ * clamped to [0, maxValue].
+ * @param path the path of the image
+ * @param image the image
+ */
+void writeImage(const std::string &path, const Image &image)
+{
+    if (!tryWriteImage(path, image))
+    {
+        std::cerr << IMAGE_WRITE_ERR_MSG;
+        exit(1);
+    }
+}
+
+/**
+ * writes a binary PGM or PPM image as writeImage() does, but returns rather than exits if the
+ * file cannot be written
+ * @param path the path of the image
+ * @param image the image
+ * @return false if the image could not be written
+ */
+bool tryWriteImage(const std::string &path, const Image &image)
+{
+    std::vector<ConstMatrixView> channels(image.channels.begin(), image.channels.end());
+    return writeChannels(path, channels, image.maxValue);
+}
+
+/**
+ * writes a single channel of shades as a binary PGM image
+ * @param path the path of the image
+ * @param image a matrix, or a view of one, of the shades
+ * @param maxValue the value of white, from 1 to MAX_PIXEL_VALUE
+ */
+void writeGray(const std::string &path, ConstMatrixView image, int maxValue)
+{
+    if (!writeChannels(path, std::vector<ConstMatrixView>(1, image), maxValue))
+    {
+        std::cerr << IMAGE_WRITE_ERR_MSG;
+        exit(1);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef EX5_IMAGEIO_H
+#define EX5_IMAGEIO_H
+
+#include <string>
+#include <vector>
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "ShadeTable.h"
+
+// the largest value of a pixel of PGM and PPM, that of 16 bit images
+#define MAX_PIXEL_VALUE 65535
+#define GRAY_CHANNELS 1
+#define RGB_CHANNELS 3
+
+/**
+ * an image of the binary PGM (P5) or PPM (P6) formats, as a matrix of every channel: a single one
+ * of shades for PGM, and the red, green and blue channels for PPM. The pixels are of 8 bits if
+ * maxValue is below 256 and of 16 bits otherwise.
+ */
+struct Image
+{
+    std::vector<Matrix> channels;
+    // the value of white
+    int maxValue;
+};
+
+/**
+ * reads a binary PGM or PPM image. The file is mapped and decoded straight into the matrices.
+ * @param path the path of the image
+ * @return the image
+ */
+Image readImage(const std::string &path);
+
+/**
+ * reads a binary PGM or PPM image as readImage() does, but returns rather than exits if the file
+ * cannot be opened or is not a valid image, for a caller which must not exit on any thread
+ * @param path the path of the image
+ * @param image set to the image
+ * @return false if the image could not be read
+ */
+bool tryReadImage(const std::string &path, Image &image);
+
+/**
+ * writes a binary PGM or PPM image, by the number of its channels. The values are rounded and
+ * clamped to [0, maxValue].
+ * @param path the path of the image
+ * @param image the image
+ */
+void writeImage(const std::string &path, const Image &image);
+
+/**
+ * writes a binary PGM or PPM image as writeImage() does, but returns rather than exits if the
+ * file cannot be written
+ * @param path the path of the image
+ * @param image the image
+ * @return false if the image could not be written
+ */
+bool tryWriteImage(const std::string &path, const Image &image);
+
+/**
+ * reads a binary PGM or PPM image as a single channel of shades. The channels of a PPM are
+ * converted to gray the way helpers/image2file.py does.
+ * @param path the path of the image
+ * @return the shades of the image, of the range of its maxValue
+ */
+Matrix readGray(const std::string &path);
+
+/**
+ * writes a single channel of shades as a binary PGM image
+ * @param path the path of the image
+ * @param image a matrix, or a view of one, of the shades
+ * @param maxValue the value of white, from 1 to MAX_PIXEL_VALUE
+ */
+void writeGray(const std::string &path, ConstMatrixView image, int maxValue = SHADES - 1);
+
+#endif //EX5_IMAGEIO_H
@@ -0,0 +1,1326 @@
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include "Kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#define KERNELS_ENV "MATRIX_KERNELS"
+#define KERNELS_ERR_MSG "Invalid MATRIX_KERNELS value, expected scalar, sse, avx2 or avx512.\n"
+// the byte stencils divide by these powers of two: blur by 16 and sobel by 8
+#define BLUR_SHIFT 4
+#define SOBEL_SHIFT 3
+// floats of this magnitude or more are integers
+#define FLOAT_INTEGER_BOUND 8388608.f
+
+// AVX-512 implies FMA, and the compiler would otherwise fuse a multiply and an add into one
+// rounding, so that the sets would no longer agree with the scalar one
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+
+/**
+ * the functions of one kernel set
+ */
+struct KernelSet
+{
+    const char *name;
+    void (*add)(float *, const float *, const float *, size_t);
+    void (*addScalar)(float *, const float *, float, size_t);
+    void (*mulScalar)(float *, const float *, float, size_t);
+    void (*divScalar)(float *, const float *, float, size_t);
+    void (*addScaled)(float *, const float *, float, size_t);
+    void (*clamp)(float *, const float *, float, float, size_t);
+    void (*addClamped)(float *, const float *, const float *, float, float, size_t);
+    void (*stencil3x3)(float *, const float *, const float *, const float *, const float *, bool,
+                       size_t);
+    void (*stencilPair3x3)(float *, float *, const float *, const float *, const float *,
+                           const float *, const float *, bool, size_t);
+    void (*blur3x3Bytes)(uint8_t *, const uint8_t *, const uint8_t *, const uint8_t *, size_t);
+    void (*sobel3x3Bytes)(uint8_t *, const uint8_t *, const uint8_t *, const uint8_t *, size_t);
+    bool (*equal)(const float *, const float *, size_t);
+    size_t (*lookup)(float *, const float *, const float *, int, size_t);
+    void (*lookupBytes)(uint8_t *, const uint8_t *, const int32_t *, size_t);
+    void (*gemmTile)(int, const float *, const float *, float *, int);
+};
+
+
+// ------------------------------------------ scalar ------------------------------------------
+
+static void addPlain(float *dst, const float *a, const float *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = a[i] + b[i];
+    }
+}
+
+static void addScalarPlain(float *dst, const float *src, float c, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = src[i] + c;
+    }
+}
+
+static void mulScalarPlain(float *dst, const float *src, float c, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = src[i] * c;
+    }
+}
+
+static void divScalarPlain(float *dst, const float *src, float c, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = src[i] / c;
+    }
+}
+
+static void addScaledPlain(float *dst, const float *src, float c, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] += src[i] * c;
+    }
+}
+
+static void clampPlain(float *dst, const float *src, float low, float high, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = std::min(std::max(src[i], low), high);
+    }
+}
+
+static void addClampedPlain(float *dst, const float *a, const float *b, float low, float high,
+                            size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = std::min(std::max(a[i] + b[i], low), high);
+    }
+}
+
+static void stencil3x3Plain(float *dst, const float *above, const float *row, const float *below,
+                            const float *taps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    for (size_t x = 0; x < n; ++ x)
+    {
+        float sum = 0.f;
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                sum += taps[3 * a + b] * rows[a][x + b];
+            }
+        }
+        dst[x] = round ? rintf(sum) : sum;
+    }
+}
+
+static void stencilPair3x3Plain(float *first, float *second, const float *above,
+                                const float *row, const float *below, const float *firstTaps,
+                                const float *secondTaps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    for (size_t x = 0; x < n; ++ x)
+    {
+        float firstSum = 0.f;
+        float secondSum = 0.f;
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                float pixel = rows[a][x + b];
+                firstSum += firstTaps[3 * a + b] * pixel;
+                secondSum += secondTaps[3 * a + b] * pixel;
+            }
+        }
+        first[x] = round ? rintf(firstSum) : firstSum;
+        second[x] = round ? rintf(secondSum) : secondSum;
+    }
+}
+
+/**
+ * divides by 2^shift and rounds halves to even. The quotient is bumped when the remainder, plus
+ * the parity of the floored quotient, reaches past half, which is how the vector versions do it.
+ */
+static int roundShiftPlain(int value, int shift)
+{
+    return (value + (1 << (shift - 1)) - 1 + ((value >> shift) & 1)) >> shift;
+}
+
+static void blur3x3BytesPlain(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                              const uint8_t *below, size_t n)
+{
+    for (size_t x = 0; x < n; ++ x)
+    {
+        int a = above[x - 1] + 2 * above[x] + above[x + 1];
+        int b = row[x - 1] + 2 * row[x] + row[x + 1];
+        int c = below[x - 1] + 2 * below[x] + below[x + 1];
+        // the sum of 16 weights of shades, so its quotient is a shade as well
+        dst[x] = (uint8_t) roundShiftPlain(a + 2 * b + c, BLUR_SHIFT);
+    }
+}
+
+static void sobel3x3BytesPlain(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                               const uint8_t *below, size_t n)
+{
+    for (size_t x = 0; x < n; ++ x)
+    {
+        int gx = (above[x - 1] - above[x + 1]) + 2 * (row[x - 1] - row[x + 1]) +
+                 (below[x - 1] - below[x + 1]);
+        int gy = (above[x - 1] + 2 * above[x] + above[x + 1]) -
+                 (below[x - 1] + 2 * below[x] + below[x + 1]);
+        int value = roundShiftPlain(gx, SOBEL_SHIFT) + roundShiftPlain(gy, SOBEL_SHIFT);
+        dst[x] = (uint8_t) (value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
+}
+
+static bool equalPlain(const float *a, const float *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t lookupPlain(float *dst, const float *src, const float *table, int size, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        float value = src[i];
+        if (!(value >= 0.f && value < (float) size) || value != (float) (int) value)
+        {
+            return i;
+        }
+        dst[i] = table[(int) value];
+    }
+    return n;
+}
+
+static void lookupBytesPlain(uint8_t *dst, const uint8_t *src, const int32_t *table, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        dst[i] = (uint8_t) table[src[i]];
+    }
+}
+
+static void gemmTilePlain(int kc, const float *a, const float *b, float *c, int ldc)
+{
+    float acc[GEMM_MR][GEMM_NR];
+    for (int i = 0; i < GEMM_MR; ++ i)
+    {
+        for (int j = 0; j < GEMM_NR; ++ j)
+        {
+            acc[i][j] = c[i * ldc + j];
+        }
+    }
+    for (int p = 0; p < kc; ++ p)
+    {
+        for (int i = 0; i < GEMM_MR; ++ i)
+        {
+            for (int j = 0; j < GEMM_NR; ++ j)
+            {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    for (int i = 0; i < GEMM_MR; ++ i)
+    {
+        for (int j = 0; j < GEMM_NR; ++ j)
+        {
+            c[i * ldc + j] = acc[i][j];
+        }
+    }
+}
+
+static const KernelSet SCALAR_SET = {"scalar", addPlain, addScalarPlain,
+                                     mulScalarPlain, divScalarPlain, addScaledPlain,
+                                     clampPlain, addClampedPlain,
+                                     stencil3x3Plain, stencilPair3x3Plain, blur3x3BytesPlain,
+                                     sobel3x3BytesPlain, equalPlain, lookupPlain,
+                                     lookupBytesPlain, gemmTilePlain};
+
+#ifdef KERNELS_X86
+
+// -------------------------------------------- SSE --------------------------------------------
+
+__attribute__((target("sse2")))
+static void addSse(float *dst, const float *a, const float *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    addPlain(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void addScalarSse(float *dst, const float *src, float c, size_t n)
+{
+    __m128 cv = _mm_set1_ps(c);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(src + i), cv));
+    }
+    addScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+static void mulScalarSse(float *dst, const float *src, float c, size_t n)
+{
+    __m128 cv = _mm_set1_ps(c);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), cv));
+    }
+    mulScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+static void divScalarSse(float *dst, const float *src, float c, size_t n)
+{
+    __m128 cv = _mm_set1_ps(c);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_loadu_ps(src + i), cv));
+    }
+    divScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+static void addScaledSse(float *dst, const float *src, float c, size_t n)
+{
+    __m128 cv = _mm_set1_ps(c);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(src + i), cv);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), product));
+    }
+    addScaledPlain(dst + i, src + i, c, n - i);
+}
+
+// the operands are in this order so that NaN and -0 come out as from std::max(x, low) and
+// std::min(x, high)
+__attribute__((target("sse2")))
+static void clampSse(float *dst, const float *src, float low, float high, size_t n)
+{
+    __m128 lv = _mm_set1_ps(low);
+    __m128 hv = _mm_set1_ps(high);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 value = _mm_max_ps(lv, _mm_loadu_ps(src + i));
+        _mm_storeu_ps(dst + i, _mm_min_ps(hv, value));
+    }
+    clampPlain(dst + i, src + i, low, high, n - i);
+}
+
+__attribute__((target("sse2")))
+static void addClampedSse(float *dst, const float *a, const float *b, float low, float high,
+                          size_t n)
+{
+    __m128 lv = _mm_set1_ps(low);
+    __m128 hv = _mm_set1_ps(high);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        _mm_storeu_ps(dst + i, _mm_min_ps(hv, _mm_max_ps(lv, sum)));
+    }
+    addClampedPlain(dst + i, a + i, b + i, low, high, n - i);
+}
+
+/**
+ * rounds to the nearest integer, halves to even, without the SSE4.1 round instruction: adding and
+ * subtracting 2^23 drops the fraction of any smaller float, larger ones are integers already
+ */
+__attribute__((target("sse2")))
+static __m128 roundSse(__m128 x)
+{
+    __m128 signBit = _mm_set1_ps(- 0.f);
+    __m128 sign = _mm_and_ps(x, signBit);
+    __m128 magic = _mm_or_ps(_mm_set1_ps(FLOAT_INTEGER_BOUND), sign);
+    // the sign is put back so that -0.3 rounds to -0 as it does with rintf
+    __m128 rounded = _mm_or_ps(_mm_sub_ps(_mm_add_ps(x, magic), magic), sign);
+    __m128 small = _mm_cmplt_ps(_mm_andnot_ps(signBit, x), _mm_set1_ps(FLOAT_INTEGER_BOUND));
+    return _mm_or_ps(_mm_and_ps(small, rounded), _mm_andnot_ps(small, x));
+}
+
+__attribute__((target("sse2")))
+static void stencil3x3Sse(float *dst, const float *above, const float *row, const float *below,
+                          const float *taps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    __m128 tv[9];
+    for (int t = 0; t < 9; ++ t)
+    {
+        tv[t] = _mm_set1_ps(taps[t]);
+    }
+    size_t x = 0;
+    for (; x + 4 <= n; x += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                sum = _mm_add_ps(sum, _mm_mul_ps(tv[3 * a + b], _mm_loadu_ps(rows[a] + x + b)));
+            }
+        }
+        _mm_storeu_ps(dst + x, round ? roundSse(sum) : sum);
+    }
+    stencil3x3Plain(dst + x, above + x, row + x, below + x, taps, round, n - x);
+}
+
+__attribute__((target("sse2")))
+static void stencilPair3x3Sse(float *first, float *second, const float *above, const float *row,
+                              const float *below, const float *firstTaps,
+                              const float *secondTaps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    __m128 fv[9];
+    __m128 sv[9];
+    for (int t = 0; t < 9; ++ t)
+    {
+        fv[t] = _mm_set1_ps(firstTaps[t]);
+        sv[t] = _mm_set1_ps(secondTaps[t]);
+    }
+    size_t x = 0;
+    for (; x + 4 <= n; x += 4)
+    {
+        __m128 firstSum = _mm_setzero_ps();
+        __m128 secondSum = _mm_setzero_ps();
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                __m128 pixel = _mm_loadu_ps(rows[a] + x + b);
+                firstSum = _mm_add_ps(firstSum, _mm_mul_ps(fv[3 * a + b], pixel));
+                secondSum = _mm_add_ps(secondSum, _mm_mul_ps(sv[3 * a + b], pixel));
+            }
+        }
+        _mm_storeu_ps(first + x, round ? roundSse(firstSum) : firstSum);
+        _mm_storeu_ps(second + x, round ? roundSse(secondSum) : secondSum);
+    }
+    stencilPair3x3Plain(first + x, second + x, above + x, row + x, below + x, firstTaps,
+                        secondTaps, round, n - x);
+}
+
+/**
+ * divides 16 bit lanes by 2^shift, rounding halves to even as roundShiftPlain does
+ */
+__attribute__((target("sse2")))
+static __m128i roundShiftSse(__m128i value, int shift)
+{
+    __m128i parity = _mm_and_si128(_mm_srai_epi16(value, shift), _mm_set1_epi16(1));
+    __m128i bias = _mm_add_epi16(_mm_set1_epi16((short) ((1 << (shift - 1)) - 1)), parity);
+    return _mm_srai_epi16(_mm_add_epi16(value, bias), shift);
+}
+
+/**
+ * widens 8 bytes to 16 bit lanes
+ */
+__attribute__((target("sse2")))
+static __m128i widenSse(const uint8_t *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), _mm_setzero_si128());
+}
+
+/**
+ * l + 2m + r over 8 pixels of a row, in 16 bit lanes
+ */
+__attribute__((target("sse2")))
+static __m128i smoothSse(const uint8_t *p)
+{
+    __m128i center = widenSse(p);
+    return _mm_add_epi16(_mm_add_epi16(widenSse(p - 1), widenSse(p + 1)),
+                         _mm_add_epi16(center, center));
+}
+
+/**
+ * l - r over 8 pixels of a row, in 16 bit lanes
+ */
+__attribute__((target("sse2")))
+static __m128i differenceSse(const uint8_t *p)
+{
+    return _mm_sub_epi16(widenSse(p - 1), widenSse(p + 1));
+}
+
+__attribute__((target("sse2")))
+static void blur3x3BytesSse(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                            const uint8_t *below, size_t n)
+{
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        __m128i half[2];
+        for (int h = 0; h < 2; ++ h)
+        {
+            size_t i = x + 8 * h;
+            __m128i b = smoothSse(row + i);
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(smoothSse(above + i), smoothSse(below + i)),
+                                        _mm_add_epi16(b, b));
+            half[h] = roundShiftSse(sum, BLUR_SHIFT);
+        }
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(half[0], half[1]));
+    }
+    blur3x3BytesPlain(dst + x, above + x, row + x, below + x, n - x);
+}
+
+__attribute__((target("sse2")))
+static void sobel3x3BytesSse(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                             const uint8_t *below, size_t n)
+{
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        __m128i half[2];
+        for (int h = 0; h < 2; ++ h)
+        {
+            size_t i = x + 8 * h;
+            __m128i b = differenceSse(row + i);
+            __m128i gx = _mm_add_epi16(_mm_add_epi16(differenceSse(above + i),
+                                                     differenceSse(below + i)),
+                                       _mm_add_epi16(b, b));
+            __m128i gy = _mm_sub_epi16(smoothSse(above + i), smoothSse(below + i));
+            half[h] = _mm_add_epi16(roundShiftSse(gx, SOBEL_SHIFT),
+                                    roundShiftSse(gy, SOBEL_SHIFT));
+        }
+        // packing saturates to [0, 255], which is the clamp of the result
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(half[0], half[1]));
+    }
+    sobel3x3BytesPlain(dst + x, above + x, row + x, below + x, n - x);
+}
+
+__attribute__((target("sse2")))
+static bool equalSse(const float *a, const float *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 eq = _mm_cmpeq_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        if (_mm_movemask_ps(eq) != 0xF)
+        {
+            return false;
+        }
+    }
+    return equalPlain(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void gemmTileSse(int kc, const float *a, const float *b, float *c, int ldc)
+{
+    __m128 acc[GEMM_MR][GEMM_NR / 4];
+    for (int i = 0; i < GEMM_MR; ++ i)
+    {
+        for (int j = 0; j < GEMM_NR / 4; ++ j)
+        {
+            acc[i][j] = _mm_loadu_ps(c + i * ldc + 4 * j);
+        }
+    }
+    for (int p = 0; p < kc; ++ p)
+    {
+        __m128 b0 = _mm_loadu_ps(b);
+        __m128 b1 = _mm_loadu_ps(b + 4);
+        __m128 b2 = _mm_loadu_ps(b + 8);
+        __m128 b3 = _mm_loadu_ps(b + 12);
+        for (int i = 0; i < GEMM_MR; ++ i)
+        {
+            __m128 av = _mm_set1_ps(a[i]);
+            acc[i][0] = _mm_add_ps(acc[i][0], _mm_mul_ps(av, b0));
+            acc[i][1] = _mm_add_ps(acc[i][1], _mm_mul_ps(av, b1));
+            acc[i][2] = _mm_add_ps(acc[i][2], _mm_mul_ps(av, b2));
+            acc[i][3] = _mm_add_ps(acc[i][3], _mm_mul_ps(av, b3));
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    for (int i = 0; i < GEMM_MR; ++ i)
+    {
+        for (int j = 0; j < GEMM_NR / 4; ++ j)
+        {
+            _mm_storeu_ps(c + i * ldc + 4 * j, acc[i][j]);
+        }
+    }
+}
+
+static const KernelSet SSE_SET = {"sse", addSse, addScalarSse, mulScalarSse, divScalarSse,
+                                  addScaledSse, clampSse, addClampedSse, stencil3x3Sse,
+                                  stencilPair3x3Sse, blur3x3BytesSse, sobel3x3BytesSse, equalSse,
+                                  lookupPlain, lookupBytesPlain, gemmTileSse};
+
+// -------------------------------------------- AVX2 --------------------------------------------
+
+__attribute__((target("avx2")))
+static void addAvx2(float *dst, const float *a, const float *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    addPlain(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void addScalarAvx2(float *dst, const float *src, float c, size_t n)
+{
+    __m256 cv = _mm256_set1_ps(c);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(src + i), cv));
+    }
+    addScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx2")))
+static void mulScalarAvx2(float *dst, const float *src, float c, size_t n)
+{
+    __m256 cv = _mm256_set1_ps(c);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), cv));
+    }
+    mulScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx2")))
+static void divScalarAvx2(float *dst, const float *src, float c, size_t n)
+{
+    __m256 cv = _mm256_set1_ps(c);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_loadu_ps(src + i), cv));
+    }
+    divScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx2")))
+static void addScaledAvx2(float *dst, const float *src, float c, size_t n)
+{
+    __m256 cv = _mm256_set1_ps(c);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 product = _mm256_mul_ps(_mm256_loadu_ps(src + i), cv);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), product));
+    }
+    addScaledPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx2")))
+static void clampAvx2(float *dst, const float *src, float low, float high, size_t n)
+{
+    __m256 lv = _mm256_set1_ps(low);
+    __m256 hv = _mm256_set1_ps(high);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 value = _mm256_max_ps(lv, _mm256_loadu_ps(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_min_ps(hv, value));
+    }
+    clampPlain(dst + i, src + i, low, high, n - i);
+}
+
+__attribute__((target("avx2")))
+static void addClampedAvx2(float *dst, const float *a, const float *b, float low, float high,
+                           size_t n)
+{
+    __m256 lv = _mm256_set1_ps(low);
+    __m256 hv = _mm256_set1_ps(high);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        _mm256_storeu_ps(dst + i, _mm256_min_ps(hv, _mm256_max_ps(lv, sum)));
+    }
+    addClampedPlain(dst + i, a + i, b + i, low, high, n - i);
+}
+
+__attribute__((target("avx2")))
+static void stencil3x3Avx2(float *dst, const float *above, const float *row, const float *below,
+                           const float *taps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    __m256 tv[9];
+    for (int t = 0; t < 9; ++ t)
+    {
+        tv[t] = _mm256_set1_ps(taps[t]);
+    }
+    size_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(tv[3 * a + b],
+                                                       _mm256_loadu_ps(rows[a] + x + b)));
+            }
+        }
+        if (round)
+        {
+            sum = _mm256_round_ps(sum, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        }
+        _mm256_storeu_ps(dst + x, sum);
+    }
+    stencil3x3Plain(dst + x, above + x, row + x, below + x, taps, round, n - x);
+}
+
+__attribute__((target("avx2")))
+static void stencilPair3x3Avx2(float *first, float *second, const float *above, const float *row,
+                               const float *below, const float *firstTaps,
+                               const float *secondTaps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    __m256 fv[9];
+    __m256 sv[9];
+    for (int t = 0; t < 9; ++ t)
+    {
+        fv[t] = _mm256_set1_ps(firstTaps[t]);
+        sv[t] = _mm256_set1_ps(secondTaps[t]);
+    }
+    size_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 firstSum = _mm256_setzero_ps();
+        __m256 secondSum = _mm256_setzero_ps();
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                __m256 pixel = _mm256_loadu_ps(rows[a] + x + b);
+                firstSum = _mm256_add_ps(firstSum, _mm256_mul_ps(fv[3 * a + b], pixel));
+                secondSum = _mm256_add_ps(secondSum, _mm256_mul_ps(sv[3 * a + b], pixel));
+            }
+        }
+        if (round)
+        {
+            firstSum = _mm256_round_ps(firstSum, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            secondSum = _mm256_round_ps(secondSum, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        }
+        _mm256_storeu_ps(first + x, firstSum);
+        _mm256_storeu_ps(second + x, secondSum);
+    }
+    stencilPair3x3Plain(first + x, second + x, above + x, row + x, below + x, firstTaps,
+                        secondTaps, round, n - x);
+}
+
+/**
+ * divides 16 bit lanes by 2^shift, rounding halves to even as roundShiftPlain does
+ */
+__attribute__((target("avx2")))
+static __m256i roundShiftAvx2(__m256i value, int shift)
+{
+    __m256i parity = _mm256_and_si256(_mm256_srai_epi16(value, shift), _mm256_set1_epi16(1));
+    __m256i bias = _mm256_add_epi16(_mm256_set1_epi16((short) ((1 << (shift - 1)) - 1)), parity);
+    return _mm256_srai_epi16(_mm256_add_epi16(value, bias), shift);
+}
+
+/**
+ * widens 16 bytes to 16 bit lanes
+ */
+__attribute__((target("avx2")))
+static __m256i widenAvx2(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p));
+}
+
+/**
+ * l + 2m + r over 16 pixels of a row, in 16 bit lanes
+ */
+__attribute__((target("avx2")))
+static __m256i smoothAvx2(const uint8_t *p)
+{
+    __m256i center = widenAvx2(p);
+    return _mm256_add_epi16(_mm256_add_epi16(widenAvx2(p - 1), widenAvx2(p + 1)),
+                            _mm256_add_epi16(center, center));
+}
+
+/**
+ * l - r over 16 pixels of a row, in 16 bit lanes
+ */
+__attribute__((target("avx2")))
+static __m256i differenceAvx2(const uint8_t *p)
+{
+    return _mm256_sub_epi16(widenAvx2(p - 1), widenAvx2(p + 1));
+}
+
+/**
+ * saturates two vectors of 16 bit lanes to 32 bytes in their order. packus works within 128 bit
+ * lanes, so its 64 bit quarters come out as lo0 hi0 lo1 hi1 and are permuted back.
+ */
+__attribute__((target("avx2")))
+static __m256i packBytesAvx2(__m256i lo, __m256i hi)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+__attribute__((target("avx2")))
+static void blur3x3BytesAvx2(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                             const uint8_t *below, size_t n)
+{
+    size_t x = 0;
+    for (; x + 32 <= n; x += 32)
+    {
+        __m256i half[2];
+        for (int h = 0; h < 2; ++ h)
+        {
+            size_t i = x + 16 * h;
+            __m256i b = smoothAvx2(row + i);
+            __m256i sum = _mm256_add_epi16(_mm256_add_epi16(smoothAvx2(above + i),
+                                                            smoothAvx2(below + i)),
+                                           _mm256_add_epi16(b, b));
+            half[h] = roundShiftAvx2(sum, BLUR_SHIFT);
+        }
+        _mm256_storeu_si256((__m256i *) (dst + x), packBytesAvx2(half[0], half[1]));
+    }
+    blur3x3BytesPlain(dst + x, above + x, row + x, below + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static void sobel3x3BytesAvx2(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                              const uint8_t *below, size_t n)
+{
+    size_t x = 0;
+    for (; x + 32 <= n; x += 32)
+    {
+        __m256i half[2];
+        for (int h = 0; h < 2; ++ h)
+        {
+            size_t i = x + 16 * h;
+            __m256i b = differenceAvx2(row + i);
+            __m256i gx = _mm256_add_epi16(_mm256_add_epi16(differenceAvx2(above + i),
+                                                           differenceAvx2(below + i)),
+                                          _mm256_add_epi16(b, b));
+            __m256i gy = _mm256_sub_epi16(smoothAvx2(above + i), smoothAvx2(below + i));
+            half[h] = _mm256_add_epi16(roundShiftAvx2(gx, SOBEL_SHIFT),
+                                       roundShiftAvx2(gy, SOBEL_SHIFT));
+        }
+        // packing saturates to [0, 255], which is the clamp of the result
+        _mm256_storeu_si256((__m256i *) (dst + x), packBytesAvx2(half[0], half[1]));
+    }
+    sobel3x3BytesPlain(dst + x, above + x, row + x, below + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static bool equalAvx2(const float *a, const float *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 eq = _mm256_cmp_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), _CMP_EQ_OQ);
+        if (_mm256_movemask_ps(eq) != 0xFF)
+        {
+            return false;
+        }
+    }
+    return equalPlain(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t lookupAvx2(float *dst, const float *src, const float *table, int size, size_t n)
+{
+    size_t i = 0;
+    __m256 zero = _mm256_setzero_ps();
+    __m256 bound = _mm256_set1_ps((float) size);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 value = _mm256_loadu_ps(src + i);
+        __m256i index = _mm256_cvttps_epi32(value);
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(value, zero, _CMP_GE_OQ),
+                                      _mm256_cmp_ps(value, bound, _CMP_LT_OQ));
+        __m256 whole = _mm256_cmp_ps(value, _mm256_cvtepi32_ps(index), _CMP_EQ_OQ);
+        if (_mm256_movemask_ps(_mm256_and_ps(inside, whole)) != 0xFF)
+        {
+            break;
+        }
+        _mm256_storeu_ps(dst + i, _mm256_i32gather_ps(table, index, 4));
+    }
+    return i + lookupPlain(dst + i, src + i, table, size, n - i);
+}
+
+__attribute__((target("avx2")))
+static void lookupBytesAvx2(uint8_t *dst, const uint8_t *src, const int32_t *table, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i words[4];
+        for (int q = 0; q < 4; ++ q)
+        {
+            __m128i bytes = _mm_loadl_epi64((const __m128i *) (src + i + 8 * q));
+            words[q] = _mm256_i32gather_epi32((const int *) table, _mm256_cvtepu8_epi32(bytes), 4);
+        }
+        // the packs interleave the 128 bit lanes, which the permutation puts back in order
+        __m256i low = _mm256_packus_epi32(words[0], words[1]);
+        __m256i high = _mm256_packus_epi32(words[2], words[3]);
+        __m256i packed = _mm256_packus_epi16(low, high);
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *) (dst + i), packed);
+    }
+    lookupBytesPlain(dst + i, src + i, table, n - i);
+}
+
+__attribute__((target("avx2")))
+static void gemmTileAvx2(int kc, const float *a, const float *b, float *c, int ldc)
+{
+    __m256 acc[GEMM_MR][GEMM_NR / 8];
+    for (int i = 0; i < GEMM_MR; ++ i)
+    {
+        acc[i][0] = _mm256_loadu_ps(c + i * ldc);
+        acc[i][1] = _mm256_loadu_ps(c + i * ldc + 8);
+    }
+    for (int p = 0; p < kc; ++ p)
+    {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (int i = 0; i < GEMM_MR; ++ i)
+        {
+            // separate multiply and add rather than FMA, to round like the scalar loop
+            __m256 av = _mm256_broadcast_ss(a + i);
+            acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_mul_ps(av, b0));
+            acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_mul_ps(av, b1));
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    for (int i = 0; i < GEMM_MR; ++ i)
+    {
+        _mm256_storeu_ps(c + i * ldc, acc[i][0]);
+        _mm256_storeu_ps(c + i * ldc + 8, acc[i][1]);
+    }
+}
+
+static const KernelSet AVX2_SET = {"avx2", addAvx2, addScalarAvx2, mulScalarAvx2, divScalarAvx2,
+                                   addScaledAvx2, clampAvx2, addClampedAvx2, stencil3x3Avx2,
+                                   stencilPair3x3Avx2, blur3x3BytesAvx2, sobel3x3BytesAvx2,
+                                   equalAvx2, lookupAvx2, lookupBytesAvx2, gemmTileAvx2};
+
+// ------------------------------------------- AVX-512 -------------------------------------------
+
+__attribute__((target("avx512f")))
+static void addAvx512(float *dst, const float *a, const float *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    }
+    addPlain(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void addScalarAvx512(float *dst, const float *src, float c, size_t n)
+{
+    __m512 cv = _mm512_set1_ps(c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(src + i), cv));
+    }
+    addScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void mulScalarAvx512(float *dst, const float *src, float c, size_t n)
+{
+    __m512 cv = _mm512_set1_ps(c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_loadu_ps(src + i), cv));
+    }
+    mulScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void divScalarAvx512(float *dst, const float *src, float c, size_t n)
+{
+    __m512 cv = _mm512_set1_ps(c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(dst + i, _mm512_div_ps(_mm512_loadu_ps(src + i), cv));
+    }
+    divScalarPlain(dst + i, src + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void addScaledAvx512(float *dst, const float *src, float c, size_t n)
+{
+    __m512 cv = _mm512_set1_ps(c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 product = _mm512_mul_ps(_mm512_loadu_ps(src + i), cv);
+        _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i), product));
+    }
+    addScaledPlain(dst + i, src + i, c, n - i);
+}
+
+// the masked forms, as the plain ones trip GCC's uninitialized warning
+__attribute__((target("avx512f")))
+static void clampAvx512(float *dst, const float *src, float low, float high, size_t n)
+{
+    __m512 lv = _mm512_set1_ps(low);
+    __m512 hv = _mm512_set1_ps(high);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 value = _mm512_maskz_max_ps(0xFFFF, lv, _mm512_loadu_ps(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_maskz_min_ps(0xFFFF, hv, value));
+    }
+    clampPlain(dst + i, src + i, low, high, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void addClampedAvx512(float *dst, const float *a, const float *b, float low, float high,
+                             size_t n)
+{
+    __m512 lv = _mm512_set1_ps(low);
+    __m512 hv = _mm512_set1_ps(high);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 sum = _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        sum = _mm512_maskz_max_ps(0xFFFF, lv, sum);
+        _mm512_storeu_ps(dst + i, _mm512_maskz_min_ps(0xFFFF, hv, sum));
+    }
+    addClampedPlain(dst + i, a + i, b + i, low, high, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void stencil3x3Avx512(float *dst, const float *above, const float *row, const float *below,
+                             const float *taps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    __m512 tv[9];
+    for (int t = 0; t < 9; ++ t)
+    {
+        tv[t] = _mm512_set1_ps(taps[t]);
+    }
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        __m512 sum = _mm512_setzero_ps();
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                sum = _mm512_add_ps(sum, _mm512_mul_ps(tv[3 * a + b],
+                                                       _mm512_loadu_ps(rows[a] + x + b)));
+            }
+        }
+        if (round)
+        {
+            // the masked form, as the plain one trips GCC's uninitialized warning
+            sum = _mm512_mask_roundscale_ps(sum, 0xFFFF, sum,
+                                            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        }
+        _mm512_storeu_ps(dst + x, sum);
+    }
+    stencil3x3Plain(dst + x, above + x, row + x, below + x, taps, round, n - x);
+}
+
+__attribute__((target("avx512f")))
+static void stencilPair3x3Avx512(float *first, float *second, const float *above,
+                                 const float *row, const float *below, const float *firstTaps,
+                                 const float *secondTaps, bool round, size_t n)
+{
+    const float *rows[3] = {above - 1, row - 1, below - 1};
+    __m512 fv[9];
+    __m512 sv[9];
+    for (int t = 0; t < 9; ++ t)
+    {
+        fv[t] = _mm512_set1_ps(firstTaps[t]);
+        sv[t] = _mm512_set1_ps(secondTaps[t]);
+    }
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        __m512 firstSum = _mm512_setzero_ps();
+        __m512 secondSum = _mm512_setzero_ps();
+        for (int a = 0; a < 3; ++ a)
+        {
+            for (int b = 0; b < 3; ++ b)
+            {
+                __m512 pixel = _mm512_loadu_ps(rows[a] + x + b);
+                firstSum = _mm512_add_ps(firstSum, _mm512_mul_ps(fv[3 * a + b], pixel));
+                secondSum = _mm512_add_ps(secondSum, _mm512_mul_ps(sv[3 * a + b], pixel));
+            }
+        }
+        if (round)
+        {
+            firstSum = _mm512_mask_roundscale_ps(firstSum, 0xFFFF, firstSum,
+                                                 _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            secondSum = _mm512_mask_roundscale_ps(secondSum, 0xFFFF, secondSum,
+                                                  _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        }
+        _mm512_storeu_ps(first + x, firstSum);
+        _mm512_storeu_ps(second + x, secondSum);
+    }
+    stencilPair3x3Plain(first + x, second + x, above + x, row + x, below + x, firstTaps,
+                        secondTaps, round, n - x);
+}
+
+__attribute__((target("avx512f")))
+static bool equalAvx512(const float *a, const float *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        if (_mm512_cmp_ps_mask(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), _CMP_EQ_OQ) !=
+            0xFFFF)
+        {
+            return false;
+        }
+    }
+    return equalPlain(a + i, b + i, n - i);
+}
+
+// the lookups use the masked forms of the conversions and the gathers with a full mask, as the
+// plain forms leave GCC warning about their undefined sources
+__attribute__((target("avx512f")))
+static size_t lookupAvx512(float *dst, const float *src, const float *table, int size, size_t n)
+{
+    size_t i = 0;
+    __m512 zero = _mm512_setzero_ps();
+    __m512 bound = _mm512_set1_ps((float) size);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 value = _mm512_loadu_ps(src + i);
+        __m512i index = _mm512_maskz_cvttps_epi32(0xFFFF, value);
+        __m512 whole = _mm512_maskz_cvtepi32_ps(0xFFFF, index);
+        __mmask16 valid = _mm512_cmp_ps_mask(value, zero, _CMP_GE_OQ) &
+                          _mm512_cmp_ps_mask(value, bound, _CMP_LT_OQ) &
+                          _mm512_cmp_ps_mask(value, whole, _CMP_EQ_OQ);
+        if (valid != 0xFFFF)
+        {
+            break;
+        }
+        _mm512_storeu_ps(dst + i, _mm512_mask_i32gather_ps(value, 0xFFFF, index, table, 4));
+    }
+    return i + lookupPlain(dst + i, src + i, table, size, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void lookupBytesAvx512(uint8_t *dst, const uint8_t *src, const int32_t *table, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i index = _mm512_maskz_cvtepu8_epi32(0xFFFF,
+                                                   _mm_loadu_si128((const __m128i *) (src + i)));
+        __m512i words = _mm512_mask_i32gather_epi32(index, 0xFFFF, index, table, 4);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm512_maskz_cvtepi32_epi8(0xFFFF, words));
+    }
+    lookupBytesPlain(dst + i, src + i, table, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void gemmTileAvx512(int kc, const float *a, const float *b, float *c, int ldc)
+{
+    __m512 acc0 = _mm512_loadu_ps(c);
+    __m512 acc1 = _mm512_loadu_ps(c + ldc);
+    __m512 acc2 = _mm512_loadu_ps(c + 2 * ldc);
+    __m512 acc3 = _mm512_loadu_ps(c + 3 * ldc);
+    for (int p = 0; p < kc; ++ p)
+    {
+        // separate multiply and add rather than FMA, to round like the scalar loop
+        __m512 bv = _mm512_loadu_ps(b);
+        acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(_mm512_set1_ps(a[0]), bv));
+        acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(_mm512_set1_ps(a[1]), bv));
+        acc2 = _mm512_add_ps(acc2, _mm512_mul_ps(_mm512_set1_ps(a[2]), bv));
+        acc3 = _mm512_add_ps(acc3, _mm512_mul_ps(_mm512_set1_ps(a[3]), bv));
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    _mm512_storeu_ps(c, acc0);
+    _mm512_storeu_ps(c + ldc, acc1);
+    _mm512_storeu_ps(c + 2 * ldc, acc2);
+    _mm512_storeu_ps(c + 3 * ldc, acc3);
+}
+
+// the 16 bit lane operations of AVX-512 need AVX512BW, so the byte stencils stay on AVX2
+static const KernelSet AVX512_SET = {"avx512", addAvx512, addScalarAvx512, mulScalarAvx512,
+                                     divScalarAvx512, addScaledAvx512, clampAvx512,
+                                     addClampedAvx512, stencil3x3Avx512,
+                                     stencilPair3x3Avx512, blur3x3BytesAvx2, sobel3x3BytesAvx2,
+                                     equalAvx512, lookupAvx512, lookupBytesAvx512,
+                                     gemmTileAvx512};
+
+#endif // KERNELS_X86
+
+
+/**
+ * chooses the widest kernel set the CPU supports, limited by the MATRIX_KERNELS variable. Exits
+ * if the variable names no kernel set, rather than run a set the user did not ask for.
+ * @return the chosen kernel set
+ */
+static const KernelSet &selectSet()
+{
+    const char *forced = getenv(KERNELS_ENV);
+    if (forced != nullptr && strcmp(forced, "scalar") != 0 && strcmp(forced, "sse") != 0 &&
+        strcmp(forced, "avx2") != 0 && strcmp(forced, "avx512") != 0)
+    {
+        std::cerr << KERNELS_ERR_MSG;
+        exit(1);
+    }
+    if (forced != nullptr && strcmp(forced, "scalar") == 0)
+    {
+        return SCALAR_SET;
+    }
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    bool allowAvx512 = (forced == nullptr || strcmp(forced, "avx512") == 0);
+    bool allowAvx2 = allowAvx512 || strcmp(forced, "avx2") == 0;
+    if (allowAvx512 && __builtin_cpu_supports("avx512f"))
+    {
+        return AVX512_SET;
+    }
+    if (allowAvx2 && __builtin_cpu_supports("avx2"))
+    {
+        return AVX2_SET;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return SSE_SET;
+    }
+#endif
+    return SCALAR_SET;
+}
+
+/**
+ * @return the kernel set in use, chosen on the first call
+ */
+static const KernelSet &activeSet()
+{
+    static const KernelSet &set = selectSet();
+    return set;
+}
+
+const char *kernels::name()
+{
+    return activeSet().name;
+}
+
+void kernels::add(float *dst, const float *a, const float *b, size_t n)
+{
+    activeSet().add(dst, a, b, n);
+}
+
+void kernels::addScalar(float *dst, const float *src, float c, size_t n)
+{
+    activeSet().addScalar(dst, src, c, n);
+}
+
+void kernels::mulScalar(float *dst, const float *src, float c, size_t n)
+{
+    activeSet().mulScalar(dst, src, c, n);
+}
+
+void kernels::divScalar(float *dst, const float *src, float c, size_t n)
+{
+    activeSet().divScalar(dst, src, c, n);
+}
+
+void kernels::addScaled(float *dst, const float *src, float c, size_t n)
+{
+    activeSet().addScaled(dst, src, c, n);
+}
+
+void kernels::clamp(float *dst, const float *src, float low, float high, size_t n)
+{
+    activeSet().clamp(dst, src, low, high, n);
+}
+
+void kernels::addClamped(float *dst, const float *a, const float *b, float low, float high,
+                         size_t n)
+{
+    activeSet().addClamped(dst, a, b, low, high, n);
+}
+
+void kernels::stencil3x3(float *dst, const float *above, const float *row, const float *below,
+                         const float *taps, bool round, size_t n)
+{
+    activeSet().stencil3x3(dst, above, row, below, taps, round, n);
+}
+
+void kernels::stencilPair3x3(float *first, float *second, const float *above, const float *row,
+                             const float *below, const float *firstTaps, const float *secondTaps,
+                             bool round, size_t n)
+{
+    activeSet().stencilPair3x3(first, second, above, row, below, firstTaps, secondTaps, round, n);
+}
+
+void kernels::blur3x3Bytes(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                           const uint8_t *below, size_t n)
+{
+    activeSet().blur3x3Bytes(dst, above, row, below, n);
+}
+
+void kernels::sobel3x3Bytes(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                            const uint8_t *below, size_t n)
+{
+    activeSet().sobel3x3Bytes(dst, above, row, below, n);
+}
+
+bool kernels::equal(const float *a, const float *b, size_t n)
+{
+    return activeSet().equal(a, b, n);
+}
+
+size_t kernels::lookup(float *dst, const float *src, const float *table, int size, size_t n)
+{
+    return activeSet().lookup(dst, src, table, size, n);
+}
+
+void kernels::lookupBytes(uint8_t *dst, const uint8_t *src, const int32_t *table, size_t n)
+{
+    activeSet().lookupBytes(dst, src, table, n);
+}
+
+void kernels::copy(float *dst, const float *src, size_t n)
+{
+    // the library memcpy is already dispatched on the widest vector unit
+    if (n > 0)
+    {
+        memcpy(dst, src, n * sizeof(float));
+    }
+}
+
+void kernels::gemmTile(int kc, const float *a, const float *b, float *c, int ldc)
+{
+    activeSet().gemmTile(kc, a, b, c, ldc);
+}
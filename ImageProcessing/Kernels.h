@@ -0,0 +1,200 @@
+#ifndef EX5_KERNELS_H
+#define EX5_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// rows and columns of the register tile computed by the GEMM micro kernel
+#define GEMM_MR 4
+#define GEMM_NR 16
+
+/**
+ * the array kernels used by Matrix. Every kernel has a scalar, SSE, AVX2 and AVX-512 version,
+ * and the widest one the CPU supports is chosen the first time a kernel is called. The
+ * environment variable MATRIX_KERNELS (scalar, sse, avx2 or avx512) can force a narrower set,
+ * any other value is an error.
+ * All the versions do the same IEEE operations in the same order, so they return identical
+ * results.
+ */
+namespace kernels
+{
+    /**
+     * @return the name of the kernel set in use
+     */
+    const char *name();
+
+    /**
+     * dst[i] = a[i] + b[i]
+     * @param dst the output array, may be a or b
+     * @param a the lhs array
+     * @param b the rhs array
+     * @param n the number of elements
+     */
+    void add(float *dst, const float *a, const float *b, size_t n);
+
+    /**
+     * dst[i] = src[i] + c
+     * @param dst the output array, may be src
+     * @param src the input array
+     * @param c the scalar to add
+     * @param n the number of elements
+     */
+    void addScalar(float *dst, const float *src, float c, size_t n);
+
+    /**
+     * dst[i] = src[i] * c
+     * @param dst the output array, may be src
+     * @param src the input array
+     * @param c the scalar to multiply by
+     * @param n the number of elements
+     */
+    void mulScalar(float *dst, const float *src, float c, size_t n);
+
+    /**
+     * dst[i] = src[i] / c
+     * @param dst the output array, may be src
+     * @param src the input array
+     * @param c the scalar to divide by
+     * @param n the number of elements
+     */
+    void divScalar(float *dst, const float *src, float c, size_t n);
+
+    /**
+     * dst[i] = dst[i] + src[i] * c, rounding the product before the sum
+     * @param dst the array to add to
+     * @param src the array to scale, must not overlap dst
+     * @param c the scalar to multiply by
+     * @param n the number of elements
+     */
+    void addScaled(float *dst, const float *src, float c, size_t n);
+
+    /**
+     * dst[i] = std::min(std::max(src[i], low), high)
+     * @param dst the output array, may be src
+     * @param src the input array
+     * @param low the least value kept
+     * @param high the largest value kept
+     * @param n the number of elements
+     */
+    void clamp(float *dst, const float *src, float low, float high, size_t n);
+
+    /**
+     * dst[i] = std::min(std::max(a[i] + b[i], low), high), in one pass
+     * @param dst the output array, may be a or b
+     * @param a the lhs array
+     * @param b the rhs array
+     * @param low the least value kept
+     * @param high the largest value kept
+     * @param n the number of elements
+     */
+    void addClamped(float *dst, const float *a, const float *b, float low, float high, size_t n);
+
+    /**
+     * runs a 3 x 3 stencil over a row. The three rows may be read one element before their start
+     * and one after their end, so the borders are whatever the caller pads them with.
+     * dst[x] is the sum of taps[3a + b] * rows[a][x + b - 1], added in the order of the taps
+     * starting from 0, as convolve() adds them.
+     * @param dst the output row, must not overlap the input rows
+     * @param above the row above
+     * @param row the row itself
+     * @param below the row below
+     * @param taps the 9 taps of the stencil, row after row
+     * @param round whether to round every result to the nearest integer, as rintf does
+     * @param n the number of elements of the rows
+     */
+    void stencil3x3(float *dst, const float *above, const float *row, const float *below,
+                    const float *taps, bool round, size_t n);
+
+    /**
+     * runs two 3 x 3 stencils over a row, loading every neighbourhood once for both. Each result
+     * is that of stencil3x3 with its taps.
+     * @param first the output row of the first stencil
+     * @param second the output row of the second stencil
+     * @param above the row above
+     * @param row the row itself
+     * @param below the row below
+     * @param firstTaps the 9 taps of the first stencil, row after row
+     * @param secondTaps the 9 taps of the second stencil, row after row
+     * @param round whether to round every result to the nearest integer, as rintf does
+     * @param n the number of elements of the rows
+     */
+    void stencilPair3x3(float *first, float *second, const float *above, const float *row,
+                        const float *below, const float *firstTaps, const float *secondTaps,
+                        bool round, size_t n);
+
+    /**
+     * blurs a row of bytes with the {{1, 2, 1}, {2, 4, 2}, {1, 2, 1}} / 16 stencil, rounding
+     * halves to even. The rows may be read one byte before their start and one after their end.
+     * @param dst the output row
+     * @param above the row above
+     * @param row the row itself
+     * @param below the row below
+     * @param n the number of bytes of the rows
+     */
+    void blur3x3Bytes(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                      const uint8_t *below, size_t n);
+
+    /**
+     * applies sobel on a row of bytes: the horizontal and the vertical gradients divided by 8 and
+     * rounded halves to even, summed and clamped to a byte. The rows may be read one byte before
+     * their start and one after their end.
+     * @param dst the output row
+     * @param above the row above
+     * @param row the row itself
+     * @param below the row below
+     * @param n the number of bytes of the rows
+     */
+    void sobel3x3Bytes(uint8_t *dst, const uint8_t *above, const uint8_t *row,
+                       const uint8_t *below, size_t n);
+
+    /**
+     * compares two arrays with the float == operator
+     * @param a the lhs array
+     * @param b the rhs array
+     * @param n the number of elements
+     * @return true if a[i] == b[i] for every i, false otherwise
+     */
+    bool equal(const float *a, const float *b, size_t n);
+
+    /**
+     * dst[i] = table[src[i]] for as long as src[i] is an integer in [0, size). SSE has no gather,
+     * so the SSE set looks up one element at a time.
+     * @param dst the output array, may be src
+     * @param src the indices into the table, as floats
+     * @param table the table
+     * @param size the number of elements of the table
+     * @param n the number of elements
+     * @return the number of elements looked up, n unless src[return value] is not an index
+     */
+    size_t lookup(float *dst, const float *src, const float *table, int size, size_t n);
+
+    /**
+     * dst[i] = table[src[i]] for a table of 256 words, each of which holds a byte
+     * @param dst the output array, may be src
+     * @param src the indices into the table
+     * @param table the 256 elements of the table, each in [0, 255]
+     * @param n the number of elements
+     */
+    void lookupBytes(uint8_t *dst, const uint8_t *src, const int32_t *table, size_t n);
+
+    /**
+     * copies n elements from src to dst
+     * @param dst the output array
+     * @param src the input array, must not overlap dst
+     * @param n the number of elements
+     */
+    void copy(float *dst, const float *src, size_t n);
+
+    /**
+     * adds the product of a packed GEMM_MR x kc sliver and a packed kc x GEMM_NR sliver to a
+     * GEMM_MR x GEMM_NR tile of C
+     * @param kc the depth of the slivers
+     * @param a the packed sliver of A, the GEMM_MR elements of each column are contiguous
+     * @param b the packed sliver of B, the GEMM_NR elements of each row are contiguous
+     * @param c the top left element of the tile
+     * @param ldc the distance between two rows of C
+     */
+    void gemmTile(int kc, const float *a, const float *b, float *c, int ldc);
+}
+
+#endif //EX5_KERNELS_H
@@ -1,34 +1,248 @@
 #include <iostream>
+#include <charconv>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <locale>
 #include "Matrix.h"
+#include "Gemm.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+#include "BufferPool.h"
+#include "Trace.h"
 #include <cstring>
+#include <utility>
+#include <atomic>
 
 #define INDEX_ERR_MSG "Index out of range.\n"
 #define DIVISION_ERR_MSG "Division by zero.\n"
 #define DIMENSIONS_ERR_MSG "Invalid Matrix dimensions.\n"
 #define STREAM_ERR_MSG "Error loading from input stream.\n"
+// padded rows start on a cache line
+#define PITCH_ALIGNMENT (BUFFER_ALIGNMENT / (int) sizeof(float))
+// padded rows are not a multiple of this many elements apart, which would alias in the cache
+#define ALIASING_PITCH 256
 
+// the text parser reads the stream in chunks of this many bytes
+#define TEXT_CHUNK_BYTES (1 << 16)
+// the largest precision written by to_chars, others are left to operator<< of the stream
+#define MAX_TEXT_PRECISION 48
+// enough characters for any float in any format of to_chars up to MAX_TEXT_PRECISION: the 39
+// integer digits of FLT_MAX in fixed, the point, the fraction and the sign
+#define FLOAT_TEXT_CHARS 128
+
+// the number of data buffers allocated by all matrices
+static std::atomic<long> allocations(0);
+
+
+/**
+ * runs fn over the rows of rows x cols arrays, in parallel row blocks when they are large
+ * @tparam Function a callable (r, count) which handles count elements from the start of row r
+ * @param rows the number of rows
+ * @param cols the number of columns
+ * @param packed whether the rows of every array have no padding between them, in which case a
+ * whole row block is handed to fn at once
+ * @param fn the function to run
+ */
+template<class Function>
+static void forRowSpans(int rows, int cols, bool packed, Function fn)
+{
+    parallelRows(rows, cols, [=](int lo, int hi)
+    {
+        if (packed)
+        {
+            fn(lo, (size_t) (hi - lo) * cols);
+            return;
+        }
+        for (int r = lo; r < hi; ++ r)
+        {
+            fn(r, (size_t) cols);
+        }
+    });
+}
+
+/**
+ * applies a scalar kernel in place to a rows x cols array
+ * @param kernel the kernel to apply
+ * @param data the array
+ * @param pitch the distance between two rows of the array
+ * @param c the scalar argument of the kernel
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+static void parallelScalarOp(void (*kernel)(float *, const float *, float, size_t), float *data,
+                             int pitch, float c, int rows, int cols)
+{
+    forRowSpans(rows, cols, pitch == cols, [=](int r, size_t count)
+    {
+        float *row = data + (size_t) r * pitch;
+        kernel(row, row, c, count);
+    });
+}
+
+/**
+ * adds a rows x cols array to another one
+ * @param dst the array to add to
+ * @param dstPitch the distance between two rows of dst
+ * @param src the array to add
+ * @param srcPitch the distance between two rows of src
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+static void parallelAdd(float *dst, int dstPitch, const float *src, int srcPitch, int rows,
+                        int cols)
+{
+    forRowSpans(rows, cols, dstPitch == cols && srcPitch == cols, [=](int r, size_t count)
+    {
+        float *row = dst + (size_t) r * dstPitch;
+        kernels::add(row, row, src + (size_t) r * srcPitch, count);
+    });
+}
+
+/**
+ * copies a rows x cols array
+ * @param dst the output array
+ * @param dstPitch the distance between two rows of dst
+ * @param src the input array
+ * @param srcPitch the distance between two rows of src
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+static void parallelCopy(float *dst, int dstPitch, const float *src, int srcPitch, int rows,
+                         int cols)
+{
+    forRowSpans(rows, cols, dstPitch == cols && srcPitch == cols, [=](int r, size_t count)
+    {
+        kernels::copy(dst + (size_t) r * dstPitch, src + (size_t) r * srcPitch, count);
+    });
+}
+
+/**
+ * compares two rows x cols arrays
+ * @param a the lhs array
+ * @param aPitch the distance between two rows of a
+ * @param b the rhs array
+ * @param bPitch the distance between two rows of b
+ * @param rows the number of rows
+ * @param cols the number of columns
+ * @return true if the arrays are equal, false otherwise
+ */
+static bool parallelEqual(const float *a, int aPitch, const float *b, int bPitch, int rows,
+                          int cols)
+{
+    std::atomic<bool> equal(true);
+    forRowSpans(rows, cols, aPitch == cols && bPitch == cols, [=, &equal](int r, size_t count)
+    {
+        if (equal && !kernels::equal(a + (size_t) r * aPitch, b + (size_t) r * bPitch, count))
+        {
+            equal = false;
+        }
+    });
+    return equal;
+}
+
+
+/**
+ * allocates a data buffer and counts the allocation
+ * @param size the number of elements in the buffer
+ * @return the new buffer
+ */
+float *Matrix::_allocate(size_t size)
+{
+    TRACE_COUNT("allocate", size * sizeof(float), 0, 0);
+    allocations++;
+    return (float *) BufferPool::instance().acquire(size * sizeof(float));
+}
+
+/**
+ * gives a data buffer back to the buffer pool
+ * @param data the buffer, or nullptr
+ */
+void Matrix::_release(float *data)
+{
+    BufferPool::instance().release(data);
+}
+
+/**
+ * makes sure the data buffer holds at least size elements, reusing the current one if it is
+ * large enough. The elements are left unspecified.
+ * @param size the number of elements needed
+ */
+void Matrix::_reserve(size_t size)
+{
+    if (_data != nullptr && BufferPool::capacity(_data) >= size * sizeof(float))
+    {
+        return;
+    }
+    _release(_data);
+    _data = nullptr;
+    _data = _allocate(size);
+}
+
+/**
+ * a row pitch for matrices of the given width, see Matrix.h
+ * @param cols the columns number of the matrix
+ * @return the pitch
+ */
+int Matrix::paddedPitch(int cols)
+{
+    int pitch = (cols + PITCH_ALIGNMENT - 1) / PITCH_ALIGNMENT * PITCH_ALIGNMENT;
+    if (pitch % ALIASING_PITCH == 0)
+    {
+        pitch += PITCH_ALIGNMENT;
+    }
+    return pitch;
+}
+
+/**
+ * @return the number of data buffers allocated by all matrices since the last reset
+ */
+long Matrix::allocationCount()
+{
+    return allocations;
+}
+
+/**
+ * resets the count of allocated data buffers
+ */
+void Matrix::resetAllocationCount()
+{
+    allocations = 0;
+}
+
+/**
+ * constructs a new matrix
+ * @param rows the rows number of the matrix
+ * @param cols the columns number of the matrix
+ */
+Matrix::Matrix(int rows, int cols) : Matrix(rows, cols, ZERO_INIT)
+{
+}
 
 /**
  * constructs a new matrix
  * @param rows the rows number of the matrix
  * @param cols the columns number of the matrix
+ * @param init whether to set the elements to 0
+ * @param pitch the distance in elements between the starts of two rows, 0 for cols
  */
-Matrix::Matrix(int rows, int cols)
+Matrix::Matrix(int rows, int cols, Initialization init, int pitch)
 {
-    if (rows >= 0 && cols >= 0)
+    if (rows >= 0 && cols >= 0 && (pitch == 0 || pitch >= cols))
     {
         _rows = rows;
         _cols = cols;
+        _pitch = (pitch == 0) ? cols : pitch;
     }
     else
     {
         std::cerr << INDEX_ERR_MSG;
         exit(1);
     }
-    this->_data = new float[_cols*_rows];
-    for (int i = 0; i < rows*cols; ++ i)
+    this->_data = _allocate((size_t) _pitch * _rows);
+    if (init == ZERO_INIT)
     {
-        this->_data[i] = 0;
+        memset(this->_data, 0, (size_t) _pitch * _rows * sizeof(float));
     }
 }
 
@@ -39,7 +253,8 @@ Matrix::Matrix()
 {
     _rows = 1;
     _cols = 1;
-    this->_data = new float[_cols*_rows];
+    _pitch = 1;
+    this->_data = _allocate((size_t) _cols * _rows);
     this->_data[0] = 1;
 }
 
@@ -56,11 +271,23 @@ Matrix::Matrix(Matrix const &m)
     }
     _rows = m.getRows();
     _cols = m.getCols();
-    this->_data = new float[_cols*_rows];
-    for (int i = 0; i < _rows*_cols; ++ i)
-    {
-        this->_data[i] = m[i];
-    }
+    _pitch = m._pitch;
+    this->_data = _allocate((size_t) _pitch * _rows);
+    TRACE_COUNT("copy", 0, 2LL * _rows * _cols, 0);
+    parallelCopy(this->_data, _pitch, m._data, m._pitch, _rows, _cols);
+}
+
+/**
+ * constructs a new matrix by taking the data of an existing one
+ * @param m the matrix to move, left as a 0 x 0 matrix
+ */
+Matrix::Matrix(Matrix &&m) noexcept : _rows(m._rows), _cols(m._cols), _pitch(m._pitch),
+                                      _data(m._data)
+{
+    m._rows = 0;
+    m._cols = 0;
+    m._pitch = 0;
+    m._data = nullptr;
 }
 
 /**
@@ -68,7 +295,7 @@ Matrix::Matrix(Matrix const &m)
  */
 Matrix::~Matrix()
 {
-    delete [] _data;
+    _release(_data);
     _data = nullptr;
 }
 
@@ -98,8 +325,18 @@ int Matrix::getCols() const
  */
 Matrix& Matrix::vectorize()
 {
+    if (_pitch != _cols)
+    {
+        // packs the rows first, every row moves towards the start so none is overwritten early
+        for (int r = 1; r < _rows; ++ r)
+        {
+            memmove(_data + (size_t) r * _cols, _data + (size_t) r * _pitch,
+                    (size_t) _cols * sizeof(float));
+        }
+    }
     this->_rows = this->_cols * this->_rows;
     this->_cols = 1;
+    this->_pitch = 1;
     return (*this);
 }
 
@@ -112,15 +349,15 @@ void Matrix::print() const
     {
         if ( i == _cols*_rows - 1)
         {
-            std::cout << _data[i];
+            std::cout << _data[_offset(i)];
         }
         if (i % _cols == _cols - 1 )
         {
-            std::cout << _data[i] << std::endl;
+            std::cout << _data[_offset(i)] << std::endl;
         }
         else
         {
-            std::cout << _data[i] << " " ;
+            std::cout << _data[_offset(i)] << " " ;
         }
     }
 }
@@ -136,14 +373,8 @@ bool Matrix::operator==(const Matrix &other) const
 {
     if (this->_cols == other.getCols() && this->_rows == other.getRows())
     {
-        for (int i = 0; i < _rows*_cols; ++ i)
-        {
-            if (this->_data[i] != other[i])
-            {
-                return false;
-            }
-        }
-        return true;
+        TRACE_COUNT("equal", 0, 2LL * _rows * _cols, 0);
+        return parallelEqual(this->_data, _pitch, other._data, other._pitch, _rows, _cols);
     }
     return false;
 }
@@ -170,14 +401,30 @@ Matrix& Matrix::operator=(const Matrix &b)
     {
         return *this;
     }
-    this->_cols = b._cols;
-    this->_rows = b._rows;
-    delete [] this->_data;
-    this->_data = new float[_cols*_rows];
-    for (int i = 0; i < _rows*_cols; ++ i)
+    if (this->_cols != b._cols || this->_rows != b._rows)
     {
-        this->_data[i] = b._data[i];
+        // a matrix of the same dimensions keeps its pitch, any other one is packed
+        _reserve((size_t) b._cols * b._rows);
+        this->_cols = b._cols;
+        this->_rows = b._rows;
+        this->_pitch = b._cols;
     }
+    TRACE_COUNT("copy", 0, 2LL * _rows * _cols, 0);
+    parallelCopy(this->_data, _pitch, b._data, b._pitch, _rows, _cols);
+    return *this;
+}
+
+/**
+ * gives the matrix the data of other matrix
+ * @param b the matrix to move, left with the previous data of the matrix
+ * @return the matrix with b's attributes
+ */
+Matrix& Matrix::operator=(Matrix &&b) noexcept
+{
+    std::swap(this->_rows, b._rows);
+    std::swap(this->_cols, b._cols);
+    std::swap(this->_pitch, b._pitch);
+    std::swap(this->_data, b._data);
     return *this;
 }
 
@@ -195,7 +442,7 @@ float &Matrix::operator()(int i, int j)
         std::cerr << INDEX_ERR_MSG;
         exit(1);
     }
-    return this->_data[i*_cols + j];
+    return this->_data[(size_t) i * _pitch + j];
 }
 
 /**
@@ -211,7 +458,7 @@ float Matrix::operator()(int i, int j) const
         std::cerr << INDEX_ERR_MSG;
         exit(1);
     }
-    return this->_data[i*_cols + j];
+    return this->_data[(size_t) i * _pitch + j];
 }
 
 
@@ -227,7 +474,7 @@ float &Matrix::operator[](int i)
         std::cerr << INDEX_ERR_MSG;
         exit(1);
     }
-    return this->_data[i];
+    return this->_data[_offset(i)];
 }
 
 /**
@@ -242,7 +489,7 @@ float Matrix::operator[](int i) const
             std::cerr << INDEX_ERR_MSG;
             exit(1);
         }
-        return this->_data[i];
+        return this->_data[_offset(i)];
     }
 
 /**
@@ -257,54 +504,16 @@ Matrix operator*(const Matrix &matrix, const Matrix &other )
         std::cerr << DIMENSIONS_ERR_MSG ; // VERIFY
         exit(1);
     }
-    Matrix newMatrix(matrix.getRows(), other.getCols());
-    for (int i = 0; i < matrix.getRows(); ++ i)
-    {
-        for (int j = 0; j < other.getCols(); ++ j)
-        {
-            float value = 0;
-            for (int k = 0; k < matrix.getCols(); ++ k)
-            {
-                value += (matrix)(i, k) * other(k, j);
-            }
-            newMatrix(i, j) = value;
-        }
-    }
+    Matrix newMatrix(matrix.getRows(), other.getCols(), Matrix::NO_INIT);
+    TRACE_COUNT("gemm", 0, (long long) matrix._rows * matrix._cols +
+                (long long) other._rows * other._cols + (long long) matrix._rows * other._cols,
+                2LL * matrix._rows * other._cols * matrix._cols);
+    gemm(matrix._rows, other._cols, matrix._cols, matrix._data, matrix._pitch, other._data,
+         other._pitch, newMatrix._data, newMatrix._pitch);
     return newMatrix;
 }
 
 
-/**
- * multiplies a matrix by a scalar
- * @param c a scalar to multiply by
- * @return a new matrix that is the result of the multiplication
- */
-Matrix operator*(Matrix &matrix, float c)
-{
-    Matrix newMatrix(matrix);
-    for (int i = 0; i < matrix.getRows() * matrix.getCols(); ++ i)
-    {
-        newMatrix._data[i] *= c;
-    }
-    return newMatrix;
-}
-
-/**
- * multiplies a matrix by a scalar
- * @param c a scalar to multiply bu
- * @param matrix the matrix to multiple
- * @return a new matrix that is the multiplication result
- */
-Matrix operator*(float c, Matrix &matrix)
-{
-    Matrix newMatrix(matrix);
-    for (int i = 0; i < matrix.getCols() * matrix.getRows(); ++ i)
-    {
-        newMatrix[i] *= c;
-    }
-    return newMatrix;
-}
-
 /**
  * multiplies a matrix by a scalar
  * @param c a scalar to multiply by
@@ -312,10 +521,8 @@ Matrix operator*(float c, Matrix &matrix)
  */
 Matrix& Matrix::operator*=(float c)
 {
-    for (int i = 0; i < _rows*_cols; ++ i)
-    {
-        _data[i] *= c;
-    }
+    TRACE_COUNT("mul_scalar", 0, 2LL * _rows * _cols, (long long) _rows * _cols);
+    parallelScalarOp(kernels::mulScalar, _data, _pitch, c, _rows, _cols);
     return *this;
 }
 
@@ -331,43 +538,17 @@ Matrix& Matrix::operator*=(Matrix &otherMat)
         std::cerr << DIMENSIONS_ERR_MSG ; // VERIFY
         exit(1);
     }
-    Matrix newMatrix(*this);
-    this->_cols = otherMat.getCols();
-    for (int i = 0; i < this->_rows; ++ i)
-    {
-        for (int j = 0; j < otherMat.getCols(); ++ j)
-        {
-            float value = 0;
-            for (int k = 0; k < newMatrix.getCols(); ++ k)
-            {
-                value += newMatrix(i, k) * otherMat(k, j);
-            }
-            (*this)(i, j) = value;
-        }
-    }
+    Matrix newMatrix(this->_rows, otherMat._cols, NO_INIT);
+    TRACE_COUNT("gemm", 0, (long long) _rows * _cols + (long long) otherMat._rows * otherMat._cols +
+                (long long) _rows * otherMat._cols, 2LL * _rows * otherMat._cols * _cols);
+    gemm(this->_rows, otherMat._cols, this->_cols, this->_data, this->_pitch, otherMat._data,
+         otherMat._pitch, newMatrix._data, newMatrix._pitch);
+    std::swap(this->_data, newMatrix._data);
+    this->_cols = otherMat._cols;
+    this->_pitch = newMatrix._pitch;
     return *this;
 }
 
-/**
- * divides a matrix by a scalar
- * @param c a scalar to divide by
- * @return a new matrix that is the result of the division
- */
-Matrix operator/(Matrix &matrix, float c)
-{
-    if (c == 0)
-    {
-        std::cerr << DIVISION_ERR_MSG ; // VERIFY
-        exit(1);
-    }
-    Matrix newMatrix(matrix);
-    for (int i = 0; i < matrix.getRows() * matrix.getCols(); ++ i)
-    {
-        newMatrix[i] /= c;
-    }
-    return newMatrix;
-}
-
 /**
  * divides a matrix by a scalar
  * @param c a scalar to divide by
@@ -380,34 +561,12 @@ Matrix& Matrix::operator/=(float c)
         std::cerr << DIVISION_ERR_MSG ;
         exit(1);
     }
-    for (int i = 0; i < _rows*_cols; ++ i)
-    {
-        this->_data[i] /= c;
-    }
+    TRACE_COUNT("div_scalar", 0, 2LL * _rows * _cols, (long long) _rows * _cols);
+    parallelScalarOp(kernels::divScalar, this->_data, _pitch, c, _rows, _cols);
     return *this;
 }
 
 
-/**
- * sums two matrices
- * @param B the matrix to add
- * @return a new matrix that is the result of the addition
- */
-Matrix operator+(const Matrix &matrix, const Matrix &other)
-{
-    if (matrix.getRows() != other.getRows() || matrix.getCols() != other.getCols())
-    {
-        std::cerr << DIMENSIONS_ERR_MSG ;
-        exit(1);
-    }
-    Matrix newMatrix(matrix.getRows(), matrix.getCols());
-    for (int i = 0; i < matrix.getRows() * other.getCols(); ++ i)
-    {
-        newMatrix[i] = matrix[i] + other[i];
-    }
-    return newMatrix;
-}
-
 /**
  * sums two matrices
  * @param other the matrix to add
@@ -420,10 +579,8 @@ Matrix& Matrix::operator+=(Matrix &other)
         std::cerr << DIMENSIONS_ERR_MSG; // VERIFY
         exit(1);
     }
-    for (int i = 0; i < this->_rows * this->_cols; ++ i)
-    {
-        this->_data[i] += other._data[i];
-    }
+    TRACE_COUNT("add", 0, 3LL * _rows * _cols, (long long) _rows * _cols);
+    parallelAdd(this->_data, _pitch, other._data, other._pitch, _rows, _cols);
     return *this;
 }
 
@@ -434,26 +591,116 @@ Matrix& Matrix::operator+=(Matrix &other)
  */
 Matrix& Matrix::operator+=(float c)
 {
-    for (int i = 0; i < _rows*_cols; ++ i)
-    {
-        this->_data[i] += c;
-    }
+    TRACE_COUNT("add_scalar", 0, 2LL * _rows * _cols, (long long) _rows * _cols);
+    parallelScalarOp(kernels::addScalar, this->_data, _pitch, c, _rows, _cols);
     return *this;
 }
 
 /**
- * writes the matrix's data into an output stream
- * @param ostream the stream to pass the output to
- * @param matrix the matrix to pass to the stream
- * @return the output stream
+ * parses floats from a seekable stream in bulk: the stream is read in chunks which are parsed by
+ * std::from_chars, and then positioned right after the last float parsed. The parser stops at any
+ * token from_chars does not take whole, such as one with a leading '+', a float out of range or
+ * a float followed by other characters, and leaves it to operator>>.
+ * @tparam Element a callable (i) which returns a reference to the i-th element to parse into
+ * @param istream the stream, in the classic locale
+ * @param n the number of floats to parse
+ * @param element the elements to parse into
+ * @return the number of floats parsed, the first n - return value of which are set
+ */
+template<class Element>
+static long parseFloats(std::istream &istream, long n, Element element)
+{
+    std::streampos base = istream.tellg();
+    if (base == std::streampos(- 1))
+    {
+        return 0;
+    }
+    std::vector<char> buffer(TEXT_CHUNK_BYTES);
+    long i = 0;
+    while (i < n)
+    {
+        istream.read(buffer.data(), TEXT_CHUNK_BYTES);
+        std::streamsize got = istream.gcount();
+        bool last = got < TEXT_CHUNK_BYTES;
+        istream.clear();
+        const char *p = buffer.data();
+        const char *end = p + got;
+        const char *consumed = p;
+        bool stopped = false;
+        while (i < n)
+        {
+            while (p < end && isspace((unsigned char) *p))
+            {
+                ++ p;
+            }
+            if (p == end)
+            {
+                consumed = p;
+                break;
+            }
+            const char *token = p;
+            while (p < end && !isspace((unsigned char) *p))
+            {
+                ++ p;
+            }
+            // a token which reaches the end of a chunk may go on in the next one
+            if (p == end && !last)
+            {
+                stopped = consumed == buffer.data();
+                break;
+            }
+            float value;
+            std::from_chars_result result = std::from_chars(token, p, value);
+            if (result.ec != std::errc() || result.ptr != p)
+            {
+                stopped = true;
+                break;
+            }
+            element(i) = value;
+            ++ i;
+            consumed = p;
+        }
+        base += (std::streamoff) (consumed - buffer.data());
+        istream.seekg(base);
+        if (i == n && consumed == end && last)
+        {
+            // operator>> would have run into the end of the stream after the last float
+            istream.setstate(std::ios::eofbit);
+        }
+        if (stopped || last)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * reads a matrix from an input stream. Streams which can be positioned, such as files and string
+ * streams, are parsed in bulk by from_chars, others float by float by operator>>, with the same
+ * result.
+ * @param istream the stream from which receive the data
+ * @param matrix the matrix to write the data into
+ * @return the input stream
  */
 std::istream& operator>>(std::istream &istream, Matrix& matrix)
 {
+    TRACE_SPAN("stream_read");
     if (istream)
     {
-        for (int i = 0; i < matrix.getRows() * matrix.getCols(); ++ i)
+        long total = (long) matrix.getRows() * matrix.getCols();
+        TRACE_COUNT("stream_read", 0, total, 0);
+        long i = 0;
+        if (istream.getloc() == std::locale::classic())
+        {
+            i = parseFloats(istream, total, [&](long k) -> float &
+            {
+                return matrix.rowData((int) (k / matrix.getCols()))[k % matrix.getCols()];
+            });
+        }
+        for (; i < total; ++ i)
         {
-            istream >> matrix[i];
+            istream >> matrix.rowData((int) (i / matrix.getCols()))[i % matrix.getCols()];
         }
     }
     else
@@ -466,28 +713,90 @@ std::istream& operator>>(std::istream &istream, Matrix& matrix)
 }
 
 /**
- * writes into a matrix from a given input stream
- * @param istream the stream from which receive the data
- * @param matrix the matrix to write the data into
- * @return the input stream
+ * finds the to_chars format which writes floats as a stream would
+ * @param ostream the stream
+ * @param format set to the format of the stream
+ * @return false if to_chars has no such format, for streams with a locale other than the classic
+ * one, a width, flags such as showpos, or hexadecimal floats
+ */
+static bool textFormat(std::ostream &ostream, std::chars_format &format)
+{
+    std::ios::fmtflags flags = ostream.flags();
+    std::ios::fmtflags field = flags & std::ios::floatfield;
+    if (ostream.getloc() != std::locale::classic() || ostream.width() != 0 ||
+        (flags & (std::ios::showpos | std::ios::showpoint | std::ios::uppercase)) ||
+        ostream.precision() < 0 || ostream.precision() > MAX_TEXT_PRECISION)
+    {
+        return false;
+    }
+    if (field == std::ios::fixed)
+    {
+        format = std::chars_format::fixed;
+        return true;
+    }
+    if (field == std::ios::scientific)
+    {
+        format = std::chars_format::scientific;
+        return true;
+    }
+    format = std::chars_format::general;
+    return field == std::ios::fmtflags(0);
+}
+
+/**
+ * writes the matrix's data into an output stream, a line per row with its elements separated by
+ * spaces. The rows are formatted by to_chars, in the format and the precision of the stream, and
+ * written whole.
+ * @param ostream the stream to pass the output to
+ * @param matrix the matrix to pass to the stream
+ * @return the output stream
  */
 std::ostream& operator<<(std::ostream &ostream, const Matrix& matrix)
 {
-    for (int i = 0; i < matrix.getRows() * matrix.getCols(); ++ i)
+    TRACE_SPAN("stream_write");
+    TRACE_COUNT("stream_write", 0, (long long) matrix.getRows() * matrix.getCols(), 0);
+    std::chars_format format;
+    if (!textFormat(ostream, format))
     {
-        if (i == matrix.getCols() * matrix.getRows() - 1)
+        for (int i = 0; i < matrix.getRows() * matrix.getCols(); ++ i)
         {
-            ostream << matrix[i];
-            return ostream;
+            if (i == matrix.getCols() * matrix.getRows() - 1)
+            {
+                ostream << matrix[i];
+                return ostream;
+            }
+            if (i % matrix.getCols() == matrix.getCols() - 1)
+            {
+                ostream << matrix[i] << std::endl;
+            }
+            else
+            {
+                ostream << matrix[i] << " ";
+            }
         }
-        if (i % matrix.getCols() == matrix.getCols() - 1)
+        return ostream;
+    }
+    int precision = (int) ostream.precision();
+    std::string line;
+    line.reserve((size_t) matrix.getCols() * FLOAT_TEXT_CHARS);
+    char text[FLOAT_TEXT_CHARS];
+    for (int r = 0; r < matrix.getRows(); ++ r)
+    {
+        line.clear();
+        const float *row = matrix.rowData(r);
+        for (int c = 0; c < matrix.getCols(); ++ c)
         {
-            ostream << matrix[i] << std::endl;
+            std::to_chars_result result = std::to_chars(text, text + FLOAT_TEXT_CHARS, row[c],
+                                                        format, precision);
+            line.append(text, result.ptr);
+            line += (c == matrix.getCols() - 1) ? '\n' : ' ';
         }
-        else
+        // no line break after the last row, and nothing at all for a row of no columns
+        if (r == matrix.getRows() - 1 && !line.empty())
         {
-            ostream << matrix[i] << " ";
+            line.pop_back();
         }
+        ostream.write(line.data(), (std::streamsize) line.size());
     }
-return ostream;
+    return ostream;
 }
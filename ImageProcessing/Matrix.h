@@ -1,208 +1,513 @@
-#ifndef EX5_MATRIX_H
-#define EX5_MATRIX_H
-
-#include <ostream>
-#include <istream>
-#include <iostream>
-
-/**
- * represents a single matrix with its dimensions and data
- */
-class Matrix
-{
-private:
-    int _rows;
-    int _cols;
-    float *_data;
-
-public:
-    /**
-     * constructs a new matrix
-     * @param rows the rows number of the matrix
-     * @param cols the columns number of the matrix
-     */
-    Matrix(int rows, int cols);
-
-
-    /**
-     * default constructor
-     */
-    Matrix();
-
-    /**
-     * constructs a new matrix using an existing one
-     * @param m the matrix to copy
-     */
-    Matrix(Matrix const &m);
-
-    /**
-     * destructor
-     */
-    ~Matrix();
-
-    /**
-     *
-     * @return matrix's number of rows
-     */
-    int getRows() const;
-
-    /**
-     *
-     * @return matrix's columns number
-     */
-    int getCols() const;
-
-    /**
-     * transforms the matrix into a vector by changing it's dimensions
-     * @return a vectorized version of the matrix
-     */
-    Matrix& vectorize();
-
-    /**
-     * prints matrix's elements
-     */
-    void print() const;
-
-    /**
-     * compares two matrices
-     * @param other the matrix to compare to
-     * @return true if matrix's have same number of rows, columns and same data array, false
-     * otherwise
-     */
-    bool operator==(const Matrix &other) const;
-
-    /**
-     * compares two matrices
-     * @param other the matrix to compare to
-     * @return true if matrix's are not equal as determined in the == operator
-     */
-    bool operator!=(const Matrix &other) const;
-
-    /**
-     * gives the matrix the attributes of other matrix
-     * @param b gives the matrix the attributes of 'b'
-     * @return the matrix with b's attributes
-     */
-    Matrix &operator=(const Matrix&b);
-
-    /**
-     * accesses to index in the data array
-     * @param i rows index
-     * @param j columns index
-     * @return the element in the [i][j] index in the data array of the matrix
-     */
-     float &operator()(int i, int j);
-
-    /**
-     * accesses to index in the data array
-     * @param i rows index
-     * @param j columns index
-     * @return the element in the [i][j] index in the data array of the matrix
-     */
-    float operator()(int i, int j) const;
-
-    /**
-     * accesses to index in the data array
-     * @param i the wanted index
-     * @return the i'th element in the data array
-     */
-    float &operator[](int i);
-
-    /**
-     * accesses to index in the data array
-     * @param i the wanted index
-     * @return the i'th element in the data array
-     */
-    float operator[](int i) const;
-
-    /**
-     * multiplies two matrices
-     * @param other the matrix to multiply by
-     * @return a new matrix that is the result of the multiplication
-     */
-    friend Matrix operator*(const Matrix &matrix, const Matrix &other) ;
-
-    /**
-     * multiplies a matrix by a scalar
-     * @param c a scalar to multiply by
-     * @return a new matrix that is the result of the multiplication
-     */
-    friend Matrix operator*(Matrix &matrix, float c);
-
-    /**
-     * multiplies a matrix by a scalar
-     * @param c a scalar to multiply bu
-     * @param matrix the matrix to multiple
-     * @return a new matrix that is the multiplication result
-     */
-    friend Matrix operator*(float c, Matrix &matrix);
-
-    /**
-     * multiplies a matrix by a scalar
-     * @param c a scalar to multiply by
-     * @return the original matrix after multiplication
-     */
-    Matrix &operator*=(float c);
-
-    /**
-     * multiplies two matrices
-     * @param otherMat the matrix to multiply by
-     * @return the original matrix after multiplication
-     */
-    Matrix &operator*=(Matrix &otherMat);
-
-    /**
-     * divides a matrix by a scalar
-     * @param c a scalar to divide by
-     * @return a new matrix that is the result of the division
-     */
-    friend Matrix operator/(Matrix &matrix, float c);
-
-    /**
-     * divides a matrix by a scalar
-     * @param c a scalar to divide by
-     * @return the original matrix divided by c
-     */
-    Matrix &operator/=(float c);
-
-    /**
-     * sums two matrices
-     * @param B the matrix to add
-     * @return a new matrix that is the result of the addition
-     */
-    friend Matrix operator+(const Matrix &matrix, const Matrix &other);
-
-
-    /**
-     * sums two matrices
-     * @param other the matrix to add
-     * @return the original matrix after the addition
-     */
-    Matrix &operator+=(Matrix &other);
-
-    /**
-     * sums a matrix and a scalar
-     * @param c the scalar to add to the matrix
-     * @return the original matrix after the addition
-     */
-    Matrix &operator+=(float c);
-
-    /**
-     * writes the matrix's data into an output stream
-     * @param ostream the stream to pass the output to
-     * @param matrix the matrix to pass to the stream
-     * @return the output stream
-     */
-    friend std::ostream& operator<<(std::ostream &ostream, const Matrix& matrix);
-
-    /**
-     * writes into a matrix from a given input stream
-     * @param istream the stream from which receive the data
-     * @param matrix the matrix to write the data into
-     * @return the input stream
-     */
-    friend std::istream& operator>>(std::istream &istream, Matrix& matrix);
-};
-
-
-#endif //EX5_MATRIX_H
+#ifndef EX5_MATRIX_H
+#define EX5_MATRIX_H
+
+#include <ostream>
+#include <istream>
+#include <iostream>
+#include <vector>
+#include "MatrixExpr.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+/**
+ * represents a single matrix with its dimensions and data. The rows are stored one after the other
+ * in a 64 byte aligned buffer, pitch() elements apart, which is the number of columns unless the
+ * matrix was constructed with padded rows.
+ */
+class Matrix : public MatrixExpr<Matrix>
+{
+private:
+    int _rows;
+    int _cols;
+    int _pitch;
+    float *_data;
+
+    /**
+     * evaluates an expression of the same dimensions into the matrix, in parallel row blocks
+     * @param expr the expression to evaluate
+     */
+    template<class E>
+    void _assign(const E &expr);
+
+    /**
+     * allocates a data buffer and counts the allocation
+     * @param size the number of elements in the buffer
+     * @return the new buffer
+     */
+    static float *_allocate(size_t size);
+
+    /**
+     * gives a data buffer back to the buffer pool
+     * @param data the buffer, or nullptr
+     */
+    static void _release(float *data);
+
+    /**
+     * makes sure the data buffer holds at least size elements, reusing the current one if it is
+     * large enough. The elements are left unspecified.
+     * @param size the number of elements needed
+     */
+    void _reserve(size_t size);
+
+    /**
+     * @param i an index of the data array, as if the rows had no padding
+     * @return the position of the element in the buffer
+     */
+    size_t _offset(int i) const
+    {
+        return (_pitch == _cols) ? (size_t) i : (size_t) (i / _cols) * _pitch + i % _cols;
+    }
+
+public:
+    static constexpr bool IS_LEAF = true;
+    static constexpr int SCRATCH_ROWS = 0;
+
+    /**
+     * whether a constructor sets the elements of a new matrix
+     */
+    enum Initialization
+    {
+        // every element is 0
+        ZERO_INIT,
+        // the elements are left unspecified, for a matrix which is about to be overwritten
+        NO_INIT
+    };
+
+    /**
+     * constructs a new matrix
+     * @param rows the rows number of the matrix
+     * @param cols the columns number of the matrix
+     */
+    Matrix(int rows, int cols);
+
+    /**
+     * constructs a new matrix
+     * @param rows the rows number of the matrix
+     * @param cols the columns number of the matrix
+     * @param init whether to set the elements to 0
+     * @param pitch the distance in elements between the starts of two rows, at least cols. 0
+     * stores the rows with no padding, paddedPitch(cols) gives aligned rows.
+     */
+    Matrix(int rows, int cols, Initialization init, int pitch = 0);
+
+
+    /**
+     * default constructor
+     */
+    Matrix();
+
+    /**
+     * constructs a new matrix using an existing one
+     * @param m the matrix to copy
+     */
+    Matrix(Matrix const &m);
+
+    /**
+     * constructs a new matrix by taking the data of an existing one
+     * @param m the matrix to move, left as a 0 x 0 matrix
+     */
+    Matrix(Matrix &&m) noexcept;
+
+    /**
+     * constructs a new matrix by evaluating an elementwise expression
+     * @param expr the expression to evaluate
+     */
+    template<class E>
+    Matrix(const MatrixExpr<E> &expr);
+
+    /**
+     * destructor
+     */
+    ~Matrix();
+
+    /**
+     *
+     * @return matrix's number of rows
+     */
+    int getRows() const;
+
+    /**
+     *
+     * @return matrix's columns number
+     */
+    int getCols() const;
+
+    /**
+     * @return the distance in elements between the starts of two rows
+     */
+    int pitch() const
+    {
+        return _pitch;
+    }
+
+    /**
+     * a row pitch for matrices of the given width: rows start on a cache line, and are not a
+     * multiple of a large power of two apart, which would map them to the same cache sets
+     * @param cols the columns number of the matrix
+     * @return the pitch
+     */
+    static int paddedPitch(int cols);
+
+    /**
+     * transforms the matrix into a vector by changing it's dimensions
+     * @return a vectorized version of the matrix
+     */
+    Matrix& vectorize();
+
+    /**
+     * prints matrix's elements
+     */
+    void print() const;
+
+    /**
+     * compares two matrices
+     * @param other the matrix to compare to
+     * @return true if matrix's have same number of rows, columns and same data array, false
+     * otherwise
+     */
+    bool operator==(const Matrix &other) const;
+
+    /**
+     * compares two matrices
+     * @param other the matrix to compare to
+     * @return true if matrix's are not equal as determined in the == operator
+     */
+    bool operator!=(const Matrix &other) const;
+
+    /**
+     * gives the matrix the attributes of other matrix
+     * @param b gives the matrix the attributes of 'b'
+     * @return the matrix with b's attributes
+     */
+    Matrix &operator=(const Matrix&b);
+
+    /**
+     * gives the matrix the data of other matrix
+     * @param b the matrix to move, left with the previous data of the matrix
+     * @return the matrix with b's attributes
+     */
+    Matrix &operator=(Matrix &&b) noexcept;
+
+    /**
+     * @return the number of data buffers allocated by all matrices since the last reset
+     */
+    static long allocationCount();
+
+    /**
+     * resets the count of allocated data buffers
+     */
+    static void resetAllocationCount();
+
+    /**
+     * evaluates an elementwise expression into the matrix, in a single pass
+     * @param expr the expression to evaluate
+     * @return the matrix holding the result
+     */
+    template<class E>
+    Matrix &operator=(const MatrixExpr<E> &expr);
+
+    /**
+     * @return the address of the data array, row after row, pitch() elements apart
+     */
+    float *data()
+    {
+        return _data;
+    }
+
+    /**
+     * @return the address of the data array, row after row, pitch() elements apart
+     */
+    const float *data() const
+    {
+        return _data;
+    }
+
+    /**
+     * @param r the row index
+     * @return the address of the first element of row r
+     */
+    float *rowData(int r)
+    {
+        return _data + (size_t) r * _pitch;
+    }
+
+    /**
+     * the address of a row, used when the matrix is an operand of an expression
+     * @param r the row index
+     * @return the address of the first element of row r
+     */
+    const float *rowData(int r) const
+    {
+        return _data + (size_t) r * _pitch;
+    }
+
+    /**
+     * copies a row, used when the matrix is evaluated as an expression
+     * @param r the row index
+     * @param out the row to copy into
+     */
+    void evalRow(int r, float *out, float *) const
+    {
+        kernels::copy(out, rowData(r), (size_t) _cols);
+    }
+
+    /**
+     * @param data the first element of a matrix an expression of this one is evaluated into
+     * @param rows the rows number of that matrix
+     * @param cols the columns number of that matrix
+     * @param pitch the row pitch of that matrix
+     * @return true if the elements of this matrix share memory with that one at other positions
+     */
+    bool overlaps(const float *data, int rows, int cols, int pitch) const
+    {
+        if (data == _data && rows == _rows && cols == _cols && pitch == _pitch)
+        {
+            return false;
+        }
+        return memoryOverlaps(_data, _data + (size_t) _rows * _pitch, data,
+                              data + (size_t) rows * pitch);
+    }
+
+    /**
+     * accesses to index in the data array
+     * @param i rows index
+     * @param j columns index
+     * @return the element in the [i][j] index in the data array of the matrix
+     */
+     float &operator()(int i, int j);
+
+    /**
+     * accesses to index in the data array
+     * @param i rows index
+     * @param j columns index
+     * @return the element in the [i][j] index in the data array of the matrix
+     */
+    float operator()(int i, int j) const;
+
+    /**
+     * accesses to index in the data array
+     * @param i the wanted index
+     * @return the i'th element in the data array
+     */
+    float &operator[](int i);
+
+    /**
+     * accesses to index in the data array
+     * @param i the wanted index
+     * @return the i'th element in the data array
+     */
+    float operator[](int i) const;
+
+    /**
+     * multiplies two matrices
+     * @param other the matrix to multiply by
+     * @return a new matrix that is the result of the multiplication
+     */
+    friend Matrix operator*(const Matrix &matrix, const Matrix &other) ;
+
+    /**
+     * multiplies a matrix by a scalar
+     * @param c a scalar to multiply by
+     * @return the original matrix after multiplication
+     */
+    Matrix &operator*=(float c);
+
+    /**
+     * multiplies two matrices
+     * @param otherMat the matrix to multiply by
+     * @return the original matrix after multiplication
+     */
+    Matrix &operator*=(Matrix &otherMat);
+
+    /**
+     * divides a matrix by a scalar
+     * @param c a scalar to divide by
+     * @return the original matrix divided by c
+     */
+    Matrix &operator/=(float c);
+
+    /**
+     * sums two matrices
+     * @param other the matrix to add
+     * @return the original matrix after the addition
+     */
+    Matrix &operator+=(Matrix &other);
+
+    /**
+     * adds an elementwise expression to the matrix, in a single pass
+     * @param expr the expression to add
+     * @return the original matrix after the addition
+     */
+    template<class E>
+    Matrix &operator+=(const MatrixExpr<E> &expr);
+
+    /**
+     * sums a matrix and a scalar
+     * @param c the scalar to add to the matrix
+     * @return the original matrix after the addition
+     */
+    Matrix &operator+=(float c);
+
+    /**
+     * writes the matrix's data into an output stream, a line per row with its elements separated
+     * by spaces, in the float format of the stream
+     * @param ostream the stream to pass the output to
+     * @param matrix the matrix to pass to the stream
+     * @return the output stream
+     */
+    friend std::ostream& operator<<(std::ostream &ostream, const Matrix& matrix);
+
+    /**
+     * writes into a matrix from a given input stream, parsed in bulk when the stream can be
+     * positioned
+     * @param istream the stream from which receive the data
+     * @param matrix the matrix to write the data into
+     * @return the input stream
+     */
+    friend std::istream& operator>>(std::istream &istream, Matrix& matrix);
+};
+
+/**
+ * evaluates an expression of the same dimensions into the matrix, in parallel row blocks
+ * @param expr the expression to evaluate
+ */
+template<class E>
+void Matrix::_assign(const E &expr)
+{
+    traceExpr(expr, (long long) _rows * _cols);
+    float *data = _data;
+    int cols = _cols;
+    int pitch = _pitch;
+    parallelRows(_rows, _cols, [&expr, data, cols, pitch](int lo, int hi)
+    {
+        std::vector<float> scratch((size_t) E::SCRATCH_ROWS * cols);
+        for (int r = lo; r < hi; ++ r)
+        {
+            expr.evalRow(r, data + (size_t) r * pitch, scratch.data());
+        }
+    });
+}
+
+/**
+ * constructs a new matrix by evaluating an elementwise expression
+ * @param expr the expression to evaluate
+ */
+template<class E>
+Matrix::Matrix(const MatrixExpr<E> &expr)
+{
+    _rows = expr.self().getRows();
+    _cols = expr.self().getCols();
+    _pitch = _cols;
+    _data = _allocate((size_t) _rows * _cols);
+    _assign(expr.self());
+}
+
+/**
+ * evaluates an elementwise expression into the matrix, in a single pass. An expression reading
+ * the matrix other than at the positions it writes, as a transposed view of it does, is evaluated
+ * into a new buffer which then replaces that of the matrix.
+ * @param expr the expression to evaluate
+ * @return the matrix holding the result
+ */
+template<class E>
+Matrix &Matrix::operator=(const MatrixExpr<E> &expr)
+{
+    const E &e = expr.self();
+    if (e.overlaps(_data, _rows, _cols, _pitch))
+    {
+        // a view reading the matrix in another order, or from a buffer the matrix may free
+        return *this = Matrix(e);
+    }
+    if (e.getRows() != _rows || e.getCols() != _cols)
+    {
+        _reserve((size_t) e.getRows() * e.getCols());
+        _rows = e.getRows();
+        _cols = e.getCols();
+        _pitch = _cols;
+    }
+    _assign(e);
+    return *this;
+}
+
+/**
+ * adds an elementwise expression to the matrix, in a single pass
+ * @param expr the expression to add
+ * @return the original matrix after the addition
+ */
+template<class E>
+Matrix &Matrix::operator+=(const MatrixExpr<E> &expr)
+{
+    if (expr.self().overlaps(_data, _rows, _cols, _pitch))
+    {
+        return *this = Matrix(MatrixSum<Matrix, E>(*this, expr.self()));
+    }
+    _assign(MatrixSum<Matrix, E>(*this, expr.self()));
+    return *this;
+}
+
+/**
+ * returns a matrix holding the value of an expression
+ * @param expr the expression
+ * @param storage where the expression is evaluated if it is not a matrix
+ * @return the matrix holding the value
+ */
+template<class E>
+const Matrix &materialize(const MatrixExpr<E> &expr, Matrix &storage)
+{
+    storage = expr.self();
+    return storage;
+}
+
+/**
+ * returns a matrix holding the value of an expression
+ * @param expr a matrix
+ * @return expr itself
+ */
+inline const Matrix &materialize(const Matrix &expr, Matrix &)
+{
+    return expr;
+}
+
+/**
+ * multiplies two matrix expressions. Unlike the elementwise operators a product is not lazy:
+ * each operand which is not already a matrix is evaluated first.
+ * @param lhs the lhs to multiply
+ * @param rhs the rhs to multiply
+ * @return a new matrix that is the result of the multiplication
+ */
+template<class L, class R>
+Matrix operator*(const MatrixExpr<L> &lhs, const MatrixExpr<R> &rhs)
+{
+    Matrix lhsStorage;
+    Matrix rhsStorage;
+    return materialize(lhs.self(), lhsStorage) * materialize(rhs.self(), rhsStorage);
+}
+
+/**
+ * multiplies a matrix expression by a matrix, see the product of two expressions
+ * @param lhs the lhs to multiply
+ * @param rhs the rhs to multiply
+ * @return a new matrix that is the result of the multiplication
+ */
+template<class L>
+Matrix operator*(const MatrixExpr<L> &lhs, const Matrix &rhs)
+{
+    Matrix lhsStorage;
+    return materialize(lhs.self(), lhsStorage) * rhs;
+}
+
+/**
+ * multiplies a matrix by a matrix expression, see the product of two expressions
+ * @param lhs the lhs to multiply
+ * @param rhs the rhs to multiply
+ * @return a new matrix that is the result of the multiplication
+ */
+template<class R>
+Matrix operator*(const Matrix &lhs, const MatrixExpr<R> &rhs)
+{
+    Matrix rhsStorage;
+    return lhs * materialize(rhs.self(), rhsStorage);
+}
+
+
+#endif //EX5_MATRIX_H
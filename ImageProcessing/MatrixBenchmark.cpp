@@ -0,0 +1,1432 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include "Matrix.h"
+#include "Kernels.h"
+#include "Filters.h"
+#include "ThreadPool.h"
+#include "BufferPool.h"
+#include "Convolution.h"
+#include "Fft.h"
+#include "ShadeTable.h"
+#include "MatrixIO.h"
+#include "ImageIO.h"
+
+#define MIN_GEMM_SIZE 64
+#define MAX_GEMM_SIZE 4096
+#define REPETITIONS 5
+#define MAX_NAIVE_SIZE 512
+#define ELEMENTWISE_SIZE 2048
+#define SCALING_GEMM_SIZE 1024
+#define SCALING_IMAGE_SIZE 4096
+#define HELPERS_DIR "helpers/"
+#define HELPER_IMAGE_SIZE 128
+// the most data buffers a filter may allocate per call: its kernels and its result
+#define BLUR_ALLOCATIONS 2
+#define SOBEL_ALLOCATIONS 4
+#define QUANTIZATION_ALLOCATIONS 1
+#define BYTE_IMAGE_SIZE 2048
+#define CONVOLUTION_IMAGE_SIZE 1024
+// the bundled images are scaled up to 8K UHD for the stencil benchmark
+#define STENCIL_IMAGE_ROWS 4320
+#define STENCIL_IMAGE_COLS 7680
+// the streamed image is ten 8K images tall, 1.3GB as a Matrix
+#define STREAM_IMAGE_ROWS 43200
+#define IO_MATRIX_SIZE 2048
+#define IO_TEXT_FILE "matrix_io_benchmark.txt"
+#define IO_BINARY_FILE "matrix_io_benchmark.bin"
+#define PGM_FILE "image_benchmark.pgm"
+#define TEXT_OUTPUT_FILE "image_benchmark_blurred.out"
+#define PGM_OUTPUT_FILE "image_benchmark_blurred.pgm"
+// the suite runs on the bundled images and on synthetic ones of every power of two in between
+#define SUITE_MIN_SIZE 128
+#define SUITE_MAX_SIZE 16384
+#define SUITE_WARMUPS 2
+#define SUITE_MIN_REPETITIONS 3
+#define SUITE_MAX_REPETITIONS 25
+// a case is repeated for about this long, by the time of its warmups, so fast cases repeat more
+#define SUITE_CASE_SECONDS 1.0
+// the product is cubic and the text of a 16K matrix is gigabytes, so they stop earlier
+#define SUITE_GEMM_MAX_SIZE 4096
+#define SUITE_TEXT_MAX_SIZE 4096
+#define BOX_IMAGE_SIZE 2048
+// the radius of the box filter of the suite, a 17 x 17 box
+#define SUITE_BOX_RADIUS 8
+
+
+/**
+ * fills a matrix with random values in [-1, 1]
+ * @param matrix the matrix to fill
+ * @param gen the random generator to use
+ */
+static void fillRandom(Matrix &matrix, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> dist(- 1.f, 1.f);
+    for (int i = 0; i < matrix.getRows() * matrix.getCols(); ++ i)
+    {
+        matrix[i] = dist(gen);
+    }
+}
+
+/**
+ * runs a function several times and measures it
+ * @tparam Function a callable without arguments
+ * @param fn the function to measure
+ * @param repetitions how many times to run fn after a warmup run
+ * @return the median run time in seconds
+ */
+template<typename Function>
+static double medianSeconds(Function fn, int repetitions)
+{
+    fn();
+    std::vector<double> times;
+    for (int r = 0; r < repetitions; ++ r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+/**
+ * the i-j-k product operator* used before the blocked kernel, kept as a reference
+ * @param a the lhs matrix
+ * @param b the rhs matrix
+ * @return the product
+ */
+static Matrix naiveProduct(const Matrix &a, const Matrix &b)
+{
+    Matrix result(a.getRows(), b.getCols());
+    for (int i = 0; i < a.getRows(); ++ i)
+    {
+        for (int j = 0; j < b.getCols(); ++ j)
+        {
+            float value = 0;
+            for (int k = 0; k < a.getCols(); ++ k)
+            {
+                value += a(i, k) * b(k, j);
+            }
+            result(i, j) = value;
+        }
+    }
+    return result;
+}
+
+/**
+ * measures operator* on square matrices and prints a CSV line per size with its GFLOP/s
+ */
+static void benchmarkGemm()
+{
+    std::mt19937 gen(42);
+    std::cout << "op,size,median_s,gflops,naive_gflops,matches_naive" << std::endl;
+    for (int n = MIN_GEMM_SIZE; n <= MAX_GEMM_SIZE; n *= 2)
+    {
+        Matrix a(n, n);
+        Matrix b(n, n);
+        fillRandom(a, gen);
+        fillRandom(b, gen);
+        Matrix c(n, n);
+        int repetitions = (n >= 2048) ? 1 : REPETITIONS;
+        double seconds = medianSeconds([&]()
+        {
+            c = a * b;
+        }, repetitions);
+        double flops = 2.0 * n * n * (double) n;
+        std::cout << "gemm," << n << "," << seconds << "," << flops / seconds * 1e-9 << ",";
+        if (n <= MAX_NAIVE_SIZE)
+        {
+            Matrix reference(n, n);
+            double naiveSeconds = medianSeconds([&]()
+            {
+                reference = naiveProduct(a, b);
+            }, 1);
+            std::cout << flops / naiveSeconds * 1e-9 << "," << (reference == c ? 1 : 0);
+        }
+        else
+        {
+            std::cout << "n/a,n/a";
+        }
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * prints a CSV line with the throughput of an elementwise operation
+ * @param op the name of the operation
+ * @param seconds the median run time
+ * @param bytes the bytes read and written by one run
+ */
+static void printThroughput(const char *op, double seconds, double bytes)
+{
+    std::cout << op << "," << kernels::name() << "," << seconds << "," << bytes / seconds * 1e-9
+              << std::endl;
+}
+
+/**
+ * measures the elementwise operators and copies of Matrix and prints their GB/s
+ */
+static void benchmarkElementwise()
+{
+    std::mt19937 gen(42);
+    int n = ELEMENTWISE_SIZE;
+    Matrix a(n, n);
+    Matrix b(n, n);
+    fillRandom(a, gen);
+    fillRandom(b, gen);
+    Matrix c(n, n);
+    double bytes = (double) n * n * sizeof(float);
+    std::cout << "op,kernels,median_s,gb_per_s" << std::endl;
+    printThroughput("add_assign", medianSeconds([&]()
+    {
+        a += b;
+    }, REPETITIONS), 3 * bytes);
+    printThroughput("add", medianSeconds([&]()
+    {
+        c = a + b;
+    }, REPETITIONS), 3 * bytes);
+    printThroughput("chain_fused", medianSeconds([&]()
+    {
+        c = a + b * 2.f + a / 3.f;
+    }, REPETITIONS), 3 * bytes);
+    printThroughput("add_scalar_assign", medianSeconds([&]()
+    {
+        a += 1.f;
+    }, REPETITIONS), 2 * bytes);
+    printThroughput("mul_scalar_assign", medianSeconds([&]()
+    {
+        a *= 0.5f;
+    }, REPETITIONS), 2 * bytes);
+    printThroughput("div_scalar_assign", medianSeconds([&]()
+    {
+        a /= 0.5f;
+    }, REPETITIONS), 2 * bytes);
+    printThroughput("equal", medianSeconds([&]()
+    {
+        c = a;
+        volatile bool eq = (c == a);
+        (void) eq;
+    }, REPETITIONS), 4 * bytes);
+    printThroughput("copy_construct", medianSeconds([&]()
+    {
+        Matrix copy(a);
+    }, REPETITIONS), 2 * bytes);
+    printThroughput("copy_assign", medianSeconds([&]()
+    {
+        c = a;
+    }, REPETITIONS), 2 * bytes);
+}
+
+/**
+ * measures the speedup of the product, an elementwise operator and convolution over 1, 2, 4...
+ * threads up to the hardware concurrency, and prints a CSV line per operation and thread count
+ */
+static void benchmarkScaling()
+{
+    std::mt19937 gen(42);
+    Matrix a(SCALING_GEMM_SIZE, SCALING_GEMM_SIZE);
+    Matrix b(SCALING_GEMM_SIZE, SCALING_GEMM_SIZE);
+    fillRandom(a, gen);
+    fillRandom(b, gen);
+    Matrix image(SCALING_IMAGE_SIZE, SCALING_IMAGE_SIZE);
+    fillRandom(image, gen);
+    Matrix other(image);
+    Matrix kernel(3, 3);
+    kernel += 1.f / 9;
+    // the filters run on an 8K image of shades
+    Matrix shades(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS, Matrix::NO_INIT);
+    for (int i = 0; i < STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS; ++ i)
+    {
+        shades[i] = (float) (gen() % 256);
+    }
+    Matrix result(1, 1);
+
+    int maxThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for (int t = 1; t < maxThreads; t *= 2)
+    {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(maxThreads);
+
+    const char *names[] = {"gemm", "add_assign", "convolution", "blur_8k", "sobel_8k",
+                           "quantization_8k"};
+    std::function<void()> ops[] = {[&]()
+    {
+        result = a * b;
+    }, [&]()
+    {
+        image += other;
+    }, [&]()
+    {
+        result = convolution(image, kernel);
+    }, [&]()
+    {
+        result = blur(shades);
+    }, [&]()
+    {
+        result = sobel(shades);
+    }, [&]()
+    {
+        result = quantization(shades, 8);
+    }};
+    int count = sizeof(names) / sizeof(names[0]);
+    std::cout << "op,threads,median_s,speedup,efficiency" << std::endl;
+    std::vector<double> serial((size_t) count);
+    for (int threads : threadCounts)
+    {
+        ThreadPool::instance().resize(threads);
+        for (int op = 0; op < count; ++ op)
+        {
+            double seconds = medianSeconds(ops[op], REPETITIONS);
+            if (threads == 1)
+            {
+                serial[op] = seconds;
+            }
+            std::cout << names[op] << "," << threads << "," << seconds << ","
+                      << serial[op] / seconds << "," << serial[op] / seconds / threads
+                      << std::endl;
+        }
+    }
+}
+
+/**
+ * loads one of the images bundled in helpers/
+ * @param name the file name of the image
+ * @param image the matrix to load the image into
+ * @return true if the image was loaded, false otherwise
+ */
+static bool loadHelperImage(const std::string &name, Matrix &image)
+{
+    std::ifstream file(HELPERS_DIR + name);
+    if (!file)
+    {
+        return false;
+    }
+    file >> image;
+    return true;
+}
+
+/**
+ * times a filter and checks how many data buffers a call allocates
+ * @tparam Function a callable without arguments which runs the filter once
+ * @param name the name of the filter
+ * @param image the name of the image
+ * @param fn runs the filter
+ * @param maxAllocations the most allocations allowed per call
+ * @return true if the filter stayed within maxAllocations, false otherwise
+ */
+template<typename Function>
+static bool measureFilter(const char *name, const std::string &image, Function fn,
+                          long maxAllocations)
+{
+    double seconds = medianSeconds(fn, REPETITIONS);
+    Matrix::resetAllocationCount();
+    fn();
+    long allocated = Matrix::allocationCount();
+    std::cout << name << "," << image << "," << seconds << "," << allocated << ","
+              << maxAllocations << std::endl;
+    return allocated <= maxAllocations;
+}
+
+/**
+ * measures the filters on the bundled images and checks their allocation budgets
+ * @return true if every filter stayed within its budget, false otherwise
+ */
+static bool benchmarkFilters()
+{
+    bool ok = true;
+    std::cout << "filter,image,median_s,allocations,max_allocations" << std::endl;
+    for (std::string name : {"lena.out", "givatram.out"})
+    {
+        Matrix image(HELPER_IMAGE_SIZE, HELPER_IMAGE_SIZE);
+        if (!loadHelperImage(name, image))
+        {
+            std::cerr << "Cannot open " << HELPERS_DIR << name << std::endl;
+            continue;
+        }
+        Matrix result(1, 1);
+        ok &= measureFilter("blur", name, [&]()
+        {
+            result = blur(image);
+        }, BLUR_ALLOCATIONS);
+        ok &= measureFilter("sobel", name, [&]()
+        {
+            result = sobel(image);
+        }, SOBEL_ALLOCATIONS);
+        ok &= measureFilter("quantization", name, [&]()
+        {
+            result = quantization(image, 8);
+        }, QUANTIZATION_ALLOCATIONS);
+    }
+    return ok;
+}
+
+/**
+ * compares the float filters with the byte filters on an image, and checks that they agree
+ * @param name the name of the image
+ * @param image the image, of whole shades
+ */
+static void compareByteFilters(const std::string &name, const Matrix &image)
+{
+    ByteMatrix bytes(image);
+    Matrix result(1, 1);
+    ByteMatrix byteResult(1, 1);
+    auto compare = [&](const char *filter, double floatSeconds, double byteSeconds)
+    {
+        std::cout << filter << "," << name << "," << floatSeconds << "," << byteSeconds << ","
+                  << floatSeconds / byteSeconds << "," << (ByteMatrix(result) == byteResult)
+                  << std::endl;
+    };
+    double floatSeconds = medianSeconds([&]()
+    {
+        result = blur(image);
+    }, REPETITIONS);
+    compare("blur", floatSeconds, medianSeconds([&]()
+    {
+        byteResult = blur(bytes);
+    }, REPETITIONS));
+    floatSeconds = medianSeconds([&]()
+    {
+        result = sobel(image);
+    }, REPETITIONS);
+    compare("sobel", floatSeconds, medianSeconds([&]()
+    {
+        byteResult = sobel(bytes);
+    }, REPETITIONS));
+    floatSeconds = medianSeconds([&]()
+    {
+        result = quantization(image, 8);
+    }, REPETITIONS);
+    compare("quantization", floatSeconds, medianSeconds([&]()
+    {
+        byteResult = quantization(bytes, 8);
+    }, REPETITIONS));
+}
+
+/**
+ * measures the byte filters against the float ones, on the bundled images and on a large image
+ * tiled from the first of them
+ */
+static void benchmarkByteFilters()
+{
+    std::cout << "filter,image,float_s,uint8_s,speedup,match" << std::endl;
+    Matrix large(BYTE_IMAGE_SIZE, BYTE_IMAGE_SIZE);
+    bool loaded = false;
+    for (std::string name : {"lena.out", "givatram.out"})
+    {
+        Matrix image(HELPER_IMAGE_SIZE, HELPER_IMAGE_SIZE);
+        if (!loadHelperImage(name, image))
+        {
+            continue;
+        }
+        compareByteFilters(name, image);
+        if (!loaded)
+        {
+            for (int i = 0; i < BYTE_IMAGE_SIZE; ++ i)
+            {
+                for (int j = 0; j < BYTE_IMAGE_SIZE; ++ j)
+                {
+                    large(i, j) = image(i % HELPER_IMAGE_SIZE, j % HELPER_IMAGE_SIZE);
+                }
+            }
+            loaded = true;
+        }
+    }
+    if (loaded)
+    {
+        compareByteFilters("tiled_" + std::to_string(BYTE_IMAGE_SIZE), large);
+    }
+}
+
+/**
+ * measures the filters with and without the buffer pool, and the elementwise operators on packed
+ * and padded rows of a power of two width
+ */
+static void benchmarkStorage()
+{
+    Matrix image(HELPER_IMAGE_SIZE, HELPER_IMAGE_SIZE);
+    loadHelperImage("lena.out", image);
+    Matrix result(1, 1);
+    std::cout << "filter,pool,median_s,allocator_calls" << std::endl;
+    for (bool pooled : {false, true})
+    {
+        BufferPool::instance().setEnabled(pooled);
+        for (std::string name : {"blur", "sobel"})
+        {
+            auto run = [&]()
+            {
+                result = (name == "blur") ? blur(image) : sobel(image);
+            };
+            double seconds = medianSeconds(run, REPETITIONS);
+            long misses = BufferPool::instance().stats().misses;
+            run();
+            std::cout << name << "," << pooled << "," << seconds << ","
+                      << BufferPool::instance().stats().misses - misses << std::endl;
+        }
+    }
+    std::mt19937 gen(42);
+    int n = ELEMENTWISE_SIZE;
+    std::cout << "op,pitch,median_s,gb_per_s" << std::endl;
+    for (int pitch : {n, Matrix::paddedPitch(n)})
+    {
+        Matrix a(n, n, Matrix::ZERO_INIT, pitch);
+        Matrix b(n, n, Matrix::ZERO_INIT, pitch);
+        fillRandom(a, gen);
+        fillRandom(b, gen);
+        Matrix c(n, n, Matrix::NO_INIT, pitch);
+        double seconds = medianSeconds([&]()
+        {
+            c = a + b * 2.f;
+        }, REPETITIONS);
+        std::cout << "add_scaled," << pitch << "," << seconds << ","
+                  << 3.0 * n * n * sizeof(float) / seconds * 1e-9 << std::endl;
+    }
+}
+
+/**
+ * measures gaussian kernels of growing size run directly and as two separable passes
+ */
+static void benchmarkConvolution()
+{
+    std::mt19937 gen(42);
+    Matrix image(CONVOLUTION_IMAGE_SIZE, CONVOLUTION_IMAGE_SIZE);
+    fillRandom(image, gen);
+    std::cout << "kernel,taps,direct_s,separable_s,speedup" << std::endl;
+    for (float sigma : {0.5f, 1.f, 2.f, 4.f})
+    {
+        SeparableKernel gaussian;
+        gaussian.column = gaussianTaps(sigma);
+        gaussian.row = gaussian.column;
+        int size = (int) gaussian.row.size();
+        Matrix kernel(size, size);
+        for (int a = 0; a < size; ++ a)
+        {
+            for (int b = 0; b < size; ++ b)
+            {
+                kernel(a, b) = gaussian.column[a] * gaussian.row[b];
+            }
+        }
+        Matrix result(1, 1);
+        double direct = medianSeconds([&]()
+        {
+            result = convolveDirect(image, kernel);
+        }, REPETITIONS);
+        double separable = medianSeconds([&]()
+        {
+            result = convolveSeparable(image, gaussian);
+        }, REPETITIONS);
+        std::cout << "gaussian_" << size << "x" << size << "," << size * size << "," << direct
+                  << "," << separable << "," << direct / separable << std::endl;
+    }
+    Matrix kernel(3, 3);
+    fillRandom(kernel, gen);
+    double bytes = 2.0 * CONVOLUTION_IMAGE_SIZE * CONVOLUTION_IMAGE_SIZE * sizeof(float);
+    std::cout << "kernel,border,median_s,gb_per_s" << std::endl;
+    const char *names[] = {"zero", "clamp", "reflect", "wrap"};
+    for (BorderMode border : {BORDER_ZERO, BORDER_CLAMP, BORDER_REFLECT, BORDER_WRAP})
+    {
+        Matrix result(1, 1);
+        double seconds = medianSeconds([&]()
+        {
+            result = convolveDirect(image, kernel, border);
+        }, REPETITIONS);
+        std::cout << "direct_3x3," << names[border] << "," << seconds << ","
+                  << bytes / seconds * 1e-9 << std::endl;
+    }
+}
+
+/**
+ * measures the direct, separable and FFT methods on rank 1 kernels of growing size, and the costs
+ * of their units which the cost model of chooseConvolution weighs: a tap of each tap based method
+ * per pixel, and an FFT point times the log2 of the points of its block per output pixel. The last
+ * columns are the methods convolve() picks for the kernel and for a kernel of its size which is
+ * not separable.
+ */
+static void benchmarkConvolutionMethods()
+{
+    std::mt19937 gen(7);
+    Matrix image(CONVOLUTION_IMAGE_SIZE, CONVOLUTION_IMAGE_SIZE);
+    fillRandom(image, gen);
+    double pixels = (double) CONVOLUTION_IMAGE_SIZE * CONVOLUTION_IMAGE_SIZE;
+    const char *names[] = {"direct", "separable", "fft"};
+    std::cout << "kernel,direct_s,separable_s,fft_s,direct_ns_per_tap,separable_ns_per_tap,"
+              << "fft_ns_per_point_log,chosen,chosen_not_separable" << std::endl;
+    for (int size : {3, 5, 7, 9, 11, 15, 21, 31, 45})
+    {
+        SeparableKernel separable;
+        separable.column.resize((size_t) size);
+        separable.row.resize((size_t) size);
+        std::uniform_real_distribution<float> tap(0.f, 1.f);
+        for (int t = 0; t < size; ++ t)
+        {
+            separable.column[t] = tap(gen);
+            separable.row[t] = tap(gen);
+        }
+        Matrix kernel(size, size);
+        for (int a = 0; a < size; ++ a)
+        {
+            for (int b = 0; b < size; ++ b)
+            {
+                kernel(a, b) = separable.column[a] * separable.row[b];
+            }
+        }
+        Matrix result(1, 1);
+        double direct = medianSeconds([&]()
+        {
+            result = convolveDirect(image, kernel);
+        }, REPETITIONS);
+        double separated = medianSeconds([&]()
+        {
+            result = convolveSeparable(image, separable);
+        }, REPETITIONS);
+        double fft = medianSeconds([&]()
+        {
+            result = convolveFft(image, kernel);
+        }, REPETITIONS);
+        // the blocks as convolveFft lays them out
+        int block = fastFftSize(std::min(CONVOLUTION_IMAGE_SIZE + size - 1,
+                                         std::max(FFT_MIN_BLOCK, FFT_BLOCK_KERNELS * size)));
+        int tile = std::min(block - size + 1, CONVOLUTION_IMAGE_SIZE);
+        double points = (double) block * block;
+        double fftUnits = pixels * points * std::log2(points) / ((double) tile * tile);
+        ConvolutionMethod chosen = chooseConvolution(CONVOLUTION_IMAGE_SIZE,
+                                                     CONVOLUTION_IMAGE_SIZE, size, size, true);
+        ConvolutionMethod chosenDense = chooseConvolution(CONVOLUTION_IMAGE_SIZE,
+                                                          CONVOLUTION_IMAGE_SIZE, size, size,
+                                                          false);
+        std::cout << size << "x" << size << "," << direct << "," << separated << "," << fft << ","
+                  << direct / (pixels * size * size) * 1e9 << ","
+                  << separated / (pixels * 2 * size) * 1e9 << "," << fft / fftUnits * 1e9 << ","
+                  << names[chosen] << "," << names[chosenDense] << std::endl;
+    }
+}
+
+/**
+ * blur as it was computed before the stencil kernels: convolution() with the blur kernel, clamped
+ * @param image the image to blur
+ * @return the blurred image
+ */
+static Matrix convolutionBlur(const Matrix &image)
+{
+    Matrix kernel(3, 3);
+    float taps[] = {1.f, 2.f, 1.f, 2.f, 4.f, 2.f, 1.f, 2.f, 1.f};
+    for (int i = 0; i < 9; ++ i)
+    {
+        kernel[i] = taps[i] / 16;
+    }
+    Matrix result = convolution(image, kernel);
+    for (int i = 0; i < result.getRows() * result.getCols(); ++ i)
+    {
+        result[i] = std::min(std::max(result[i], 0.f), 255.f);
+    }
+    return result;
+}
+
+/**
+ * sobel as it was computed before the stencil kernels: convolution() with each gradient, summed
+ * and clamped
+ * @param image the image to apply sobel on
+ * @return the result image
+ */
+static Matrix convolutionSobel(const Matrix &image)
+{
+    Matrix gx(3, 3);
+    Matrix gy(3, 3);
+    float xTaps[] = {1.f, 0.f, - 1.f, 2.f, 0.f, - 2.f, 1.f, 0.f, - 1.f};
+    float yTaps[] = {1.f, 2.f, 1.f, 0.f, 0.f, 0.f, - 1.f, - 2.f, - 1.f};
+    for (int i = 0; i < 9; ++ i)
+    {
+        gx[i] = xTaps[i] / 8;
+        gy[i] = yTaps[i] / 8;
+    }
+    Matrix result = convolution(image, gx);
+    result += convolution(image, gy);
+    for (int i = 0; i < result.getRows() * result.getCols(); ++ i)
+    {
+        result[i] = std::min(std::max(result[i], 0.f), 255.f);
+    }
+    return result;
+}
+
+/**
+ * measures blur and sobel through convolution() and through the float and byte stencil kernels,
+ * in megapixels per second, on the bundled images scaled up to 8K
+ */
+static void benchmarkStencils()
+{
+    std::cout << "filter,image,kernels,convolution_mpix_s,stencil_mpix_s,uint8_mpix_s,speedup,"
+              << "match" << std::endl;
+    double megapixels = (double) STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS * 1e-6;
+    for (std::string name : {"lena.out", "givatram.out"})
+    {
+        Matrix small(HELPER_IMAGE_SIZE, HELPER_IMAGE_SIZE);
+        if (!loadHelperImage(name, small))
+        {
+            continue;
+        }
+        // nearest neighbour scaling, so the large image keeps the shades of the small one
+        Matrix image(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS, Matrix::NO_INIT);
+        for (int i = 0; i < STENCIL_IMAGE_ROWS; ++ i)
+        {
+            for (int j = 0; j < STENCIL_IMAGE_COLS; ++ j)
+            {
+                image(i, j) = small((int) ((long) i * HELPER_IMAGE_SIZE / STENCIL_IMAGE_ROWS),
+                                    (int) ((long) j * HELPER_IMAGE_SIZE / STENCIL_IMAGE_COLS));
+            }
+        }
+        ByteMatrix bytes(image);
+        std::string scaled = name + "@" + std::to_string(STENCIL_IMAGE_COLS) + "x" +
+                             std::to_string(STENCIL_IMAGE_ROWS);
+        for (std::string filter : {"blur", "sobel"})
+        {
+            bool isBlur = filter == "blur";
+            Matrix expected(1, 1);
+            Matrix result(1, 1);
+            ByteMatrix byteResult(1, 1);
+            double convolutionSeconds = medianSeconds([&]()
+            {
+                expected = isBlur ? convolutionBlur(image) : convolutionSobel(image);
+            }, REPETITIONS);
+            double stencilSeconds = medianSeconds([&]()
+            {
+                result = isBlur ? blur(image) : sobel(image);
+            }, REPETITIONS);
+            double byteSeconds = medianSeconds([&]()
+            {
+                byteResult = isBlur ? blur(bytes) : sobel(bytes);
+            }, REPETITIONS);
+            bool match = result == expected && byteResult == ByteMatrix(expected);
+            std::cout << filter << "," << scaled << "," << kernels::name() << ","
+                      << megapixels / convolutionSeconds << "," << megapixels / stencilSeconds
+                      << "," << megapixels / byteSeconds << ","
+                      << convolutionSeconds / stencilSeconds << "," << match << std::endl;
+        }
+    }
+}
+
+/**
+ * measures the single sweep gradients on an 8K image of shades, in megapixels per second, against
+ * sobel as it was computed before the stencil kernels, whose gradients each took a convolution
+ */
+static void benchmarkGradients()
+{
+    std::mt19937 gen(42);
+    Matrix shades(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS, Matrix::NO_INIT);
+    for (int i = 0; i < STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS; ++ i)
+    {
+        shades[i] = (float) (gen() % 256);
+    }
+    double megapixels = (double) STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS * 1e-6;
+    Matrix expected(1, 1);
+    Gradients result;
+    double convolutionSeconds = medianSeconds([&]()
+    {
+        expected = convolutionSobel(shades);
+    }, REPETITIONS);
+    const char *names[] = {"sobel", "x_y", "l1_magnitude", "l2_magnitude_orientation"};
+    int outputs[] = {0, GRADIENT_X | GRADIENT_Y, GRADIENT_MAGNITUDE,
+                     GRADIENT_MAGNITUDE | GRADIENT_ORIENTATION};
+    GradientNorm norms[] = {GRADIENT_L1, GRADIENT_L1, GRADIENT_L1, GRADIENT_L2};
+    std::cout << "gradients,kernels,mpix_s,speedup_over_convolution_sobel" << std::endl;
+    for (int g = 0; g < 4; ++ g)
+    {
+        double seconds = medianSeconds([&]()
+        {
+            if (g == 0)
+            {
+                result.x = sobel(shades);
+                return;
+            }
+            result = gradients(shades, outputs[g], norms[g]);
+        }, REPETITIONS);
+        std::cout << names[g] << "," << kernels::name() << "," << megapixels / seconds << ","
+                  << convolutionSeconds / seconds << std::endl;
+    }
+}
+
+/**
+ * measures blur, sobel and quantization applied one after the other against the same chain run as
+ * a single FilterPipeline on an 8K image of shades, in megapixels per second, with the number of
+ * matrices each allocates
+ */
+static void benchmarkPipeline()
+{
+    std::mt19937 gen(42);
+    Matrix shades(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS, Matrix::NO_INIT);
+    for (int i = 0; i < STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS; ++ i)
+    {
+        shades[i] = (float) (gen() % 256);
+    }
+    double megapixels = (double) STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS * 1e-6;
+    FilterPipeline pipeline;
+    pipeline.blur().sobel().quantization(8);
+    Matrix expected(1, 1);
+    Matrix result(1, 1);
+    auto chained = [&]()
+    {
+        expected = quantization(sobel(blur(shades)), 8);
+    };
+    auto fused = [&]()
+    {
+        result = pipeline.run(shades);
+    };
+    std::cout << "chain,method,median_s,mpix_s,allocations,match" << std::endl;
+    const char *methods[] = {"chained", "pipeline"};
+    std::function<void()> runs[] = {chained, fused};
+    double seconds[2];
+    long allocated[2];
+    for (int m = 0; m < 2; ++ m)
+    {
+        seconds[m] = medianSeconds(runs[m], REPETITIONS);
+        Matrix::resetAllocationCount();
+        runs[m]();
+        allocated[m] = Matrix::allocationCount();
+    }
+    for (int m = 0; m < 2; ++ m)
+    {
+        std::cout << "blur_sobel_quantization_8k," << methods[m] << "," << seconds[m] << ","
+                  << megapixels / seconds[m] << "," << allocated[m] << ","
+                  << (result == expected) << std::endl;
+    }
+}
+
+/**
+ * streams a tall image of shades through blur, sobel and quantization, generating its rows on the
+ * fly and summing the result rows as they come, and prints the throughput in megapixels per
+ * second with the bytes the pipeline holds against those of the whole image
+ */
+static void benchmarkStreaming()
+{
+    FilterPipeline pipeline;
+    pipeline.blur().sobel().quantization(8);
+    double megapixels = (double) STREAM_IMAGE_ROWS * STENCIL_IMAGE_COLS * 1e-6;
+    std::mt19937 gen(42);
+    double checksum = 0;
+    Matrix::resetAllocationCount();
+    double seconds = medianSeconds([&]()
+    {
+        pipeline.stream(STREAM_IMAGE_ROWS, STENCIL_IMAGE_COLS, [&](float *row)
+        {
+            for (int x = 0; x < STENCIL_IMAGE_COLS; ++ x)
+            {
+                row[x] = (float) (gen() % 256);
+            }
+        }, [&](const float *row)
+        {
+            checksum += row[0];
+        });
+    }, 1);
+    // the input row, the three ring rows of every 3 x 3 filter and the output row
+    double heldBytes = (double) (3 * pipeline.radius() + 2) * STENCIL_IMAGE_COLS * sizeof(float);
+    double imageBytes = megapixels * 1e6 * sizeof(float);
+    std::cout << "pipeline,rows,cols,median_s,mpix_s,held_bytes,image_bytes,matrix_allocations"
+              << std::endl;
+    std::cout << "blur_sobel_quantization," << STREAM_IMAGE_ROWS << "," << STENCIL_IMAGE_COLS
+              << "," << seconds << "," << megapixels / seconds << "," << heldBytes << ","
+              << imageBytes << "," << Matrix::allocationCount() << std::endl;
+}
+
+/**
+ * quantization as it was computed before the shade tables: the ranges searched for every pixel
+ * @param image the image to quantize
+ * @param levels the wanted level of shades
+ * @return the quantized image
+ */
+static Matrix loopQuantization(const Matrix &image, int levels)
+{
+    int scaleRange = 256 / levels;
+    Matrix result(image.getRows(), image.getCols(), Matrix::NO_INIT);
+    for (int i = 0; i < image.getRows() * image.getCols(); ++ i)
+    {
+        int j = 0;
+        int destRange = 0;
+        while (j + scaleRange - 1 < 256)
+        {
+            if (image[i] >= (float) j && image[i] <= (float) (j + scaleRange - 1))
+            {
+                destRange = j;
+                break;
+            }
+            j += scaleRange;
+        }
+        result[i] = floorf((float) (2 * destRange + scaleRange - 1) / 2);
+    }
+    return result;
+}
+
+/**
+ * measures the shade tables on an 8K image of shades, in megapixels per second: quantization
+ * against the search it replaced, on floats and on bytes, and a chain of four tables composed into
+ * one against the four applied one after the other
+ */
+static void benchmarkShadeTables()
+{
+    std::mt19937 gen(42);
+    Matrix shades(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS, Matrix::NO_INIT);
+    for (int i = 0; i < STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS; ++ i)
+    {
+        shades[i] = (float) (gen() % 256);
+    }
+    ByteMatrix bytes(shades);
+    double megapixels = (double) STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS * 1e-6;
+    ShadeTable gamma = ShadeTable::gamma(0.8f);
+    ShadeTable stretch = ShadeTable::contrastStretch(16, 240);
+    ShadeTable clamp = ShadeTable::clamp(8, 248);
+    ShadeTable quantize = ShadeTable::quantization(8);
+    ShadeTable chain = gamma.then(stretch).then(clamp).then(quantize);
+    Matrix expected(1, 1);
+    Matrix result(1, 1);
+    ByteMatrix byteResult(1, 1);
+
+    std::cout << "op,kernels,baseline_mpix_s,table_mpix_s,uint8_mpix_s,speedup,match"
+              << std::endl;
+    double loopSeconds = medianSeconds([&]()
+    {
+        expected = loopQuantization(shades, 8);
+    }, REPETITIONS);
+    double tableSeconds = medianSeconds([&]()
+    {
+        result = quantization(shades, 8);
+    }, REPETITIONS);
+    double byteSeconds = medianSeconds([&]()
+    {
+        byteResult = quantization(bytes, 8);
+    }, REPETITIONS);
+    bool match = result == expected && byteResult == ByteMatrix(expected);
+    std::cout << "quantization_8k," << kernels::name() << "," << megapixels / loopSeconds << ","
+              << megapixels / tableSeconds << "," << megapixels / byteSeconds << ","
+              << loopSeconds / tableSeconds << "," << match << std::endl;
+
+    double separateSeconds = medianSeconds([&]()
+    {
+        expected = quantize.apply(clamp.apply(stretch.apply(gamma.apply(shades))));
+    }, REPETITIONS);
+    double composedSeconds = medianSeconds([&]()
+    {
+        result = chain.apply(shades);
+    }, REPETITIONS);
+    byteSeconds = medianSeconds([&]()
+    {
+        byteResult = chain.apply(bytes);
+    }, REPETITIONS);
+    match = result == expected && byteResult == ByteMatrix(expected);
+    std::cout << "chain_of_4_8k," << kernels::name() << "," << megapixels / separateSeconds
+              << "," << megapixels / composedSeconds << "," << megapixels / byteSeconds << ","
+              << separateSeconds / composedSeconds << "," << match << std::endl;
+}
+
+/**
+ * writes a matrix as text the way operator<< did before the fast path: one stream insertion per
+ * element
+ * @param ostream the stream to write to
+ * @param matrix the matrix to write
+ */
+static void loopWrite(std::ostream &ostream, const Matrix &matrix)
+{
+    long size = (long) matrix.getRows() * matrix.getCols();
+    for (long i = 0; i < size; ++ i)
+    {
+        ostream << matrix[i];
+        if (i < size - 1)
+        {
+            ostream << (i % matrix.getCols() == matrix.getCols() - 1 ? '\n' : ' ');
+        }
+    }
+}
+
+/**
+ * reads a matrix as text the way operator>> did before the fast path: one stream extraction per
+ * element
+ * @param istream the stream to read from
+ * @param matrix the matrix to read into
+ */
+static void loopRead(std::istream &istream, Matrix &matrix)
+{
+    long size = (long) matrix.getRows() * matrix.getCols();
+    for (long i = 0; i < size; ++ i)
+    {
+        istream >> matrix[i];
+    }
+}
+
+/**
+ * prints a line of the I/O benchmark
+ * @param op the name of the operation
+ * @param seconds the median time of the operation
+ * @param bytes the bytes of the file it wrote or read
+ * @param match true if its matrix is the original one
+ */
+static void printIO(const char *op, double seconds, double bytes, bool match)
+{
+    std::cout << op << "," << IO_MATRIX_SIZE << "," << seconds << "," << bytes * 1e-6 / seconds
+              << "," << match << std::endl;
+}
+
+/**
+ * measures saving and loading a 2K matrix of arbitrary floats, in MB of file per second: the text
+ * format by a stream operation per element against the chunked from_chars and to_chars path, the
+ * binary format, and mapping the binary file, which reads its pages only as they are summed
+ */
+static void benchmarkMatrixIO()
+{
+    std::mt19937 gen(42);
+    Matrix matrix(IO_MATRIX_SIZE, IO_MATRIX_SIZE, Matrix::NO_INIT);
+    std::uniform_real_distribution<float> dist(-1000, 1000);
+    for (int i = 0; i < IO_MATRIX_SIZE * IO_MATRIX_SIZE; ++ i)
+    {
+        matrix[i] = dist(gen);
+    }
+    Matrix result(IO_MATRIX_SIZE, IO_MATRIX_SIZE);
+    std::ostringstream expected;
+    expected << std::setprecision(9);
+    loopWrite(expected, matrix);
+
+    std::cout << "op,size,median_s,mb_s,match" << std::endl;
+    std::string text;
+    double seconds = medianSeconds([&]()
+    {
+        std::ofstream file(IO_TEXT_FILE);
+        file << std::setprecision(9);
+        loopWrite(file, matrix);
+    }, REPETITIONS);
+    double textBytes = (double) expected.str().size();
+    printIO("text_write_loop", seconds, textBytes, true);
+    seconds = medianSeconds([&]()
+    {
+        std::ofstream file(IO_TEXT_FILE);
+        file << std::setprecision(9) << matrix;
+    }, REPETITIONS);
+    {
+        std::ifstream file(IO_TEXT_FILE);
+        std::ostringstream written;
+        written << file.rdbuf();
+        text = written.str();
+    }
+    printIO("text_write_to_chars", seconds, textBytes, text == expected.str());
+    seconds = medianSeconds([&]()
+    {
+        std::ifstream file(IO_TEXT_FILE);
+        loopRead(file, result);
+    }, REPETITIONS);
+    printIO("text_read_loop", seconds, textBytes, result == matrix);
+    result = Matrix(IO_MATRIX_SIZE, IO_MATRIX_SIZE);
+    seconds = medianSeconds([&]()
+    {
+        std::ifstream file(IO_TEXT_FILE);
+        file >> result;
+    }, REPETITIONS);
+    printIO("text_read_from_chars", seconds, textBytes, result == matrix);
+
+    double binaryBytes = BINARY_HEADER_BYTES + (double) IO_MATRIX_SIZE * IO_MATRIX_SIZE * 4;
+    seconds = medianSeconds([&]()
+    {
+        std::ofstream file(IO_BINARY_FILE, std::ios::binary);
+        writeBinary(file, matrix);
+    }, REPETITIONS);
+    printIO("binary_write", seconds, binaryBytes, true);
+    seconds = medianSeconds([&]()
+    {
+        std::ifstream file(IO_BINARY_FILE, std::ios::binary);
+        result = readBinary(file);
+    }, REPETITIONS);
+    printIO("binary_read", seconds, binaryBytes, result == matrix);
+    double sum = 0;
+    seconds = medianSeconds([&]()
+    {
+        MappedMatrix mapped(IO_BINARY_FILE);
+        ConstMatrixView view = mapped.view();
+        sum = 0;
+        for (int r = 0; r < view.getRows(); ++ r)
+        {
+            for (int c = 0; c < view.getCols(); ++ c)
+            {
+                sum += view(r, c);
+            }
+        }
+    }, REPETITIONS);
+    double expectedSum = 0;
+    for (int i = 0; i < IO_MATRIX_SIZE * IO_MATRIX_SIZE; ++ i)
+    {
+        expectedSum += matrix[i];
+    }
+    printIO("binary_mmap_sum", seconds, binaryBytes, sum == expectedSum);
+    std::remove(IO_TEXT_FILE);
+    std::remove(IO_BINARY_FILE);
+}
+
+/**
+ * measures a blur job on an 8K image of shades, in megapixels per second: through the text format
+ * of the Python helpers against the native PGM codec, each step and the whole job of reading,
+ * blurring and writing
+ */
+static void benchmarkImageCodec()
+{
+    std::mt19937 gen(42);
+    Matrix image(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS, Matrix::NO_INIT);
+    for (int i = 0; i < STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS; ++ i)
+    {
+        image[i] = (float) (gen() % 256);
+    }
+    double megapixels = (double) STENCIL_IMAGE_ROWS * STENCIL_IMAGE_COLS * 1e-6;
+    {
+        std::ofstream file(IO_TEXT_FILE);
+        file << image;
+    }
+    writeGray(PGM_FILE, image);
+    Matrix textImage(STENCIL_IMAGE_ROWS, STENCIL_IMAGE_COLS);
+    Matrix pgmImage(1, 1);
+
+    std::cout << "step,text_mpix_s,pgm_mpix_s,speedup,match" << std::endl;
+    double textSeconds = medianSeconds([&]()
+    {
+        std::ifstream file(IO_TEXT_FILE);
+        file >> textImage;
+    }, REPETITIONS);
+    double pgmSeconds = medianSeconds([&]()
+    {
+        pgmImage = readGray(PGM_FILE);
+    }, REPETITIONS);
+    std::cout << "read," << megapixels / textSeconds << "," << megapixels / pgmSeconds << ","
+              << textSeconds / pgmSeconds << "," << (textImage == pgmImage) << std::endl;
+    textSeconds = medianSeconds([&]()
+    {
+        std::ofstream file(IO_TEXT_FILE);
+        file << image;
+    }, REPETITIONS);
+    pgmSeconds = medianSeconds([&]()
+    {
+        writeGray(PGM_FILE, image);
+    }, REPETITIONS);
+    std::cout << "write," << megapixels / textSeconds << "," << megapixels / pgmSeconds << ","
+              << textSeconds / pgmSeconds << "," << (readGray(PGM_FILE) == image) << std::endl;
+    textSeconds = medianSeconds([&]()
+    {
+        std::ifstream input(IO_TEXT_FILE);
+        input >> textImage;
+        std::ofstream output(TEXT_OUTPUT_FILE);
+        output << blur(textImage);
+    }, REPETITIONS);
+    pgmSeconds = medianSeconds([&]()
+    {
+        writeGray(PGM_OUTPUT_FILE, blur(readGray(PGM_FILE)));
+    }, REPETITIONS);
+    {
+        std::ifstream file(TEXT_OUTPUT_FILE);
+        file >> textImage;
+    }
+    std::cout << "blur_job," << megapixels / textSeconds << "," << megapixels / pgmSeconds << ","
+              << textSeconds / pgmSeconds << "," << (textImage == readGray(PGM_OUTPUT_FILE))
+              << std::endl;
+    std::remove(IO_TEXT_FILE);
+    std::remove(PGM_FILE);
+    std::remove(TEXT_OUTPUT_FILE);
+    std::remove(PGM_OUTPUT_FILE);
+}
+
+/**
+ * measures box blurs of growing radius through convolution() with a box kernel, whose cost grows
+ * with the radius, and through boxFilter(), whose cost does not, and the other filters of summed
+ * area tables. Counts the pixels where the two blurs differ, which are pixels within rounding of a
+ * half that the FFT of convolution() rounds the other way.
+ */
+static void benchmarkBoxFilters()
+{
+    std::mt19937 gen(11);
+    Matrix image(BOX_IMAGE_SIZE, BOX_IMAGE_SIZE);
+    for (int i = 0; i < BOX_IMAGE_SIZE * BOX_IMAGE_SIZE; ++ i)
+    {
+        image[i] = (float) (gen() % SHADES);
+    }
+    double megapixels = (double) BOX_IMAGE_SIZE * BOX_IMAGE_SIZE * 1e-6;
+    std::cout << "radius,convolution_mp_s,box_filter_mp_s,speedup,differing,mean_filter_mp_s,"
+              << "local_contrast_mp_s" << std::endl;
+    for (int radius : {1, 2, 4, 8, 16, 32, 64})
+    {
+        int size = 2 * radius + 1;
+        Matrix kernel(size, size);
+        for (int i = 0; i < size * size; ++ i)
+        {
+            kernel[i] = 1.f / (float) (size * size);
+        }
+        Matrix convolved(1, 1);
+        Matrix boxed(1, 1);
+        Matrix result(1, 1);
+        double convolutionSeconds = medianSeconds([&]()
+        {
+            convolved = convolution(image, kernel);
+        }, REPETITIONS);
+        double boxSeconds = medianSeconds([&]()
+        {
+            boxed = boxFilter(image, radius);
+        }, REPETITIONS);
+        double meanSeconds = medianSeconds([&]()
+        {
+            result = meanFilter(image, radius);
+        }, REPETITIONS);
+        double contrastSeconds = medianSeconds([&]()
+        {
+            result = localContrast(image, radius);
+        }, REPETITIONS);
+        int differing = 0;
+        for (int i = 0; i < BOX_IMAGE_SIZE * BOX_IMAGE_SIZE; ++ i)
+        {
+            differing += convolved[i] != boxed[i];
+        }
+        std::cout << radius << "," << megapixels / convolutionSeconds << ","
+                  << megapixels / boxSeconds << "," << convolutionSeconds / boxSeconds << ","
+                  << differing << "," << megapixels / meanSeconds << ","
+                  << megapixels / contrastSeconds << std::endl;
+    }
+}
+
+/**
+ * the run times of a suite case
+ */
+struct SuiteTimes
+{
+    double median;
+    double p95;
+    int repetitions;
+};
+
+/**
+ * runs a function SUITE_WARMUPS times, then measures it
+ * @tparam Function a callable without arguments
+ * @param fn the function to measure
+ * @return the median and the 95th percentile of the run times in seconds
+ */
+template<typename Function>
+static SuiteTimes suiteSeconds(Function fn)
+{
+    auto warmupStart = std::chrono::steady_clock::now();
+    for (int w = 0; w < SUITE_WARMUPS; ++ w)
+    {
+        fn();
+    }
+    auto warmupEnd = std::chrono::steady_clock::now();
+    double warmup = std::chrono::duration<double>(warmupEnd - warmupStart).count() / SUITE_WARMUPS;
+    int repetitions = (int) std::min(std::max(SUITE_CASE_SECONDS / std::max(warmup, 1e-9),
+                                              (double) SUITE_MIN_REPETITIONS),
+                                     (double) SUITE_MAX_REPETITIONS);
+    std::vector<double> times;
+    for (int r = 0; r < repetitions; ++ r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    size_t p95 = (size_t) std::ceil(0.95 * (double) repetitions) - 1;
+    return SuiteTimes{times[times.size() / 2], times[p95], repetitions};
+}
+
+/**
+ * measures a suite case and prints its CSV line: the times, the MB of data read and written and
+ * the GFLOP of a run per second, and the matrix buffers a run allocates
+ * @tparam Function a callable without arguments which runs the case once
+ * @param op the name of the operation
+ * @param input the name of the input, a bundled image or synthetic
+ * @param size the rows number of the input
+ * @param fn runs the case
+ * @param bytes the bytes read and written by a run
+ * @param flops the floating point operations of a run, 0 for operations without arithmetic
+ */
+template<typename Function>
+static void suiteCase(const char *op, const std::string &input, int size, Function fn,
+                      double bytes, double flops)
+{
+    SuiteTimes times = suiteSeconds(fn);
+    Matrix::resetAllocationCount();
+    fn();
+    long allocated = Matrix::allocationCount();
+    std::cout << op << "," << input << "," << size << "," << kernels::name() << ","
+              << ThreadPool::instance().size() << "," << times.repetitions << ","
+              << times.median << "," << times.p95 << "," << bytes * 1e-6 / times.median << ","
+              << flops * 1e-9 / times.median << "," << allocated << std::endl;
+}
+
+/**
+ * runs the suite cases of an image: the filters, a 3 x 3 convolution and the text stream
+ * operators
+ * @param input the name of the image
+ * @param image the image
+ */
+static void suiteImageCases(const std::string &input, const Matrix &image)
+{
+    int size = image.getRows();
+    double pixels = (double) image.getRows() * image.getCols();
+    double bytes = 2 * pixels * sizeof(float);
+    Matrix kernel(3, 3);
+    float taps[] = {0, - 1, 0, - 1, 5, - 1, 0, - 1, 0};
+    for (int i = 0; i < 9; ++ i)
+    {
+        kernel[i] = taps[i];
+    }
+    Matrix result(1, 1);
+    suiteCase("convolution_3x3", input, size, [&]()
+    {
+        result = convolution(image, kernel);
+    }, bytes, 18 * pixels);
+    suiteCase("blur", input, size, [&]()
+    {
+        result = blur(image);
+    }, bytes, 18 * pixels);
+    // a gradient along each axis, and their sum
+    suiteCase("sobel", input, size, [&]()
+    {
+        result = sobel(image);
+    }, bytes, 2 * 12 * pixels + pixels);
+    suiteCase("box_filter_17x17", input, size, [&]()
+    {
+        result = boxFilter(image, SUITE_BOX_RADIUS);
+    }, bytes, 5 * pixels);
+    suiteCase("quantization", input, size, [&]()
+    {
+        result = quantization(image, 8);
+    }, bytes, 0);
+    if (size > SUITE_TEXT_MAX_SIZE)
+    {
+        return;
+    }
+    std::string text;
+    suiteCase("stream_write", input, size, [&]()
+    {
+        std::ostringstream ostream;
+        ostream << image;
+        text = ostream.str();
+    }, pixels * sizeof(float), 0);
+    // the bytes of the text rather than of the matrix, as for writing
+    Matrix read(image.getRows(), image.getCols());
+    suiteCase("stream_read", input, size, [&]()
+    {
+        std::istringstream istream(text);
+        istream >> read;
+    }, (double) text.size(), 0);
+}
+
+/**
+ * runs the suite cases of size x size matrices: the product, the elementwise operators, and
+ * copying
+ * @param size the rows and columns number of the matrices
+ * @param gen the random generator to fill the matrices with
+ */
+static void suiteMatrixCases(int size, std::mt19937 &gen)
+{
+    Matrix a(size, size, Matrix::NO_INIT);
+    Matrix b(size, size, Matrix::NO_INIT);
+    fillRandom(a, gen);
+    fillRandom(b, gen);
+    Matrix c(1, 1);
+    double elements = (double) size * size;
+    double bytes = elements * sizeof(float);
+    if (size <= SUITE_GEMM_MAX_SIZE)
+    {
+        suiteCase("gemm", "synthetic", size, [&]()
+        {
+            c = a * b;
+        }, 3 * bytes, 2 * elements * size);
+    }
+    suiteCase("add", "synthetic", size, [&]()
+    {
+        c = a + b;
+    }, 3 * bytes, elements);
+    suiteCase("add_assign", "synthetic", size, [&]()
+    {
+        a += b;
+    }, 3 * bytes, elements);
+    suiteCase("mul_scalar", "synthetic", size, [&]()
+    {
+        c = a * 0.5f;
+    }, 2 * bytes, elements);
+    suiteCase("copy_construct", "synthetic", size, [&]()
+    {
+        Matrix copy(a);
+    }, 2 * bytes, 0);
+    suiteCase("copy_assign", "synthetic", size, [&]()
+    {
+        c = a;
+    }, 2 * bytes, 0);
+}
+
+/**
+ * runs the benchmark suite and prints a CSV line per case, in a single table which runs can be
+ * compared by to gate changes on regressions: every operation on the bundled images, and on
+ * synthetic images and matrices of every power of two from SUITE_MIN_SIZE to maxSize
+ * @param maxSize the largest synthetic size
+ */
+static void benchmarkSuite(int maxSize)
+{
+    std::mt19937 gen(42);
+    std::cout << "op,input,size,kernels,threads,repetitions,median_s,p95_s,mb_s,gflops,allocations"
+              << std::endl;
+    for (std::string name : {"lena.out", "givatram.out"})
+    {
+        Matrix image(HELPER_IMAGE_SIZE, HELPER_IMAGE_SIZE);
+        if (loadHelperImage(name, image))
+        {
+            suiteImageCases(name, image);
+        }
+    }
+    for (int size = SUITE_MIN_SIZE; size <= maxSize; size *= 2)
+    {
+        Matrix image(size, size, Matrix::NO_INIT);
+        for (int i = 0; i < size * size; ++ i)
+        {
+            image[i] = (float) (gen() % 256);
+        }
+        suiteImageCases("synthetic", image);
+        image = Matrix(1, 1);
+        suiteMatrixCases(size, gen);
+    }
+}
+
+/**
+ * runs the Matrix benchmarks. Exits with a failure if a filter allocates more than its budget.
+ * With the argument suite runs just the benchmark suite, up to the size of the next argument if
+ * given and to SUITE_MAX_SIZE otherwise.
+ * @param argc the number of arguments
+ * @param argv the arguments
+ */
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "suite")
+    {
+        benchmarkSuite(argc > 2 ? atoi(argv[2]) : SUITE_MAX_SIZE);
+        return EXIT_SUCCESS;
+    }
+    if (!benchmarkFilters())
+    {
+        std::cerr << "A filter exceeded its allocation budget." << std::endl;
+        return EXIT_FAILURE;
+    }
+    benchmarkByteFilters();
+    benchmarkStorage();
+    benchmarkConvolution();
+    benchmarkConvolutionMethods();
+    benchmarkStencils();
+    benchmarkGradients();
+    benchmarkPipeline();
+    benchmarkStreaming();
+    benchmarkShadeTables();
+    benchmarkMatrixIO();
+    benchmarkImageCodec();
+    benchmarkBoxFilters();
+    benchmarkGemm();
+    benchmarkElementwise();
+    benchmarkScaling();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,335 @@
+#ifndef EX5_MATRIXEXPR_H
+#define EX5_MATRIXEXPR_H
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include "Kernels.h"
+#include "Trace.h"
+
+#define EXPR_DIMENSIONS_ERR_MSG "Invalid Matrix dimensions.\n"
+#define EXPR_DIVISION_ERR_MSG "Division by zero.\n"
+
+class Matrix;
+
+/**
+ * the base of every lazily evaluated elementwise matrix expression. An expression is only
+ * evaluated when it is assigned to a Matrix, one row at a time, so that a whole chain of
+ * elementwise operations costs a single pass over the operands and no temporary matrices.
+ *
+ * Every expression E provides:
+ *  - getRows() and getCols()
+ *  - IS_LEAF: true if the expression holds its elements in memory, one row after the other
+ *  - rowData(r): the address of row r, for leaves only
+ *  - SCRATCH_ROWS: the number of rows of scratch memory evalRow needs
+ *  - evalRow(r, out, scratch): writes row r of the expression into out. Every operand is read
+ *    before out is written, so out may be the row of an operand.
+ *  - overlaps(data, rows, cols, pitch): true if the expression reads any element of the rows x
+ *    cols matrix of row pitch pitch at data other than at its own position, so that evaluating
+ *    the expression into that matrix row by row could overwrite an element before it is read
+ *  - NAME and FLOPS, for expressions which are not leaves: the name the expression is counted
+ *    under by the trace, and the floating point operations it does per element, not counting
+ *    those of its operands
+ *  - trace(elements), for expressions which are not leaves: counts an evaluation of that many
+ *    elements of the expression, and of its operands under their own names
+ *
+ * Expressions keep references to the matrices they use, so they must be evaluated before these
+ * matrices are destroyed. In particular an expression should not be kept in an auto variable.
+ * @tparam E the type of the expression
+ */
+template<class E>
+class MatrixExpr
+{
+public:
+    /**
+     * @return the expression as its actual type
+     */
+    const E &self() const
+    {
+        return static_cast<const E &>(*this);
+    }
+};
+
+/**
+ * how an expression is kept inside another one: matrices by reference and expressions, which
+ * only hold references and scalars, by value
+ * @tparam E the type of the kept expression
+ */
+template<class E>
+struct ExprStorage
+{
+    typedef const E type;
+};
+
+template<>
+struct ExprStorage<Matrix>
+{
+    typedef const Matrix &type;
+};
+
+/**
+ * @param begin the first element of a block of memory
+ * @param end one past the last element of the block
+ * @param otherBegin the first element of another block
+ * @param otherEnd one past the last element of the other block
+ * @return true if the blocks share an element
+ */
+inline bool memoryOverlaps(const float *begin, const float *end, const float *otherBegin,
+                           const float *otherEnd)
+{
+    // std::less orders pointers into different buffers too
+    std::less<const float *> less;
+    return begin != end && otherBegin != otherEnd && less(begin, otherEnd) &&
+           less(otherBegin, end);
+}
+
+/**
+ * @return the number of scratch rows an operand of type E needs, including the row it is
+ * evaluated into
+ */
+template<class E>
+constexpr int operandScratchRows()
+{
+    return E::IS_LEAF ? 0 : E::SCRATCH_ROWS + 1;
+}
+
+/**
+ * counts an evaluation of an expression for the trace, nothing for a leaf, which is just read
+ * @param expr the expression
+ * @param elements the number of elements evaluated
+ */
+template<class E>
+void traceExpr(const E &expr, long long elements)
+{
+    if constexpr (!E::IS_LEAF)
+    {
+        expr.trace(elements);
+    }
+}
+
+/**
+ * finds row r of an operand, evaluating it into scratch if it is not a leaf
+ * @param expr the operand
+ * @param r the row index
+ * @param scratch the scratch memory of the operand, operandScratchRows<E>() rows
+ * @return the address of the row
+ */
+template<class E>
+const float *operandRow(const E &expr, int r, float *scratch)
+{
+    if constexpr (E::IS_LEAF)
+    {
+        return expr.rowData(r);
+    }
+    else
+    {
+        expr.evalRow(r, scratch, scratch + expr.getCols());
+        return scratch;
+    }
+}
+
+/**
+ * the elementwise sum of two expressions
+ */
+template<class L, class R>
+class MatrixSum : public MatrixExpr<MatrixSum<L, R>>
+{
+private:
+    typename ExprStorage<L>::type _lhs;
+    typename ExprStorage<R>::type _rhs;
+
+public:
+    static constexpr bool IS_LEAF = false;
+    static constexpr int SCRATCH_ROWS = operandScratchRows<L>() + operandScratchRows<R>();
+    static constexpr const char *NAME = "expr_add";
+    static constexpr int FLOPS = 1;
+
+    MatrixSum(const L &lhs, const R &rhs) : _lhs(lhs), _rhs(rhs)
+    {
+        if (lhs.getRows() != rhs.getRows() || lhs.getCols() != rhs.getCols())
+        {
+            std::cerr << EXPR_DIMENSIONS_ERR_MSG;
+            exit(1);
+        }
+    }
+
+    int getRows() const
+    {
+        return _lhs.getRows();
+    }
+
+    int getCols() const
+    {
+        return _lhs.getCols();
+    }
+
+    void evalRow(int r, float *out, float *scratch) const
+    {
+        const float *lhsRow = operandRow(_lhs, r, scratch);
+        const float *rhsRow = operandRow(_rhs, r, scratch + operandScratchRows<L>() * getCols());
+        kernels::add(out, lhsRow, rhsRow, (size_t) getCols());
+    }
+
+    void trace(long long elements) const
+    {
+        // an element of each operand is read and one is written
+        TRACE_COUNT(NAME, 0, 3 * elements, FLOPS * elements);
+        traceExpr(_lhs, elements);
+        traceExpr(_rhs, elements);
+    }
+
+    bool overlaps(const float *data, int rows, int cols, int pitch) const
+    {
+        return _lhs.overlaps(data, rows, cols, pitch) || _rhs.overlaps(data, rows, cols, pitch);
+    }
+};
+
+/**
+ * an expression multiplied by a scalar
+ */
+template<class E>
+class MatrixScaled : public MatrixExpr<MatrixScaled<E>>
+{
+private:
+    typename ExprStorage<E>::type _expr;
+    float _c;
+
+public:
+    static constexpr bool IS_LEAF = false;
+    static constexpr int SCRATCH_ROWS = operandScratchRows<E>();
+    static constexpr const char *NAME = "expr_mul_scalar";
+    static constexpr int FLOPS = 1;
+
+    MatrixScaled(const E &expr, float c) : _expr(expr), _c(c)
+    {
+    }
+
+    int getRows() const
+    {
+        return _expr.getRows();
+    }
+
+    int getCols() const
+    {
+        return _expr.getCols();
+    }
+
+    void evalRow(int r, float *out, float *scratch) const
+    {
+        kernels::mulScalar(out, operandRow(_expr, r, scratch), _c, (size_t) getCols());
+    }
+
+    void trace(long long elements) const
+    {
+        TRACE_COUNT(NAME, 0, 2 * elements, FLOPS * elements);
+        traceExpr(_expr, elements);
+    }
+
+    bool overlaps(const float *data, int rows, int cols, int pitch) const
+    {
+        return _expr.overlaps(data, rows, cols, pitch);
+    }
+};
+
+/**
+ * an expression divided by a scalar
+ */
+template<class E>
+class MatrixQuotient : public MatrixExpr<MatrixQuotient<E>>
+{
+private:
+    typename ExprStorage<E>::type _expr;
+    float _c;
+
+public:
+    static constexpr bool IS_LEAF = false;
+    static constexpr int SCRATCH_ROWS = operandScratchRows<E>();
+    static constexpr const char *NAME = "expr_div_scalar";
+    static constexpr int FLOPS = 1;
+
+    MatrixQuotient(const E &expr, float c) : _expr(expr), _c(c)
+    {
+        if (c == 0)
+        {
+            std::cerr << EXPR_DIVISION_ERR_MSG;
+            exit(1);
+        }
+    }
+
+    int getRows() const
+    {
+        return _expr.getRows();
+    }
+
+    int getCols() const
+    {
+        return _expr.getCols();
+    }
+
+    void evalRow(int r, float *out, float *scratch) const
+    {
+        kernels::divScalar(out, operandRow(_expr, r, scratch), _c, (size_t) getCols());
+    }
+
+    void trace(long long elements) const
+    {
+        TRACE_COUNT(NAME, 0, 2 * elements, FLOPS * elements);
+        traceExpr(_expr, elements);
+    }
+
+    bool overlaps(const float *data, int rows, int cols, int pitch) const
+    {
+        return _expr.overlaps(data, rows, cols, pitch);
+    }
+};
+
+/**
+ * sums two matrices, lazily
+ * @param lhs the lhs to add
+ * @param rhs the rhs to add
+ * @return an expression of the sum
+ */
+template<class L, class R>
+MatrixSum<L, R> operator+(const MatrixExpr<L> &lhs, const MatrixExpr<R> &rhs)
+{
+    return MatrixSum<L, R>(lhs.self(), rhs.self());
+}
+
+/**
+ * multiplies a matrix by a scalar, lazily
+ * @param matrix the matrix to multiply
+ * @param c a scalar to multiply by
+ * @return an expression of the multiplication
+ */
+template<class E>
+MatrixScaled<E> operator*(const MatrixExpr<E> &matrix, float c)
+{
+    return MatrixScaled<E>(matrix.self(), c);
+}
+
+/**
+ * multiplies a matrix by a scalar, lazily
+ * @param c a scalar to multiply by
+ * @param matrix the matrix to multiply
+ * @return an expression of the multiplication
+ */
+template<class E>
+MatrixScaled<E> operator*(float c, const MatrixExpr<E> &matrix)
+{
+    return MatrixScaled<E>(matrix.self(), c);
+}
+
+/**
+ * divides a matrix by a scalar, lazily
+ * @param matrix the matrix to divide
+ * @param c a scalar to divide by
+ * @return an expression of the division
+ */
+template<class E>
+MatrixQuotient<E> operator/(const MatrixExpr<E> &matrix, float c)
+{
+    return MatrixQuotient<E>(matrix.self(), c);
+}
+
+#endif //EX5_MATRIXEXPR_H
@@ -0,0 +1,294 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <iterator>
+#include "MatrixIO.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATRIX_IO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define BINARY_ERR_MSG "Error loading from input stream.\n"
+#define BINARY_FORMAT_ERR_MSG "Invalid binary matrix.\n"
+#define BINARY_WRITE_ERR_MSG "Error writing to output stream.\n"
+#define MAPPED_FILE_ERR_MSG "Error opening file.\n"
+// the bytes of the offsets of the version, the rows number and the columns number in the header
+#define VERSION_OFFSET 8
+#define ROWS_OFFSET 12
+#define COLS_OFFSET 16
+
+
+/**
+ * @return true if the host stores numbers in little endian byte order, as the format does
+ */
+static bool littleEndian()
+{
+    uint32_t one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+/**
+ * writes a 32 bit integer in little endian byte order
+ * @param dst the 4 bytes to write to
+ * @param value the integer
+ */
+static void storeWord(unsigned char *dst, uint32_t value)
+{
+    for (int b = 0; b < 4; ++ b)
+    {
+        dst[b] = (unsigned char) (value >> (8 * b));
+    }
+}
+
+/**
+ * reads a 32 bit integer in little endian byte order
+ * @param src the 4 bytes to read
+ * @return the integer
+ */
+static uint32_t loadWord(const unsigned char *src)
+{
+    uint32_t value = 0;
+    for (int b = 0; b < 4; ++ b)
+    {
+        value |= (uint32_t) src[b] << (8 * b);
+    }
+    return value;
+}
+
+/**
+ * reverses the bytes of every float of an array, between the byte orders
+ * @param data the array
+ * @param n the number of floats
+ */
+static void swapBytes(float *data, size_t n)
+{
+    for (size_t i = 0; i < n; ++ i)
+    {
+        uint32_t word;
+        memcpy(&word, data + i, 4);
+        word = (word >> 24) | ((word >> 8) & 0xFF00u) | ((word << 8) & 0xFF0000u) | (word << 24);
+        memcpy(data + i, &word, 4);
+    }
+}
+
+/**
+ * checks a header and reads the dimensions from it, exits if it is not a valid header. Either
+ * dimension may be 0, as that of a Matrix may, so every matrix writeBinary writes reads back.
+ * @param header the BINARY_HEADER_BYTES of the header
+ * @param rows set to the rows number
+ * @param cols set to the columns number
+ */
+static void parseHeader(const unsigned char *header, int &rows, int &cols)
+{
+    uint32_t r = loadWord(header + ROWS_OFFSET);
+    uint32_t c = loadWord(header + COLS_OFFSET);
+    if (memcmp(header, BINARY_MAGIC, BINARY_MAGIC_BYTES) != 0 ||
+        loadWord(header + VERSION_OFFSET) != BINARY_VERSION || r > INT32_MAX || c > INT32_MAX)
+    {
+        std::cerr << BINARY_FORMAT_ERR_MSG;
+        exit(1);
+    }
+    rows = (int) r;
+    cols = (int) c;
+}
+
+/**
+ * writes a matrix in the binary format, row by row
+ * @param ostream the stream to write to, opened in binary mode
+ * @param matrix the matrix to write
+ */
+void writeBinary(std::ostream &ostream, const Matrix &matrix)
+{
+    unsigned char header[BINARY_HEADER_BYTES] = {};
+    memcpy(header, BINARY_MAGIC, BINARY_MAGIC_BYTES);
+    storeWord(header + VERSION_OFFSET, BINARY_VERSION);
+    storeWord(header + ROWS_OFFSET, (uint32_t) matrix.getRows());
+    storeWord(header + COLS_OFFSET, (uint32_t) matrix.getCols());
+    ostream.write((const char *) header, BINARY_HEADER_BYTES);
+    bool swap = !littleEndian();
+    std::vector<float> row;
+    for (int r = 0; r < matrix.getRows(); ++ r)
+    {
+        const float *data = matrix.rowData(r);
+        if (swap)
+        {
+            row.assign(data, data + matrix.getCols());
+            swapBytes(row.data(), row.size());
+            data = row.data();
+        }
+        ostream.write((const char *) data, (std::streamsize) matrix.getCols() * sizeof(float));
+    }
+    if (!ostream)
+    {
+        std::cerr << BINARY_WRITE_ERR_MSG;
+        exit(1);
+    }
+}
+
+/**
+ * reads the header of a matrix in the binary format, exits if it is not a valid header
+ * @param istream the stream to read from
+ * @param rows set to the rows number
+ * @param cols set to the columns number
+ */
+static void readHeader(std::istream &istream, int &rows, int &cols)
+{
+    unsigned char header[BINARY_HEADER_BYTES];
+    if (!istream.read((char *) header, BINARY_HEADER_BYTES))
+    {
+        std::cerr << BINARY_ERR_MSG;
+        exit(1);
+    }
+    parseHeader(header, rows, cols);
+}
+
+/**
+ * reads a row of a matrix in the binary format, exits if the stream ends before it
+ * @param istream the stream to read from
+ * @param row the row to read into
+ * @param cols the columns number
+ */
+static void readRow(std::istream &istream, float *row, int cols)
+{
+    if (!istream.read((char *) row, (std::streamsize) cols * sizeof(float)))
+    {
+        std::cerr << BINARY_ERR_MSG;
+        exit(1);
+    }
+    if (!littleEndian())
+    {
+        swapBytes(row, (size_t) cols);
+    }
+}
+
+/**
+ * reads a matrix in the binary format straight into the rows of the matrix
+ * @param istream the stream to read from, opened in binary mode
+ * @return the matrix
+ */
+Matrix readBinary(std::istream &istream)
+{
+    int rows;
+    int cols;
+    readHeader(istream, rows, cols);
+    Matrix matrix(rows, cols, Matrix::NO_INIT);
+    for (int r = 0; r < rows; ++ r)
+    {
+        readRow(istream, matrix.rowData(r), cols);
+    }
+    return matrix;
+}
+
+/**
+ * fails to open the file: exits, or leaves the file empty and not open
+ * @param exitOnError whether to exit
+ */
+void MappedFile::_fail(bool exitOnError)
+{
+    if (exitOnError)
+    {
+        std::cerr << MAPPED_FILE_ERR_MSG;
+        exit(1);
+    }
+    _mapping = nullptr;
+    _bytes = 0;
+    _data = nullptr;
+    _open = false;
+}
+
+/**
+ * maps a file into memory, or reads it where there is no mmap
+ * @param path the path of the file
+ * @param exitOnError whether to exit if the file cannot be opened, rather than leave the object
+ * empty and isOpen() false
+ */
+MappedFile::MappedFile(const std::string &path, bool exitOnError) :
+        _mapping(nullptr), _bytes(0), _data(nullptr), _open(true)
+{
+#ifdef MATRIX_IO_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        _fail(exitOnError);
+        return;
+    }
+    _bytes = (size_t) status.st_size;
+    // an empty file cannot be mapped, and has no data to map
+    if (_bytes > 0)
+    {
+        _mapping = mmap(nullptr, _bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // the mapping keeps the file open by itself
+    close(fd);
+    if (_mapping == MAP_FAILED)
+    {
+        _fail(exitOnError);
+        return;
+    }
+    _data = (const unsigned char *) _mapping;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        _fail(exitOnError);
+        return;
+    }
+    _copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    _bytes = _copy.size();
+    _data = _copy.data();
+#endif
+}
+
+/**
+ * unmaps the file
+ */
+MappedFile::~MappedFile()
+{
+#ifdef MATRIX_IO_MMAP
+    if (_mapping != nullptr)
+    {
+        munmap(_mapping, _bytes);
+    }
+#endif
+}
+
+/**
+ * maps a file in the binary format. The header is checked against the size of the file, so a
+ * truncated file is an error rather than a fault when the view reads past its end.
+ * @param path the path of the file
+ */
+MappedMatrix::MappedMatrix(const std::string &path) : _file(path), _data(nullptr), _rows(0),
+                                                      _cols(0)
+{
+    if (_file.size() < BINARY_HEADER_BYTES)
+    {
+        std::cerr << BINARY_FORMAT_ERR_MSG;
+        exit(1);
+    }
+    parseHeader(_file.data(), _rows, _cols);
+    size_t elements = (size_t) _rows * _cols;
+    if (_file.size() < BINARY_HEADER_BYTES + elements * sizeof(float))
+    {
+        std::cerr << BINARY_FORMAT_ERR_MSG;
+        exit(1);
+    }
+    _data = (const float *) (_file.data() + BINARY_HEADER_BYTES);
+    if (!littleEndian())
+    {
+        _copy.assign(_data, _data + elements);
+        swapBytes(_copy.data(), elements);
+        _data = _copy.data();
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef EX5_MATRIXIO_H
+#define EX5_MATRIXIO_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "Matrix.h"
+#include "MatrixView.h"
+
+// the binary format is a header of BINARY_HEADER_BYTES, which keeps the data on a cache line,
+// followed by the rows of the matrix as little endian floats with no padding. The header holds
+// BINARY_MAGIC, and then the version, the rows number and the columns number as little endian
+// 32 bit integers, the rest of it being zeros.
+#define BINARY_MAGIC "EX5MTRX"
+#define BINARY_MAGIC_BYTES 8
+#define BINARY_VERSION 1
+#define BINARY_HEADER_BYTES 64
+
+/**
+ * writes a matrix in the binary format
+ * @param ostream the stream to write to, opened in binary mode
+ * @param matrix the matrix to write
+ */
+void writeBinary(std::ostream &ostream, const Matrix &matrix);
+
+/**
+ * reads a matrix in the binary format
+ * @param istream the stream to read from, opened in binary mode
+ * @return the matrix
+ */
+Matrix readBinary(std::istream &istream);
+
+/**
+ * a whole file mapped into memory, read only. The pages are read from the disk as they are
+ * touched. On systems without mmap the file is read into memory instead.
+ */
+class MappedFile
+{
+private:
+    // the mapping of the whole file, or nullptr if the file is empty or was read instead
+    void *_mapping;
+    size_t _bytes;
+    // the file when it is not mapped
+    std::vector<unsigned char> _copy;
+    const unsigned char *_data;
+    bool _open;
+
+    /**
+     * fails to open the file: exits, or leaves the file empty and not open
+     * @param exitOnError whether to exit
+     */
+    void _fail(bool exitOnError);
+
+public:
+    /**
+     * maps a file into memory
+     * @param path the path of the file
+     * @param exitOnError whether to exit if the file cannot be opened, rather than leave the
+     * object empty and isOpen() false
+     */
+    explicit MappedFile(const std::string &path, bool exitOnError = true);
+
+    /**
+     * unmaps the file
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @return the bytes of the file, valid as long as this object
+     */
+    const unsigned char *data() const
+    {
+        return _data;
+    }
+
+    /**
+     * @return the size of the file in bytes
+     */
+    size_t size() const
+    {
+        return _bytes;
+    }
+
+    /**
+     * @return true if the file was opened
+     */
+    bool isOpen() const
+    {
+        return _open;
+    }
+};
+
+/**
+ * a matrix in the binary format mapped into memory. The data of the file is used where it is, so
+ * opening a matrix of any size copies nothing, and the pages are read from the disk as the view
+ * touches them. On systems without mmap the file is read into memory, and on systems of big
+ * endian byte order the data is copied in the byte order of the host.
+ */
+class MappedMatrix
+{
+private:
+    MappedFile _file;
+    // the data in the byte order of the host, when it is not that of the file
+    std::vector<float> _copy;
+    const float *_data;
+    int _rows;
+    int _cols;
+
+public:
+    /**
+     * maps a file in the binary format
+     * @param path the path of the file
+     */
+    explicit MappedMatrix(const std::string &path);
+
+    /**
+     * @return the rows number of the matrix
+     */
+    int getRows() const
+    {
+        return _rows;
+    }
+
+    /**
+     * @return the columns number of the matrix
+     */
+    int getCols() const
+    {
+        return _cols;
+    }
+
+    /**
+     * @return a read only view of the matrix, valid as long as this object
+     */
+    ConstMatrixView view() const
+    {
+        return ConstMatrixView(_data, _rows, _cols, _cols, 1);
+    }
+};
+
+#endif //EX5_MATRIXIO_H
@@ -0,0 +1,406 @@
+#ifndef EX5_MATRIXVIEW_H
+#define EX5_MATRIXVIEW_H
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "Matrix.h"
+
+#define VIEW_INDEX_ERR_MSG "Index out of range.\n"
+#define VIEW_DIMENSIONS_ERR_MSG "Invalid Matrix dimensions.\n"
+
+
+/**
+ * a non owning view of elements of a Matrix. Element (i, j) of the view is at
+ * data[i * rowStride + j * colStride], so submatrices, single rows and columns and transposes
+ * are all views of the original data and never copy it. A view is an elementwise expression,
+ * so it can be an operand of the Matrix arithmetic operators and of the filters.
+ * The viewed matrix must outlive the view, and must not be resized while the view is used.
+ * @tparam T float for a view which can write to the matrix, const float for a read only view
+ */
+template<class T>
+class BasicMatrixView : public MatrixExpr<BasicMatrixView<T>>
+{
+private:
+    T *_data;
+    int _rows;
+    int _cols;
+    int _rowStride;
+    int _colStride;
+
+    /**
+     * exits if the given region is not inside the view
+     */
+    void _checkRegion(int row, int col, int rows, int cols) const
+    {
+        if (row < 0 || col < 0 || rows < 0 || cols < 0 || row + rows > _rows ||
+            col + cols > _cols)
+        {
+            std::cerr << VIEW_INDEX_ERR_MSG;
+            exit(1);
+        }
+    }
+
+    /**
+     * @param e an expression to evaluate into the view
+     * @return true if e reads any viewed element other than at its own position. A view with
+     * strides other than those of a matrix is described to e by the range of memory it spans, so
+     * any expression reading that range counts as overlapping it.
+     */
+    template<class E>
+    bool _overlappedBy(const E &e) const
+    {
+        if (_colStride == 1 && _rowStride >= _cols)
+        {
+            return e.overlaps(_data, _rows, _cols, _rowStride);
+        }
+        if (_rows == 0 || _cols == 0)
+        {
+            return false;
+        }
+        long rowSpan = (long) (_rows - 1) * _rowStride;
+        long colSpan = (long) (_cols - 1) * _colStride;
+        const T *first = _data + std::min(rowSpan, 0L) + std::min(colSpan, 0L);
+        int span = (int) (std::abs(rowSpan) + std::abs(colSpan) + 1);
+        return e.overlaps(first, 1, span, span);
+    }
+
+public:
+    static constexpr bool IS_LEAF = false;
+    static constexpr int SCRATCH_ROWS = 0;
+    static constexpr const char *NAME = "expr_view";
+    static constexpr int FLOPS = 0;
+
+    /**
+     * constructs a view of a strided block of memory
+     * @param data the address of element (0, 0)
+     * @param rows the number of rows
+     * @param cols the number of columns
+     * @param rowStride the distance in elements between two rows
+     * @param colStride the distance in elements between two columns
+     */
+    BasicMatrixView(T *data, int rows, int cols, int rowStride, int colStride) :
+            _data(data), _rows(rows), _cols(cols), _rowStride(rowStride), _colStride(colStride)
+    {
+    }
+
+    /**
+     * constructs a view of a whole matrix
+     * @param matrix the matrix to view
+     */
+    BasicMatrixView(Matrix &matrix) :
+            BasicMatrixView(matrix.data(), matrix.getRows(), matrix.getCols(), matrix.pitch(), 1)
+    {
+    }
+
+    /**
+     * constructs a read only view of a whole matrix
+     * @param matrix the matrix to view
+     */
+    template<class U = T, class = typename std::enable_if<std::is_const<U>::value>::type>
+    BasicMatrixView(const Matrix &matrix) :
+            BasicMatrixView(matrix.data(), matrix.getRows(), matrix.getCols(), matrix.pitch(), 1)
+    {
+    }
+
+    /**
+     * converts a writable view into a read only one
+     * @param other the view to convert
+     */
+    template<class U, class = typename std::enable_if<std::is_const<T>::value &&
+                                                      !std::is_const<U>::value>::type>
+    BasicMatrixView(const BasicMatrixView<U> &other) :
+            BasicMatrixView(other.data(), other.getRows(), other.getCols(), other.rowStride(),
+                            other.colStride())
+    {
+    }
+
+    /**
+     * @return the number of rows of the view
+     */
+    int getRows() const
+    {
+        return _rows;
+    }
+
+    /**
+     * @return the number of columns of the view
+     */
+    int getCols() const
+    {
+        return _cols;
+    }
+
+    /**
+     * @return the distance in elements between two rows
+     */
+    int rowStride() const
+    {
+        return _rowStride;
+    }
+
+    /**
+     * @return the distance in elements between two columns
+     */
+    int colStride() const
+    {
+        return _colStride;
+    }
+
+    /**
+     * @return the address of element (0, 0)
+     */
+    T *data() const
+    {
+        return _data;
+    }
+
+    /**
+     * @return true if every row is contiguous in memory, false otherwise
+     */
+    bool contiguousRows() const
+    {
+        return (_colStride == 1);
+    }
+
+    /**
+     * accesses an element of the view
+     * @param i rows index
+     * @param j columns index
+     * @return the element in the [i][j] index of the view
+     */
+    T &operator()(int i, int j) const
+    {
+        if (i < 0 || j < 0 || i >= _rows || j >= _cols)
+        {
+            std::cerr << VIEW_INDEX_ERR_MSG;
+            exit(1);
+        }
+        return _data[(long) i * _rowStride + (long) j * _colStride];
+    }
+
+    /**
+     * accesses an element of the view without checking the indices
+     * @param i rows index
+     * @param j columns index
+     * @return the element in the [i][j] index of the view
+     */
+    T &at(int i, int j) const
+    {
+        return _data[(long) i * _rowStride + (long) j * _colStride];
+    }
+
+    /**
+     * a rectangular part of the view
+     * @param row the first row of the part
+     * @param col the first column of the part
+     * @param rows the number of rows of the part
+     * @param cols the number of columns of the part
+     * @return a view of the part
+     */
+    BasicMatrixView submatrix(int row, int col, int rows, int cols) const
+    {
+        _checkRegion(row, col, rows, cols);
+        return BasicMatrixView(&at(row, col), rows, cols, _rowStride, _colStride);
+    }
+
+    /**
+     * @param i the row index
+     * @return a 1 x cols view of row i
+     */
+    BasicMatrixView row(int i) const
+    {
+        return submatrix(i, 0, 1, _cols);
+    }
+
+    /**
+     * @param j the column index
+     * @return a rows x 1 view of column j
+     */
+    BasicMatrixView column(int j) const
+    {
+        return submatrix(0, j, _rows, 1);
+    }
+
+    /**
+     * @return a cols x rows view in which element (i, j) is element (j, i) of this view
+     */
+    BasicMatrixView transpose() const
+    {
+        return BasicMatrixView(_data, _cols, _rows, _colStride, _rowStride);
+    }
+
+    /**
+     * views the same elements, read row after row, with other dimensions. Only a view whose
+     * elements are contiguous in memory can be reshaped.
+     * @param rows the new number of rows
+     * @param cols the new number of columns
+     * @return the reshaped view
+     */
+    BasicMatrixView reshape(int rows, int cols) const
+    {
+        bool contiguous = (_colStride == 1 && (_rowStride == _cols || _rows <= 1));
+        if (!contiguous || rows < 0 || cols < 0 || (long) rows * cols != (long) _rows * _cols)
+        {
+            std::cerr << VIEW_DIMENSIONS_ERR_MSG;
+            exit(1);
+        }
+        return BasicMatrixView(_data, rows, cols, cols, 1);
+    }
+
+    /**
+     * copies a row, used when the view is evaluated as an expression
+     * @param r the row index
+     * @param out the row to copy into
+     */
+    void evalRow(int r, float *out, float *) const
+    {
+        const T *src = _data + (long) r * _rowStride;
+        if (_colStride == 1)
+        {
+            kernels::copy(out, src, (size_t) _cols);
+            return;
+        }
+        for (int j = 0; j < _cols; ++ j)
+        {
+            out[j] = src[(long) j * _colStride];
+        }
+    }
+
+    /**
+     * counts an evaluation of the view as an expression for the trace, a copy of its elements
+     * @param elements the number of elements evaluated
+     */
+    void trace(long long elements) const
+    {
+        // unused without -DMATRIX_TRACE
+        (void) elements;
+        TRACE_COUNT(NAME, 0, 2 * elements, FLOPS * elements);
+    }
+
+    /**
+     * @param data the first element of a matrix an expression of the view is evaluated into
+     * @param rows the rows number of that matrix
+     * @param cols the columns number of that matrix
+     * @param pitch the row pitch of that matrix
+     * @return true if the viewed elements share memory with that matrix at other positions
+     */
+    bool overlaps(const float *data, int rows, int cols, int pitch) const
+    {
+        if (_data == data && _rows == rows && _cols == cols && _rowStride == pitch &&
+            _colStride == 1)
+        {
+            return false;
+        }
+        if (_rows == 0 || _cols == 0)
+        {
+            return false;
+        }
+        // the lowest and the highest element the view reads, for strides of either sign
+        long rowSpan = (long) (_rows - 1) * _rowStride;
+        long colSpan = (long) (_cols - 1) * _colStride;
+        const T *first = _data + std::min(rowSpan, 0L) + std::min(colSpan, 0L);
+        const T *last = _data + std::max(rowSpan, 0L) + std::max(colSpan, 0L);
+        return memoryOverlaps(first, last + 1, data, data + (size_t) rows * pitch);
+    }
+
+    /**
+     * evaluates an elementwise expression into the viewed elements. An expression reading the
+     * view other than at the positions it writes, as a transpose of it or a shifted submatrix of
+     * the same matrix does, is evaluated into a new matrix first, which is then copied in.
+     * @param expr an expression of the dimensions of the view
+     * @return the view
+     */
+    template<class E>
+    const BasicMatrixView &assign(const MatrixExpr<E> &expr) const
+    {
+        static_assert(!std::is_const<T>::value, "A read only view cannot be assigned to.");
+        const E &e = expr.self();
+        if (e.getRows() != _rows || e.getCols() != _cols)
+        {
+            std::cerr << VIEW_DIMENSIONS_ERR_MSG;
+            exit(1);
+        }
+        if (_overlappedBy(e))
+        {
+            return assign(Matrix(e));
+        }
+        traceExpr(e, (long long) _rows * _cols);
+        BasicMatrixView view = *this;
+        parallelRows(_rows, _cols, [&e, view](int lo, int hi)
+        {
+            std::vector<float> scratch((size_t) (E::SCRATCH_ROWS + 1) * view._cols);
+            for (int r = lo; r < hi; ++ r)
+            {
+                float *dst = view._data + (long) r * view._rowStride;
+                if (view._colStride == 1)
+                {
+                    e.evalRow(r, dst, scratch.data());
+                    continue;
+                }
+                float *out = scratch.data() + (size_t) E::SCRATCH_ROWS * view._cols;
+                e.evalRow(r, out, scratch.data());
+                for (int j = 0; j < view._cols; ++ j)
+                {
+                    dst[(long) j * view._colStride] = out[j];
+                }
+            }
+        });
+        return *this;
+    }
+
+    /**
+     * adds an elementwise expression to the viewed elements
+     * @param expr an expression of the dimensions of the view
+     * @return the view
+     */
+    template<class E>
+    const BasicMatrixView &operator+=(const MatrixExpr<E> &expr) const
+    {
+        return assign(*this + expr);
+    }
+
+    /**
+     * adds a scalar to the viewed elements
+     * @param c the scalar to add
+     * @return the view
+     */
+    const BasicMatrixView &operator+=(float c) const
+    {
+        for (int i = 0; i < _rows; ++ i)
+        {
+            for (int j = 0; j < _cols; ++ j)
+            {
+                at(i, j) += c;
+            }
+        }
+        return *this;
+    }
+
+    /**
+     * multiplies the viewed elements by a scalar
+     * @param c the scalar to multiply by
+     * @return the view
+     */
+    const BasicMatrixView &operator*=(float c) const
+    {
+        return assign(*this * c);
+    }
+
+    /**
+     * divides the viewed elements by a scalar
+     * @param c the scalar to divide by
+     * @return the view
+     */
+    const BasicMatrixView &operator/=(float c) const
+    {
+        return assign(*this / c);
+    }
+};
+
+typedef BasicMatrixView<float> MatrixView;
+typedef BasicMatrixView<const float> ConstMatrixView;
+
+#endif //EX5_MATRIXVIEW_H
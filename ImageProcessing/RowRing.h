@@ -0,0 +1,54 @@
+#ifndef EX5_ROWRING_H
+#define EX5_ROWRING_H
+
+#include <vector>
+#include <limits>
+
+/**
+ * the rows a sliding window over an image needs, each computed once. Rows are keyed by their
+ * index before any border mapping, and the window never spans more rows than there are slots,
+ * so the rows of a window never evict each other. The rows start as zeros, so elements a fill
+ * never writes stay zero.
+ */
+class RowRing
+{
+private:
+    std::vector<float> _rows;
+    std::vector<int> _keys;
+    int _slots;
+    int _length;
+
+public:
+    /**
+     * constructs an empty ring
+     * @param slots the number of rows the ring holds
+     * @param length the number of elements of a row
+     */
+    RowRing(int slots, int length) : _rows((size_t) slots * length),
+                                     _keys((size_t) slots, std::numeric_limits<int>::min()),
+                                     _slots(slots), _length(length)
+    {
+    }
+
+    /**
+     * finds a row, computing it if it is not in the ring
+     * @tparam Fill a callable which writes the row into the float * it is given
+     * @param key the index of the row
+     * @param fill computes the row
+     * @return the row
+     */
+    template<class Fill>
+    const float *get(int key, Fill fill)
+    {
+        int slot = ((key % _slots) + _slots) % _slots;
+        float *row = _rows.data() + (size_t) slot * _length;
+        if (_keys[slot] != key)
+        {
+            fill(row);
+            _keys[slot] = key;
+        }
+        return row;
+    }
+};
+
+#endif //EX5_ROWRING_H
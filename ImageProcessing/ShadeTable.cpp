@@ -0,0 +1,249 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "ShadeTable.h"
+#include "ThreadPool.h"
+#include "Kernels.h"
+
+#define TABLE_SHADES_ERR_MSG "Invalid number of table shades.\n"
+
+
+/**
+ * quantizes a single shade
+ * @param curVal the shade to quantize
+ * @param scaleRange the number of shades mapped to the same level
+ * @return the quantized shade
+ */
+static float quantizeValue(float curVal, int scaleRange)
+{
+    int j = 0;
+    int destRange = 0;
+    while ((j + scaleRange - 1) < SHADES)
+    {
+        if (curVal >= (float )j && curVal <= (float )j + (float )scaleRange-1)
+        {
+            destRange = j;
+            break;
+        }
+        j += scaleRange ;
+    }
+    return floorf(((float )destRange + (float )(destRange + scaleRange - 1)) / 2);
+}
+
+/**
+ * rounds a value to the nearest shade
+ * @param value the value
+ * @return the value rounded and clamped to [0, SHADES - 1]
+ */
+static float roundShade(float value)
+{
+    return std::min(std::max(rintf(value), 0.f), (float) (SHADES - 1));
+}
+
+/**
+ * constructs the identity table
+ * @param shades the number of shades the table covers, from SHADES to MAX_TABLE_SHADES
+ */
+ShadeTable::ShadeTable(int shades)
+{
+    if (shades < SHADES || shades > MAX_TABLE_SHADES)
+    {
+        std::cerr << TABLE_SHADES_ERR_MSG;
+        exit(1);
+    }
+    _table.resize((size_t) shades);
+    for (int shade = 0; shade < shades; ++ shade)
+    {
+        _table[shade] = (float) shade;
+    }
+    _fillBytes();
+}
+
+/**
+ * compiles a function into a table
+ * @param function the function of a shade
+ * @param shades the number of shades the table covers, from SHADES to MAX_TABLE_SHADES
+ */
+ShadeTable::ShadeTable(const Function &function, int shades) : ShadeTable(shades)
+{
+    _functions.push_back(function);
+    for (int shade = 0; shade < shades; ++ shade)
+    {
+        _table[shade] = function((float) shade);
+    }
+    _fillBytes();
+}
+
+/**
+ * fills _bytes from the first SHADES elements of _table
+ */
+void ShadeTable::_fillBytes()
+{
+    _bytes.resize(SHADES);
+    for (int shade = 0; shade < SHADES; ++ shade)
+    {
+        _bytes[shade] = saturateCast<uint8_t>(_table[shade]);
+    }
+}
+
+/**
+ * @param levels the wanted level of shades
+ * @return the table of quantization(), see there
+ */
+ShadeTable ShadeTable::quantization(int const levels)
+{
+    int scaleRange = (SHADES / levels) ;
+    return ShadeTable([scaleRange](float value)
+    {
+        return quantizeValue(value, scaleRange);
+    });
+}
+
+/**
+ * @param gamma the exponent, positive
+ * @return the table of 255 * (shade / 255) ^ gamma, rounded and clamped to the shades
+ */
+ShadeTable ShadeTable::gamma(float gamma)
+{
+    return ShadeTable([gamma](float value)
+    {
+        float top = (float) (SHADES - 1);
+        return roundShade(top * powf(std::max(value, 0.f) / top, gamma));
+    });
+}
+
+/**
+ * @param level the least shade which becomes white
+ * @return the table of 255 for the shades of at least level and 0 for the rest
+ */
+ShadeTable ShadeTable::threshold(float level)
+{
+    return ShadeTable([level](float value)
+    {
+        return value >= level ? (float) (SHADES - 1) : 0.f;
+    });
+}
+
+/**
+ * @param low the shade which becomes 0
+ * @param high the shade which becomes 255, above low
+ * @return the table which maps [low, high] linearly onto the shades, rounded and clamped
+ */
+ShadeTable ShadeTable::contrastStretch(float low, float high)
+{
+    float scale = (float) (SHADES - 1) / (high - low);
+    return ShadeTable([low, scale](float value)
+    {
+        return roundShade((value - low) * scale);
+    });
+}
+
+/**
+ * @param low the least shade kept
+ * @param high the largest shade kept
+ * @return the table which clamps the shades to [low, high]
+ */
+ShadeTable ShadeTable::clamp(float low, float high)
+{
+    return ShadeTable([low, high](float value)
+    {
+        return std::min(std::max(value, low), high);
+    });
+}
+
+/**
+ * composes two tables. Every shade of this table is looked up in next, so the composed table
+ * costs a single lookup however many tables it was composed of.
+ * @param next the table applied on the results of this one
+ * @return the table of this one followed by next, covering the shades of this one
+ */
+ShadeTable ShadeTable::then(const ShadeTable &next) const
+{
+    ShadeTable composed(*this);
+    composed._functions.insert(composed._functions.end(), next._functions.begin(),
+                               next._functions.end());
+    for (float &value : composed._table)
+    {
+        value = next(value);
+    }
+    composed._fillBytes();
+    return composed;
+}
+
+/**
+ * @param value a shade, or any other value
+ * @return the value of the functions on it
+ */
+float ShadeTable::operator()(float value) const
+{
+    float result;
+    if (kernels::lookup(&result, &value, _table.data(), shades(), 1) == 1)
+    {
+        return result;
+    }
+    for (const Function &function : _functions)
+    {
+        value = function(value);
+    }
+    return value;
+}
+
+/**
+ * applies the table on a span of a row. The shades are looked up by the vector kernels, and the
+ * rare element which is not a shade is computed by the functions.
+ * @param dst the output span, may be src
+ * @param src the input span
+ * @param n the number of elements of the spans
+ */
+void ShadeTable::apply(float *dst, const float *src, int n) const
+{
+    size_t i = 0;
+    while (i < (size_t) n)
+    {
+        i += kernels::lookup(dst + i, src + i, _table.data(), shades(), (size_t) n - i);
+        if (i < (size_t) n)
+        {
+            dst[i] = (*this)(src[i]);
+            ++ i;
+        }
+    }
+}
+
+/**
+ * applies the table on an image
+ * @param image a matrix, or a view of one, representing the image
+ * @return the image after the table
+ */
+Matrix ShadeTable::apply(ConstMatrixView image) const
+{
+    Matrix result(image.getRows(), image.getCols(), Matrix::NO_INIT);
+    parallelRows(image.getRows(), image.getCols(), [&](int lo, int hi)
+    {
+        for (int i = lo; i < hi; ++ i)
+        {
+            float *row = result.rowData(i);
+            image.evalRow(i, row, nullptr);
+            apply(row, row, image.getCols());
+        }
+    });
+    return result;
+}
+
+/**
+ * applies the table on a byte image, with the results saturated to bytes
+ * @param image the byte image
+ * @return the byte image after the table
+ */
+ByteMatrix ShadeTable::apply(const ByteMatrix &image) const
+{
+    ByteMatrix result(image.getRows(), image.getCols());
+    const uint8_t *src = image.data();
+    uint8_t *dst = result.data();
+    parallelRows(image.getRows(), image.getCols(), [&](int lo, int hi)
+    {
+        long first = (long) lo * image.getCols();
+        long last = (long) hi * image.getCols();
+        kernels::lookupBytes(dst + first, src + first, _bytes.data(), (size_t) (last - first));
+    });
+    return result;
+}
@@ -0,0 +1,141 @@
+#ifndef EX5_SHADETABLE_H
+#define EX5_SHADETABLE_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "TypedMatrix.h"
+
+#define SHADES 256
+// the largest table, for images of 16 bit shades
+#define MAX_TABLE_SHADES 65536
+
+/**
+ * a function of a single shade, such as quantization, gamma or a threshold, compiled into a table
+ * of its value on every shade, so applying it is a single lookup per pixel. Tables compose: a
+ * table followed by another is a single table of both.
+ * Elements of float images which are not shades, fractions or values out of the range of the
+ * table, are computed by the functions themselves, so the result is always that of the functions.
+ */
+class ShadeTable
+{
+public:
+    /**
+     * a function of a single shade
+     */
+    typedef std::function<float(float)> Function;
+
+private:
+    // the functions, first to last, for the elements which are not shades
+    std::vector<Function> _functions;
+    // the value of the functions on every shade
+    std::vector<float> _table;
+    // the values of _table saturated to bytes, for byte images
+    std::vector<int32_t> _bytes;
+
+    /**
+     * fills _bytes from the first SHADES elements of _table
+     */
+    void _fillBytes();
+
+public:
+    /**
+     * constructs the identity table
+     * @param shades the number of shades the table covers, from SHADES to MAX_TABLE_SHADES
+     */
+    explicit ShadeTable(int shades = SHADES);
+
+    /**
+     * compiles a function into a table
+     * @param function the function of a shade
+     * @param shades the number of shades the table covers, from SHADES to MAX_TABLE_SHADES
+     */
+    explicit ShadeTable(const Function &function, int shades = SHADES);
+
+    /**
+     * @param levels the wanted level of shades
+     * @return the table of quantization(), see there
+     */
+    static ShadeTable quantization(int levels);
+
+    /**
+     * @param gamma the exponent, positive
+     * @return the table of 255 * (shade / 255) ^ gamma, rounded and clamped to the shades
+     */
+    static ShadeTable gamma(float gamma);
+
+    /**
+     * @param level the least shade which becomes white
+     * @return the table of 255 for the shades of at least level and 0 for the rest
+     */
+    static ShadeTable threshold(float level);
+
+    /**
+     * @param low the shade which becomes 0
+     * @param high the shade which becomes 255, above low
+     * @return the table which maps [low, high] linearly onto the shades, rounded and clamped
+     */
+    static ShadeTable contrastStretch(float low, float high);
+
+    /**
+     * @param low the least shade kept
+     * @param high the largest shade kept
+     * @return the table which clamps the shades to [low, high]
+     */
+    static ShadeTable clamp(float low, float high);
+
+    /**
+     * @return true if the table is the identity
+     */
+    bool isIdentity() const
+    {
+        return _functions.empty();
+    }
+
+    /**
+     * @return the number of shades the table covers
+     */
+    int shades() const
+    {
+        return (int) _table.size();
+    }
+
+    /**
+     * composes two tables
+     * @param next the table applied on the results of this one
+     * @return the table of this one followed by next, covering the shades of this one
+     */
+    ShadeTable then(const ShadeTable &next) const;
+
+    /**
+     * @param value a shade, or any other value
+     * @return the value of the functions on it
+     */
+    float operator()(float value) const;
+
+    /**
+     * applies the table on a span of a row
+     * @param dst the output span, may be src
+     * @param src the input span
+     * @param n the number of elements of the spans
+     */
+    void apply(float *dst, const float *src, int n) const;
+
+    /**
+     * applies the table on an image
+     * @param image a matrix, or a view of one, representing the image
+     * @return the image after the table
+     */
+    Matrix apply(ConstMatrixView image) const;
+
+    /**
+     * applies the table on a byte image, with the results saturated to bytes
+     * @param image the byte image
+     * @return the byte image after the table
+     */
+    ByteMatrix apply(const ByteMatrix &image) const;
+};
+
+#endif //EX5_SHADETABLE_H
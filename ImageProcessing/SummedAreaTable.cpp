@@ -0,0 +1,308 @@
+#include <iostream>
+#include <algorithm>
+#include "SummedAreaTable.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#define SQUARES_ERR_MSG "Summed area table built without squares.\n"
+
+
+/**
+ * writes a row of the table: the sums of the elements of a row from its start, or of their
+ * squares, added to the row of the table above
+ * @param src the first element of the row
+ * @param step the distance in elements between two columns
+ * @param cols the columns number of the row
+ * @param square whether to sum the squares of the elements
+ * @param above the row of the table above, zeros to write just the sums of the row
+ * @param row the row of the table, the sum of the first x elements is added to above[x] into
+ * row[x]
+ */
+static void prefixRow(const float *src, int step, int cols, bool square, const double *above,
+                      double *row)
+{
+    double sum = 0;
+    row[0] = 0;
+    if (square)
+    {
+        for (int x = 0; x < cols; ++ x)
+        {
+            double value = src[(long) x * step];
+            sum += value * value;
+            row[x + 1] = above[x + 1] + sum;
+        }
+        return;
+    }
+    for (int x = 0; x < cols; ++ x)
+    {
+        sum += src[(long) x * step];
+        row[x + 1] = above[x + 1] + sum;
+    }
+}
+
+/**
+ * adds a row of the table to the row below it, over a range of columns
+ * @param above the row above
+ * @param row the row, holding the sums of its own elements
+ * @param lo the first column
+ * @param hi one past the last column
+ */
+static void accumulateRow(const double *above, double *row, int lo, int hi)
+{
+    for (int x = lo; x < hi; ++ x)
+    {
+        row[x] += above[x];
+    }
+}
+
+/**
+ * builds the table of a matrix, see build()
+ * @param image a matrix, or a view of one
+ * @param squares whether to keep the sums of the squares too, needed by squareSum() and
+ * variance()
+ */
+SummedAreaTable::SummedAreaTable(ConstMatrixView image, bool squares) :
+        _rows(0), _cols(0), _hasSquares(false)
+{
+    build(image, squares);
+}
+
+/**
+ * builds the table of a matrix in place. Small matrices are summed in a single pass, the sums of
+ * every row added to the row above as soon as they are written. Large ones are summed in two: the
+ * rows are independent so a band of them per thread writes their sums, then a band of columns per
+ * thread adds them down. Every entry is written, so the memory is not cleared first.
+ * @param image a matrix, or a view of one
+ * @param squares whether to keep the sums of the squares too
+ */
+void SummedAreaTable::build(ConstMatrixView image, bool squares)
+{
+    TRACE_SPAN("summed_area_table");
+    _rows = image.getRows();
+    _cols = image.getCols();
+    _hasSquares = squares;
+    size_t pitch = (size_t) _cols + 1;
+    size_t entries = ((size_t) _rows + 1) * pitch;
+    TRACE_COUNT("summed_area_table", 0, (long long) (_rows * pitch + entries * (squares ? 2 : 1)),
+                (long long) _rows * _cols * (squares ? 5 : 2));
+    _sums.resize(entries);
+    std::fill(_sums.begin(), _sums.begin() + pitch, 0.0);
+    if (squares)
+    {
+        _squares.resize(entries);
+        std::fill(_squares.begin(), _squares.begin() + pitch, 0.0);
+    }
+    // writes rows [lo, hi) of the table, added to the rows above if fused and to zeros otherwise
+    auto prefixRows = [&](int lo, int hi, bool fused)
+    {
+        for (int r = lo; r < hi; ++ r)
+        {
+            size_t row = (r + 1) * pitch;
+            size_t above = fused ? row - pitch : 0;
+            const float *src = &image.at(r, 0);
+            prefixRow(src, image.colStride(), _cols, false, &_sums[above], &_sums[row]);
+            if (squares)
+            {
+                prefixRow(src, image.colStride(), _cols, true, &_squares[above], &_squares[row]);
+            }
+        }
+    };
+    if (_rows == 0 || _cols == 0)
+    {
+        return;
+    }
+    long long elements = (long long) _rows * _cols;
+    if (elements < 2LL * PARALLEL_MIN_ELEMENTS || ThreadPool::instance().size() == 1)
+    {
+        prefixRows(0, _rows, true);
+        return;
+    }
+    parallelRows(_rows, _cols, [&](int lo, int hi)
+    {
+        prefixRows(lo, hi, false);
+    });
+    // a band of columns per thread walks down every row, the bands wide enough to be worth a task
+    int minCols = std::max(1, PARALLEL_MIN_ELEMENTS / _rows);
+    ThreadPool::instance().parallelFor(0, (int) pitch, minCols, [&](int lo, int hi)
+    {
+        for (int r = 1; r < _rows; ++ r)
+        {
+            size_t row = (r + 1) * pitch;
+            accumulateRow(&_sums[row - pitch], &_sums[row], lo, hi);
+            if (squares)
+            {
+                accumulateRow(&_squares[row - pitch], &_squares[row], lo, hi);
+            }
+        }
+    });
+}
+
+/**
+ * clips a rectangle to the matrix
+ * @return false if nothing of the rectangle is inside of the matrix
+ */
+bool SummedAreaTable::_clip(int &top, int &left, int &bottom, int &right) const
+{
+    top = std::max(top, 0);
+    left = std::max(left, 0);
+    bottom = std::min(bottom, _rows);
+    right = std::min(right, _cols);
+    return top < bottom && left < right;
+}
+
+/**
+ * @param top the first row of the rectangle
+ * @param left the first column of the rectangle
+ * @param bottom one past the last row of the rectangle
+ * @param right one past the last column of the rectangle
+ * @return the sum of the elements of the rectangle inside of the matrix
+ */
+double SummedAreaTable::sum(int top, int left, int bottom, int right) const
+{
+    if (!_clip(top, left, bottom, right))
+    {
+        return 0;
+    }
+    return _rectangle(_sums, top, left, bottom, right);
+}
+
+/**
+ * @param top the first row of the rectangle
+ * @param left the first column of the rectangle
+ * @param bottom one past the last row of the rectangle
+ * @param right one past the last column of the rectangle
+ * @return the sum of the squares of the elements of the rectangle inside of the matrix, exits
+ * if the table was built without squares
+ */
+double SummedAreaTable::squareSum(int top, int left, int bottom, int right) const
+{
+    if (!hasSquares())
+    {
+        std::cerr << SQUARES_ERR_MSG;
+        exit(1);
+    }
+    if (!_clip(top, left, bottom, right))
+    {
+        return 0;
+    }
+    return _rectangle(_squares, top, left, bottom, right);
+}
+
+/**
+ * writes the differences of two rows of a table over the boxes of a span. The boxes of the columns
+ * near the borders are clipped one by one, those in between are a loop the compiler vectorizes.
+ * @param top the row of the table above the boxes
+ * @param bottom the row of the table below the boxes
+ * @param cols the columns number of the matrix
+ * @param left the first column of the span
+ * @param right one past the last column of the span
+ * @param radius the elements of a box to each side of its center
+ * @param out the sum of the box of column x is written to out[x - left]
+ */
+static void spanSums(const double *top, const double *bottom, int cols, int left, int right,
+                     int radius, double *out)
+{
+    // the columns whose boxes are inside of the matrix
+    int first = std::min(std::max(left, radius), right);
+    int last = std::max(std::min(right, cols - radius), first);
+    auto clipped = [&](int x)
+    {
+        int a = std::max(x - radius, 0);
+        int b = std::min(x + radius + 1, cols);
+        out[x - left] = (bottom[b] - top[b]) - (bottom[a] - top[a]);
+    };
+    for (int x = left; x < first; ++ x)
+    {
+        clipped(x);
+    }
+    for (int x = first; x < last; ++ x)
+    {
+        int a = x - radius;
+        int b = x + radius + 1;
+        out[x - left] = (bottom[b] - top[b]) - (bottom[a] - top[a]);
+    }
+    for (int x = last; x < right; ++ x)
+    {
+        clipped(x);
+    }
+}
+
+/**
+ * the sums of the boxes around a span of a row, as boxSum() of each of its elements but
+ * clipping the boxes once for the whole span, see spanSums
+ * @param row the row of the centers of the boxes
+ * @param left the first column of the span
+ * @param right one past the last column of the span
+ * @param radius the elements of a box to each side of its center, 0 or more
+ * @param sums the sum of the box of column x is written to sums[x - left]
+ * @param squares as sums for the sums of the squares, or nullptr. The table must keep them if
+ * given.
+ */
+void SummedAreaTable::boxSums(int row, int left, int right, int radius, double *sums,
+                              double *squares) const
+{
+    if (squares != nullptr && !hasSquares())
+    {
+        std::cerr << SQUARES_ERR_MSG;
+        exit(1);
+    }
+    size_t pitch = (size_t) _cols + 1;
+    size_t top = (size_t) std::min(std::max(row - radius, 0), _rows) * pitch;
+    size_t bottom = (size_t) std::max(std::min(row + radius + 1, _rows), 0) * pitch;
+    spanSums(&_sums[top], &_sums[bottom], _cols, left, right, radius, sums);
+    if (squares != nullptr)
+    {
+        spanSums(&_squares[top], &_squares[bottom], _cols, left, right, radius, squares);
+    }
+}
+
+/**
+ * @param row the row of the center of the box
+ * @param col the column of the center of the box
+ * @param radius the elements of the box to each side of its center, 0 or more
+ * @return the mean of the elements of the box inside of the matrix, 0 if there are none
+ */
+double SummedAreaTable::mean(int row, int col, int radius) const
+{
+    int top = row - radius;
+    int left = col - radius;
+    int bottom = row + radius + 1;
+    int right = col + radius + 1;
+    if (!_clip(top, left, bottom, right))
+    {
+        return 0;
+    }
+    double area = (double) (bottom - top) * (right - left);
+    return _rectangle(_sums, top, left, bottom, right) / area;
+}
+
+/**
+ * the variance as the mean of the squares less the square of the mean. The sums of integer
+ * shades are exact, so the difference is accurate to far below a shade, and it is clamped at 0
+ * against the rounding of fractional values.
+ * @param row the row of the center of the box
+ * @param col the column of the center of the box
+ * @param radius the elements of the box to each side of its center, 0 or more
+ * @return the variance of the elements of the box inside of the matrix, 0 if there are none.
+ * Exits if the table was built without squares.
+ */
+double SummedAreaTable::variance(int row, int col, int radius) const
+{
+    if (!hasSquares())
+    {
+        std::cerr << SQUARES_ERR_MSG;
+        exit(1);
+    }
+    int top = row - radius;
+    int left = col - radius;
+    int bottom = row + radius + 1;
+    int right = col + radius + 1;
+    if (!_clip(top, left, bottom, right))
+    {
+        return 0;
+    }
+    double area = (double) (bottom - top) * (right - left);
+    double mean = _rectangle(_sums, top, left, bottom, right) / area;
+    double meanSquare = _rectangle(_squares, top, left, bottom, right) / area;
+    return std::max(meanSquare - mean * mean, 0.0);
+}
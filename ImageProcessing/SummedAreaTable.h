@@ -0,0 +1,161 @@
+#ifndef EX5_SUMMEDAREATABLE_H
+#define EX5_SUMMEDAREATABLE_H
+
+#include <vector>
+#include "MatrixView.h"
+
+/**
+ * the summed area table, or integral image, of a matrix: every entry is the sum of the elements
+ * above and to the left of it, so the sum of any rectangle is read from its four corners in
+ * constant time whatever its size. The sums are kept in double, exact for integer shades of images
+ * up to 2^53 / 255^2 pixels, and the table can keep the sums of the squares of the elements too,
+ * for the variance of a rectangle.
+ * Rectangles are clipped to the matrix, so a box around a pixel near the border covers just its
+ * part inside of the matrix.
+ */
+class SummedAreaTable
+{
+private:
+    int _rows;
+    int _cols;
+    // (rows + 1) x (cols + 1), the first row and the first column are zeros
+    std::vector<double> _sums;
+    // as _sums for the squares of the elements, if _hasSquares
+    std::vector<double> _squares;
+    bool _hasSquares;
+
+    /**
+     * @param table _sums or _squares
+     * @param top the first row of the rectangle, clipped
+     * @param left the first column of the rectangle, clipped
+     * @param bottom one past the last row of the rectangle, clipped
+     * @param right one past the last column of the rectangle, clipped
+     * @return the sum of the table over the rectangle
+     */
+    double _rectangle(const std::vector<double> &table, int top, int left, int bottom,
+                      int right) const
+    {
+        size_t pitch = (size_t) _cols + 1;
+        return table[bottom * pitch + right] - table[top * pitch + right] -
+               table[bottom * pitch + left] + table[top * pitch + left];
+    }
+
+    /**
+     * clips a rectangle to the matrix
+     * @return false if nothing of the rectangle is inside of the matrix
+     */
+    bool _clip(int &top, int &left, int &bottom, int &right) const;
+
+public:
+    /**
+     * an empty table, of a 0 x 0 matrix, to build() later
+     */
+    SummedAreaTable() : _rows(0), _cols(0), _sums(1, 0.0), _hasSquares(false)
+    {
+    }
+
+    /**
+     * builds the table of a matrix in a single pass over it, a band of rows per thread for large
+     * matrices
+     * @param image a matrix, or a view of one
+     * @param squares whether to keep the sums of the squares too, needed by squareSum() and
+     * variance()
+     */
+    explicit SummedAreaTable(ConstMatrixView image, bool squares = false);
+
+    /**
+     * builds the table of another matrix in place, in the memory of the table as far as it goes,
+     * so that a filter summing the bands of an image one after the other allocates once
+     * @param image a matrix, or a view of one
+     * @param squares whether to keep the sums of the squares too
+     */
+    void build(ConstMatrixView image, bool squares = false);
+
+    /**
+     * @return the rows number of the matrix
+     */
+    int getRows() const
+    {
+        return _rows;
+    }
+
+    /**
+     * @return the columns number of the matrix
+     */
+    int getCols() const
+    {
+        return _cols;
+    }
+
+    /**
+     * @return true if the table keeps the sums of the squares
+     */
+    bool hasSquares() const
+    {
+        return _hasSquares;
+    }
+
+    /**
+     * @param top the first row of the rectangle
+     * @param left the first column of the rectangle
+     * @param bottom one past the last row of the rectangle
+     * @param right one past the last column of the rectangle
+     * @return the sum of the elements of the rectangle inside of the matrix
+     */
+    double sum(int top, int left, int bottom, int right) const;
+
+    /**
+     * @param top the first row of the rectangle
+     * @param left the first column of the rectangle
+     * @param bottom one past the last row of the rectangle
+     * @param right one past the last column of the rectangle
+     * @return the sum of the squares of the elements of the rectangle inside of the matrix, exits
+     * if the table was built without squares
+     */
+    double squareSum(int top, int left, int bottom, int right) const;
+
+    /**
+     * @param row the row of the center of the box
+     * @param col the column of the center of the box
+     * @param radius the elements of the box to each side of its center, 0 or more
+     * @return the sum of the (2 radius + 1) x (2 radius + 1) box inside of the matrix
+     */
+    double boxSum(int row, int col, int radius) const
+    {
+        return sum(row - radius, col - radius, row + radius + 1, col + radius + 1);
+    }
+
+    /**
+     * the sums of the boxes around a span of a row, as boxSum() of each of its elements but
+     * clipping the boxes once for the whole span, so that the sums of the elements far from the
+     * borders are a plain loop over the rows of the table
+     * @param row the row of the centers of the boxes
+     * @param left the first column of the span
+     * @param right one past the last column of the span
+     * @param radius the elements of a box to each side of its center, 0 or more
+     * @param sums the sum of the box of column x is written to sums[x - left]
+     * @param squares as sums for the sums of the squares, or nullptr. The table must keep them if
+     * given.
+     */
+    void boxSums(int row, int left, int right, int radius, double *sums,
+                 double *squares = nullptr) const;
+
+    /**
+     * @param row the row of the center of the box
+     * @param col the column of the center of the box
+     * @param radius the elements of the box to each side of its center, 0 or more
+     * @return the mean of the elements of the box inside of the matrix, 0 if there are none
+     */
+    double mean(int row, int col, int radius) const;
+
+    /**
+     * @param row the row of the center of the box
+     * @param col the column of the center of the box
+     * @param radius the elements of the box to each side of its center, 0 or more
+     * @return the variance of the elements of the box inside of the matrix, 0 if there are none.
+     * Exits if the table was built without squares.
+     */
+    double variance(int row, int col, int radius) const;
+};
+
+#endif //EX5_SUMMEDAREATABLE_H
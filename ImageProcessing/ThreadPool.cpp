@@ -0,0 +1,354 @@
+#include <cstdlib>
+#include <algorithm>
+#include "ThreadPool.h"
+
+#define THREADS_ENV "MATRIX_THREADS"
+// chunks per thread in parallelFor, so that stealing can even out uneven chunks
+#define CHUNKS_PER_THREAD 4
+#define NOT_A_WORKER (- 1)
+// the times a thread waiting for a parallelFor looks for a task to run in vain before it sleeps
+#define WAIT_SPINS 64
+
+// the queue index of the current thread, NOT_A_WORKER for threads outside the pool
+static thread_local int workerIndex = NOT_A_WORKER;
+
+
+/**
+ * constructs a pool
+ * @param threads the total number of threads, the calling thread included
+ */
+ThreadPool::ThreadPool(int threads) : _stop(false), _queued(0), _nextQueue(0)
+{
+    _start(threads);
+}
+
+/**
+ * stops the workers, the queued tasks are dropped
+ */
+ThreadPool::~ThreadPool()
+{
+    _stopWorkers();
+}
+
+/**
+ * the process wide pool
+ * @return the process wide pool
+ */
+ThreadPool &ThreadPool::instance()
+{
+    static ThreadPool pool([]()
+    {
+        const char *env = getenv(THREADS_ENV);
+        int threads = (env != nullptr) ? atoi(env) : 0;
+        if (threads <= 0)
+        {
+            threads = (int) std::thread::hardware_concurrency();
+        }
+        return threads;
+    }());
+    return pool;
+}
+
+/**
+ * starts the worker threads
+ * @param threads the total number of threads, the calling thread included
+ */
+void ThreadPool::_start(int threads)
+{
+    threads = std::max(threads, 1);
+    _stop = false;
+    _queued = 0;
+    _queues.clear();
+    // queue 0 is shared by the threads outside the pool, queue i > 0 belongs to worker i
+    for (int i = 0; i < threads; ++ i)
+    {
+        _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (int i = 1; i < threads; ++ i)
+    {
+        _workers.emplace_back(&ThreadPool::_workerLoop, this, i);
+    }
+}
+
+/**
+ * stops and joins the worker threads
+ */
+void ThreadPool::_stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &worker : _workers)
+    {
+        worker.join();
+    }
+    _workers.clear();
+}
+
+/**
+ * @return the total number of threads, the calling thread included
+ */
+int ThreadPool::size() const
+{
+    return (int) _workers.size() + 1;
+}
+
+/**
+ * changes the number of threads
+ * @param threads the total number of threads, the calling thread included
+ */
+void ThreadPool::resize(int threads)
+{
+    _stopWorkers();
+    _start(threads);
+}
+
+/**
+ * pops a task from the given queue, or steals one from another queue
+ * @param index the queue to look at first
+ * @param task set to the task found
+ * @return true if a task was found, false otherwise
+ */
+bool ThreadPool::_takeTask(int index, std::function<void()> &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        if (!_queues[index]->tasks.empty())
+        {
+            task = std::move(_queues[index]->tasks.back());
+            _queues[index]->tasks.pop_back();
+            _queued--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < _queues.size(); ++ i)
+    {
+        Queue &victim = *_queues[(index + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            _queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * the loop run by every worker thread
+ * @param index the index of the worker's queue
+ */
+void ThreadPool::_workerLoop(int index)
+{
+    workerIndex = index;
+    std::function<void()> task;
+    while (true)
+    {
+        if (_takeTask(index, task))
+        {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wake.wait(lock, [this]()
+        {
+            return _stop || _queued > 0;
+        });
+        if (_stop)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * queues a task to run on one of the workers
+ * @param task the task to run
+ */
+void ThreadPool::submit(std::function<void()> task)
+{
+    int index = workerIndex;
+    if (index == NOT_A_WORKER)
+    {
+        index = (int) (_nextQueue++ % _queues.size());
+    }
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        _queues[index]->tasks.push_back(std::move(task));
+        _queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wake.notify_one();
+}
+
+/**
+ * runs a single queued task on the calling thread
+ * @return true if a task was run, false if there was none
+ */
+bool ThreadPool::runTask()
+{
+    int index = (workerIndex == NOT_A_WORKER) ? 0 : workerIndex;
+    std::function<void()> task;
+    if (!_takeTask(index, task))
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+/**
+ * runs fn over [begin, end) split into chunks, on the pool and the calling thread. The calling
+ * thread runs queued tasks until its chunks are done, and once there are none left to run for a
+ * while, the rest being run by other threads, it sleeps until the last of its chunks wakes it.
+ * @param begin the first index
+ * @param end one past the last index
+ * @param minChunk the least number of indices in a chunk
+ * @param fn called with the bounds [lo, hi) of every chunk
+ */
+void ThreadPool::parallelFor(int begin, int end, int minChunk,
+                             const std::function<void(int, int)> &fn)
+{
+    int count = end - begin;
+    if (count <= 0)
+    {
+        return;
+    }
+    int chunks = std::min(size() * CHUNKS_PER_THREAD, count / std::max(minChunk, 1));
+    if (chunks <= 1 || size() == 1)
+    {
+        fn(begin, end);
+        return;
+    }
+    // the chunks count down under the mutex, so that the last one cannot wake the calling thread
+    // between its check and its sleep
+    std::atomic<int> remaining(chunks - 1);
+    std::mutex doneMutex;
+    std::condition_variable done;
+    for (int c = 1; c < chunks; ++ c)
+    {
+        int lo = begin + (int) ((long long) count * c / chunks);
+        int hi = begin + (int) ((long long) count * (c + 1) / chunks);
+        submit([&fn, &remaining, &doneMutex, &done, lo, hi]()
+        {
+            fn(lo, hi);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (-- remaining == 0)
+            {
+                done.notify_one();
+            }
+        });
+    }
+    fn(begin, begin + count / chunks);
+    int index = (workerIndex == NOT_A_WORKER) ? 0 : workerIndex;
+    std::function<void()> task;
+    int spins = 0;
+    while (remaining > 0 && spins < WAIT_SPINS)
+    {
+        if (_takeTask(index, task))
+        {
+            task();
+            spins = 0;
+        }
+        else
+        {
+            std::this_thread::yield();
+            ++ spins;
+        }
+    }
+    // taken even if every chunk is done, so that the last one has left the mutex before it goes
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&remaining]()
+    {
+        return remaining == 0;
+    });
+}
+
+/**
+ * runs fn over the rows of a rows x cols matrix split into row blocks on the process wide pool
+ * @param rows the number of rows
+ * @param cols the number of columns
+ * @param fn called with the bounds [lo, hi) of every row block
+ */
+void parallelRows(int rows, int cols, const std::function<void(int, int)> &fn)
+{
+    if ((long long) rows * cols < 2LL * PARALLEL_MIN_ELEMENTS)
+    {
+        fn(0, rows);
+        return;
+    }
+    int minRows = std::max(1, PARALLEL_MIN_ELEMENTS / std::max(cols, 1));
+    ThreadPool::instance().parallelFor(0, rows, minRows, fn);
+}
+
+/**
+ * runs fn over a rows x cols image split into tiles on the process wide pool
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param haloRows the rows above and below a tile which its pixels read
+ * @param haloCols the columns to the left and the right of a tile which its pixels read
+ * @param columnBytes the bytes of working set a tile keeps per column, halo included
+ * @param pixelWork the work of a pixel relative to that of a single element
+ * @param fn called with every tile
+ */
+void parallelTiles(int rows, int cols, int haloRows, int haloCols, size_t columnBytes,
+                   int pixelWork, const std::function<void(const Tile &)> &fn)
+{
+    if (rows <= 0 || cols <= 0)
+    {
+        return;
+    }
+    int work = std::max(pixelWork, 1);
+    // as wide as the cache allows, but not so narrow that the side halos dominate
+    long fitting = (long) (TILE_CACHE_BYTES / std::max(columnBytes, (size_t) 1)) - 2L * haloCols;
+    long widest = std::max({fitting, 2L * TILE_HALO_RATIO * haloCols, 1L});
+    int tilesAcross = (int) ((cols + widest - 1) / widest);
+    int tileCols = (cols + tilesAcross - 1) / tilesAcross;
+    tilesAcross = (cols + tileCols - 1) / tileCols;
+
+    int threads = ThreadPool::instance().size();
+    if ((long long) rows * cols * work < 2LL * PARALLEL_MIN_ELEMENTS)
+    {
+        threads = 1;
+    }
+    int tilesDown = 1;
+    if (threads > 1)
+    {
+        // a few tiles a thread for stealing, each tall enough for its halo and its hand off
+        int wanted = (threads * CHUNKS_PER_THREAD + tilesAcross - 1) / tilesAcross;
+        long minRows = std::max(2L * TILE_HALO_RATIO * haloRows,
+                                (long) PARALLEL_MIN_ELEMENTS / ((long) tileCols * work) + 1);
+        tilesDown = (int) std::max(1L, std::min((long) wanted, rows / std::max(minRows, 1L)));
+    }
+    int tileRows = (rows + tilesDown - 1) / tilesDown;
+    tilesDown = (rows + tileRows - 1) / tileRows;
+
+    auto tileAt = [=](int t)
+    {
+        int top = (t / tilesAcross) * tileRows;
+        int left = (t % tilesAcross) * tileCols;
+        return Tile{top, std::min(top + tileRows, rows), left, std::min(left + tileCols, cols)};
+    };
+    int tiles = tilesDown * tilesAcross;
+    if (threads == 1)
+    {
+        for (int t = 0; t < tiles; ++ t)
+        {
+            fn(tileAt(t));
+        }
+        return;
+    }
+    ThreadPool::instance().parallelFor(0, tiles, 1, [&](int lo, int hi)
+    {
+        for (int t = lo; t < hi; ++ t)
+        {
+            fn(tileAt(t));
+        }
+    });
+}
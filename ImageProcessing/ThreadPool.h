@@ -0,0 +1,168 @@
+#ifndef EX5_THREADPOOL_H
+#define EX5_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// the least number of elements worth handing to another thread
+#define PARALLEL_MIN_ELEMENTS (1 << 15)
+// the working set of a tile is kept within about the L2 cache of a core
+#define TILE_CACHE_BYTES (1 << 18)
+// a tile is at least this many times as large as its halo along each axis, so that the halo,
+// which neighbouring tiles both read, stays a small part of the work
+#define TILE_HALO_RATIO 4
+
+/**
+ * a work stealing thread pool. Every worker owns a queue of tasks: it runs its own tasks newest
+ * first and steals the oldest task of another worker when its queue is empty. A thread that
+ * waits for a parallelFor runs queued tasks meanwhile, so loops may be nested.
+ */
+class ThreadPool
+{
+private:
+    /**
+     * the task queue of a single worker
+     */
+    struct Queue
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<bool> _stop;
+    std::atomic<int> _queued;
+    std::atomic<unsigned> _nextQueue;
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+
+    /**
+     * starts the worker threads
+     * @param threads the total number of threads, the calling thread included
+     */
+    void _start(int threads);
+
+    /**
+     * stops and joins the worker threads
+     */
+    void _stopWorkers();
+
+    /**
+     * the loop run by every worker thread
+     * @param index the index of the worker's queue
+     */
+    void _workerLoop(int index);
+
+    /**
+     * pops a task from the given queue, or steals one from another queue
+     * @param index the queue to look at first
+     * @param task set to the task found
+     * @return true if a task was found, false otherwise
+     */
+    bool _takeTask(int index, std::function<void()> &task);
+
+public:
+    /**
+     * constructs a pool
+     * @param threads the total number of threads, the calling thread included
+     */
+    explicit ThreadPool(int threads);
+
+    /**
+     * stops the workers, the queued tasks are dropped
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * the process wide pool. Its size is the MATRIX_THREADS environment variable if set, and the
+     * hardware concurrency otherwise.
+     * @return the process wide pool
+     */
+    static ThreadPool &instance();
+
+    /**
+     * @return the total number of threads, the calling thread included
+     */
+    int size() const;
+
+    /**
+     * changes the number of threads. Must not be called while the pool runs tasks.
+     * @param threads the total number of threads, the calling thread included
+     */
+    void resize(int threads);
+
+    /**
+     * queues a task to run on one of the workers
+     * @param task the task to run
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * runs a single queued task on the calling thread, so that a thread which waits for tasks of
+     * the pool can help with them meanwhile
+     * @return true if a task was run, false if there was none
+     */
+    bool runTask();
+
+    /**
+     * runs fn over [begin, end) split into chunks, on the pool and the calling thread, and
+     * returns when every chunk is done. The calling thread helps with queued tasks meanwhile, and
+     * sleeps rather than spins once there are none.
+     * @param begin the first index
+     * @param end one past the last index
+     * @param minChunk the least number of indices in a chunk
+     * @param fn called with the bounds [lo, hi) of every chunk
+     */
+    void parallelFor(int begin, int end, int minChunk, const std::function<void(int, int)> &fn);
+};
+
+/**
+ * a rectangle of an image, rows [top, bottom) and columns [left, right)
+ */
+struct Tile
+{
+    int top;
+    int bottom;
+    int left;
+    int right;
+};
+
+/**
+ * runs fn over a rows x cols image split into tiles on the process wide pool, for filters whose
+ * output pixels read a halo of input pixels around them. A tile is as wide as fits its working set
+ * in TILE_CACHE_BYTES, as the whole image if the image fits, and the tiles are cut across so that
+ * every thread gets a few of them. Each tile reads its halo again rather than sharing it, so the
+ * tiles write disjoint parts of the output and need no locking.
+ * Images worth less than two blocks of PARALLEL_MIN_ELEMENTS run serially on the calling thread,
+ * still tiled across their width.
+ * @param rows the rows number of the image
+ * @param cols the columns number of the image
+ * @param haloRows the rows above and below a tile which its pixels read
+ * @param haloCols the columns to the left and the right of a tile which its pixels read
+ * @param columnBytes the bytes of working set a tile keeps per column, halo included
+ * @param pixelWork the work of a pixel relative to that of a single element
+ * @param fn called with every tile
+ */
+void parallelTiles(int rows, int cols, int haloRows, int haloCols, size_t columnBytes,
+                   int pixelWork, const std::function<void(const Tile &)> &fn);
+
+/**
+ * runs fn over the rows of a rows x cols matrix split into row blocks on the process wide pool.
+ * Matrices smaller than two blocks of PARALLEL_MIN_ELEMENTS run serially on the calling thread.
+ * @param rows the number of rows
+ * @param cols the number of columns
+ * @param fn called with the bounds [lo, hi) of every row block
+ */
+void parallelRows(int rows, int cols, const std::function<void(int, int)> &fn);
+
+#endif //EX5_THREADPOOL_H
@@ -0,0 +1,201 @@
+#include "Trace.h"
+
+#ifdef MATRIX_TRACE
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <vector>
+#include <cstring>
+#include <mutex>
+#include <memory>
+#include <unistd.h>
+
+#define TRACE_FILE_ENV "MATRIX_TRACE_FILE"
+// the most spans kept, later ones are dropped so that a long job cannot run out of memory
+#define MAX_TRACE_EVENTS (1 << 20)
+
+/**
+ * a span which ended, in microseconds of the steady clock
+ */
+struct TraceEvent
+{
+    const char *name;
+    int thread;
+    long long start;
+    long long duration;
+};
+
+/**
+ * the counters and the spans of the process
+ */
+struct TraceLog
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<trace::Counter>> counters;
+    std::vector<TraceEvent> events;
+    long long dropped = 0;
+};
+
+/**
+ * the totals of the counters of a single name
+ */
+struct TraceTotals
+{
+    const char *name;
+    long long calls;
+    long long bytes;
+    long long elements;
+    long long flops;
+};
+
+// the next number of a thread, in the order threads first record a span
+static std::atomic<int> nextThread(0);
+static thread_local int traceThread = - 1;
+
+
+/**
+ * @param time a point of the steady clock
+ * @return its microseconds since the epoch of the clock, the time base of the trace
+ */
+static long long microseconds(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+/**
+ * sums the counters by name, since a name may be counted at several sites
+ * @param log the log, locked
+ * @return the totals of every name, in the order the names were first counted
+ */
+static std::vector<TraceTotals> totals(const TraceLog &log)
+{
+    std::vector<TraceTotals> result;
+    for (const std::unique_ptr<trace::Counter> &counter : log.counters)
+    {
+        size_t i = 0;
+        while (i < result.size() && strcmp(result[i].name, counter->name) != 0)
+        {
+            ++ i;
+        }
+        if (i == result.size())
+        {
+            result.push_back(TraceTotals{counter->name, 0, 0, 0, 0});
+        }
+        result[i].calls += counter->calls;
+        result[i].bytes += counter->bytes;
+        result[i].elements += counter->elements;
+        result[i].flops += counter->flops;
+    }
+    return result;
+}
+
+/**
+ * writes the trace to the file named by MATRIX_TRACE_FILE, at exit
+ */
+static void writeAtExit()
+{
+    const char *env = getenv(TRACE_FILE_ENV);
+    std::ofstream file(env != nullptr ? env : TRACE_DEFAULT_FILE);
+    trace::writeTrace(file);
+}
+
+/**
+ * @return the log of the process. The trace is written at exit, before the log is destroyed.
+ */
+static TraceLog &traceLog()
+{
+    static TraceLog log;
+    // registered after the log is constructed, so it runs before the log is destroyed
+    static bool registered = (std::atexit(writeAtExit) == 0);
+    (void) registered;
+    return log;
+}
+
+/**
+ * @param name the name of the operation, a string literal
+ * @return a new counter registered for the output, for a site to keep
+ */
+trace::Counter &trace::counter(const char *name)
+{
+    TraceLog &log = traceLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.counters.emplace_back(new Counter());
+    Counter &counter = *log.counters.back();
+    counter.name = name;
+    return counter;
+}
+
+/**
+ * ends the span and records it
+ */
+trace::Span::~Span()
+{
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    if (traceThread < 0)
+    {
+        traceThread = nextThread++;
+    }
+    TraceLog &log = traceLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    if (log.events.size() >= MAX_TRACE_EVENTS)
+    {
+        ++ log.dropped;
+        return;
+    }
+    long long start = microseconds(_start);
+    log.events.push_back(TraceEvent{_name, traceThread, start, microseconds(end) - start});
+}
+
+/**
+ * writes the spans recorded so far and the totals of the counters as a trace in the Chrome
+ * trace event format: a complete event per span, and a counter event per name at the time of
+ * writing. Times are microseconds of the steady clock, so spans line up with other traces of the
+ * same host taken by the monotonic clock.
+ * @param ostream the stream to write to
+ */
+void trace::writeTrace(std::ostream &ostream)
+{
+    TraceLog &log = traceLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    long long pid = (long long) getpid();
+    long long end = microseconds(std::chrono::steady_clock::now());
+    ostream << "{\"traceEvents\":[";
+    const char *separator = "\n";
+    for (const TraceEvent &event : log.events)
+    {
+        ostream << separator << "{\"name\":\"" << event.name << "\",\"cat\":\"matrix\","
+                << "\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << event.thread << ",\"ts\":"
+                << event.start << ",\"dur\":" << event.duration << "}";
+        separator = ",\n";
+    }
+    for (const TraceTotals &counter : totals(log))
+    {
+        ostream << separator << "{\"name\":\"" << counter.name << "\",\"cat\":\"matrix\","
+                << "\"ph\":\"C\",\"pid\":" << pid << ",\"ts\":" << end << ",\"args\":{"
+                << "\"calls\":" << counter.calls << ",\"bytes\":" << counter.bytes
+                << ",\"elements\":" << counter.elements << ",\"flops\":" << counter.flops
+                << "}}";
+        separator = ",\n";
+    }
+    ostream << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_spans\":" << log.dropped
+            << "}}\n";
+}
+
+/**
+ * writes the totals of the counters as CSV, a line per name
+ * @param ostream the stream to write to
+ */
+void trace::writeCounters(std::ostream &ostream)
+{
+    TraceLog &log = traceLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    ostream << "op,calls,bytes,elements,flops" << std::endl;
+    for (const TraceTotals &counter : totals(log))
+    {
+        ostream << counter.name << "," << counter.calls << "," << counter.bytes << ","
+                << counter.elements << "," << counter.flops << std::endl;
+    }
+}
+
+#endif
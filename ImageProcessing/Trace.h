@@ -0,0 +1,117 @@
+#ifndef EX5_TRACE_H
+#define EX5_TRACE_H
+
+// instrumentation of the Matrix operations and the filters, compiled in only with -DMATRIX_TRACE.
+// Without it TRACE_COUNT and TRACE_SPAN expand to nothing and this header declares nothing, so a
+// normal build pays nothing for it.
+// With it every TRACE_COUNT site counts its calls, the bytes it allocates, the elements it touches
+// and its floating point operations, and every TRACE_SPAN times the scope it is in. At exit the
+// spans and the totals of the counters are written in the Chrome trace event format to the file
+// named by the MATRIX_TRACE_FILE environment variable, TRACE_DEFAULT_FILE if it is not set.
+// A lazy expression is counted when it is evaluated, every operator of it under its own name, as
+// expr_add or expr_mul_scalar.
+// Counters and spans nest: a filter counts the pixels it reads and writes and its own work per
+// pixel, and what it calls, as the summed area tables of the box filters or the allocation of its
+// result, counts its own under its own name. The span of a filter includes those of what it calls,
+// and summing the totals of different names counts the nested elements more than once.
+#ifdef MATRIX_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
+
+#define TRACE_DEFAULT_FILE "matrix_trace.json"
+
+namespace trace
+{
+    /**
+     * the totals of a single counting site, never destroyed so that they can be written at exit
+     */
+    struct Counter
+    {
+        const char *name;
+        std::atomic<long long> calls;
+        std::atomic<long long> bytes;
+        std::atomic<long long> elements;
+        std::atomic<long long> flops;
+
+        /**
+         * counts a call
+         * @param allocated the bytes the call allocated
+         * @param touched the elements the call read or wrote
+         * @param operations the floating point operations of the call
+         */
+        void add(long long allocated, long long touched, long long operations)
+        {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(allocated, std::memory_order_relaxed);
+            elements.fetch_add(touched, std::memory_order_relaxed);
+            flops.fetch_add(operations, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @param name the name of the operation, a string literal
+     * @return a new counter registered for the output, for a site to keep
+     */
+    Counter &counter(const char *name);
+
+    /**
+     * times the scope it lives in, and records it as a complete event of the trace
+     */
+    class Span
+    {
+    private:
+        const char *_name;
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        /**
+         * starts a span
+         * @param name the name of the span, a string literal
+         */
+        explicit Span(const char *name) : _name(name), _start(std::chrono::steady_clock::now())
+        {
+        }
+
+        /**
+         * ends the span and records it
+         */
+        ~Span();
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+    };
+
+    /**
+     * writes the spans recorded so far and the totals of the counters as a trace in the Chrome
+     * trace event format
+     * @param ostream the stream to write to
+     */
+    void writeTrace(std::ostream &ostream);
+
+    /**
+     * writes the totals of the counters as CSV, a line per name
+     * @param ostream the stream to write to
+     */
+    void writeCounters(std::ostream &ostream);
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_COUNT(name, bytes, elements, flops) \
+    do \
+    { \
+        static trace::Counter &traceCounter = trace::counter(name); \
+        traceCounter.add((long long) (bytes), (long long) (elements), (long long) (flops)); \
+    } while (0)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#else
+
+#define TRACE_COUNT(name, bytes, elements, flops) ((void) 0)
+#define TRACE_SPAN(name) ((void) 0)
+
+#endif
+
+#endif //EX5_TRACE_H
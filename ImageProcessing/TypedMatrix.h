@@ -0,0 +1,436 @@
+#ifndef EX5_TYPEDMATRIX_H
+#define EX5_TYPEDMATRIX_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "BufferPool.h"
+
+#define TYPED_INDEX_ERR_MSG "Index out of range.\n"
+#define TYPED_DIMENSIONS_ERR_MSG "Invalid Matrix dimensions.\n"
+#define TYPED_STREAM_ERR_MSG "Error loading from input stream.\n"
+
+
+/**
+ * converts a value to another arithmetic type. A conversion to an integer type rounds to the
+ * nearest integer, halves to even like rintf, and clamps to the range of the type. NaN becomes 0.
+ * @tparam T the type to convert to
+ * @tparam U the type to convert from
+ * @param value the value to convert
+ * @return the converted value
+ */
+template<class T, class U>
+T saturateCast(U value)
+{
+    static_assert(std::is_arithmetic<T>::value && std::is_arithmetic<U>::value,
+                  "saturateCast converts between arithmetic types only.");
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        return static_cast<T>(value);
+    }
+    else if constexpr (std::is_floating_point<U>::value)
+    {
+        if (std::isnan(value))
+        {
+            return 0;
+        }
+        double rounded = std::nearbyint((double) value);
+        if (rounded <= (double) std::numeric_limits<T>::min())
+        {
+            return std::numeric_limits<T>::min();
+        }
+        if (rounded >= (double) std::numeric_limits<T>::max())
+        {
+            return std::numeric_limits<T>::max();
+        }
+        return static_cast<T>(rounded);
+    }
+    else
+    {
+        long long wide = (long long) value;
+        if (wide <= (long long) std::numeric_limits<T>::min())
+        {
+            return std::numeric_limits<T>::min();
+        }
+        if (wide >= (long long) std::numeric_limits<T>::max())
+        {
+            return std::numeric_limits<T>::max();
+        }
+        return static_cast<T>(wide);
+    }
+}
+
+/**
+ * a matrix which stores its elements as T, for uint8_t, int16_t, float or double. It only holds
+ * data: arithmetic is done on Matrix, and the filters have native paths for bytes. Conversions
+ * between element types are explicit and saturate, see saturateCast.
+ * The elements are packed row after row in a BUFFER_ALIGNMENT aligned buffer of the BufferPool,
+ * as those of Matrix, so that the byte images of a batch reuse the buffers of the previous ones.
+ * @tparam T the element type
+ */
+template<class T>
+class TypedMatrix
+{
+private:
+    int _rows;
+    int _cols;
+    T *_data;
+
+    /**
+     * @return the number of elements of the matrix
+     */
+    size_t _size() const
+    {
+        return (size_t) _rows * _cols;
+    }
+
+    /**
+     * exits if the element (i, j) is not inside the matrix
+     */
+    void _checkIndex(int i, int j) const
+    {
+        if (_cols <= j || _rows <= i || i < 0 || j < 0)
+        {
+            std::cerr << TYPED_INDEX_ERR_MSG;
+            exit(1);
+        }
+    }
+
+    /**
+     * exits if i is not an index of the data array
+     */
+    void _checkIndex(int i) const
+    {
+        if ((long) _rows * _cols <= i || i < 0)
+        {
+            std::cerr << TYPED_INDEX_ERR_MSG;
+            exit(1);
+        }
+    }
+
+public:
+    static_assert(std::is_same<T, uint8_t>::value || std::is_same<T, int16_t>::value ||
+                  std::is_same<T, float>::value || std::is_same<T, double>::value,
+                  "TypedMatrix holds uint8_t, int16_t, float or double elements.");
+
+    /**
+     * constructs a new matrix, of zeros unless told otherwise. A matrix may have 0 rows or
+     * columns, as a Matrix may.
+     * @param rows the rows number of the matrix
+     * @param cols the columns number of the matrix
+     * @param init whether to set the elements to 0
+     */
+    TypedMatrix(int rows, int cols, Matrix::Initialization init = Matrix::ZERO_INIT) :
+            _rows(rows), _cols(cols)
+    {
+        if (rows < 0 || cols < 0)
+        {
+            std::cerr << TYPED_DIMENSIONS_ERR_MSG;
+            exit(1);
+        }
+        _data = (T *) BufferPool::instance().acquire(_size() * sizeof(T));
+        if (init == Matrix::ZERO_INIT)
+        {
+            memset(_data, 0, _size() * sizeof(T));
+        }
+    }
+
+    /**
+     * constructs a new matrix using an existing one
+     * @param other the matrix to copy
+     */
+    TypedMatrix(const TypedMatrix &other) : TypedMatrix(other._rows, other._cols, Matrix::NO_INIT)
+    {
+        std::copy(other._data, other._data + _size(), _data);
+    }
+
+    /**
+     * constructs a new matrix by taking the data of an existing one
+     * @param other the matrix to move, left as a 0 x 0 matrix
+     */
+    TypedMatrix(TypedMatrix &&other) noexcept : _rows(other._rows), _cols(other._cols),
+                                                _data(other._data)
+    {
+        other._rows = 0;
+        other._cols = 0;
+        other._data = nullptr;
+    }
+
+    /**
+     * converts a matrix of another element type
+     * @param other the matrix to convert
+     */
+    template<class U>
+    explicit TypedMatrix(const TypedMatrix<U> &other) : TypedMatrix(other.getRows(),
+                                                                    other.getCols(),
+                                                                    Matrix::NO_INIT)
+    {
+        for (size_t i = 0; i < _size(); ++ i)
+        {
+            _data[i] = saturateCast<T>(other.data()[i]);
+        }
+    }
+
+    /**
+     * converts a float matrix, or a view of one
+     * @param matrix the matrix to convert
+     */
+    explicit TypedMatrix(ConstMatrixView matrix) : TypedMatrix(matrix.getRows(),
+                                                               matrix.getCols(),
+                                                               Matrix::NO_INIT)
+    {
+        for (int i = 0; i < _rows; ++ i)
+        {
+            T *row = rowData(i);
+            for (int j = 0; j < _cols; ++ j)
+            {
+                row[j] = saturateCast<T>(matrix.at(i, j));
+            }
+        }
+    }
+
+    /**
+     * gives the data buffer back to the buffer pool
+     */
+    ~TypedMatrix()
+    {
+        BufferPool::instance().release(_data);
+    }
+
+    /**
+     * gives the matrix the dimensions and the elements of other, in its own buffer if it is
+     * large enough
+     * @param other the matrix to copy
+     * @return this matrix
+     */
+    TypedMatrix &operator=(const TypedMatrix &other)
+    {
+        if (this == &other)
+        {
+            return *this;
+        }
+        size_t bytes = other._size() * sizeof(T);
+        if (_data == nullptr || BufferPool::capacity(_data) < bytes)
+        {
+            BufferPool::instance().release(_data);
+            _data = nullptr;
+            _data = (T *) BufferPool::instance().acquire(bytes);
+        }
+        _rows = other._rows;
+        _cols = other._cols;
+        std::copy(other._data, other._data + _size(), _data);
+        return *this;
+    }
+
+    /**
+     * gives the matrix the data of other matrix
+     * @param other the matrix to move, left with the previous data of the matrix
+     * @return this matrix
+     */
+    TypedMatrix &operator=(TypedMatrix &&other) noexcept
+    {
+        std::swap(_rows, other._rows);
+        std::swap(_cols, other._cols);
+        std::swap(_data, other._data);
+        return *this;
+    }
+
+    /**
+     * @return the matrix converted to a float Matrix
+     */
+    Matrix toMatrix() const
+    {
+        Matrix matrix(_rows, _cols, Matrix::NO_INIT);
+        for (int i = 0; i < _rows; ++ i)
+        {
+            const T *row = rowData(i);
+            float *out = matrix.rowData(i);
+            for (int j = 0; j < _cols; ++ j)
+            {
+                out[j] = saturateCast<float>(row[j]);
+            }
+        }
+        return matrix;
+    }
+
+    /**
+     * @return the rows number of the matrix
+     */
+    int getRows() const
+    {
+        return _rows;
+    }
+
+    /**
+     * @return the columns number of the matrix
+     */
+    int getCols() const
+    {
+        return _cols;
+    }
+
+    /**
+     * @return the data array of the matrix, row after row
+     */
+    T *data()
+    {
+        return _data;
+    }
+
+    /**
+     * @return the data array of the matrix, row after row
+     */
+    const T *data() const
+    {
+        return _data;
+    }
+
+    /**
+     * @param r the row index
+     * @return the address of the first element of row r
+     */
+    T *rowData(int r)
+    {
+        return _data + (size_t) r * _cols;
+    }
+
+    /**
+     * @param r the row index
+     * @return the address of the first element of row r
+     */
+    const T *rowData(int r) const
+    {
+        return _data + (size_t) r * _cols;
+    }
+
+    /**
+     * accesses to index in the data array
+     * @param i rows index
+     * @param j columns index
+     * @return the element in the [i][j] index in the data array of the matrix
+     */
+    T &operator()(int i, int j)
+    {
+        _checkIndex(i, j);
+        return _data[(size_t) i * _cols + j];
+    }
+
+    /**
+     * accesses to index in the data array
+     * @param i rows index
+     * @param j columns index
+     * @return the element in the [i][j] index in the data array of the matrix
+     */
+    T operator()(int i, int j) const
+    {
+        _checkIndex(i, j);
+        return _data[(size_t) i * _cols + j];
+    }
+
+    /**
+     * accesses to index in the data array
+     * @param i the wanted index
+     * @return the i'th element in the data array
+     */
+    T &operator[](int i)
+    {
+        _checkIndex(i);
+        return _data[i];
+    }
+
+    /**
+     * accesses to index in the data array
+     * @param i the wanted index
+     * @return the i'th element in the data array
+     */
+    T operator[](int i) const
+    {
+        _checkIndex(i);
+        return _data[i];
+    }
+
+    /**
+     * checks if two matrices have the same dimensions and elements
+     * @param other the matrix to compare with
+     * @return true if the matrices are equal, false otherwise
+     */
+    bool operator==(const TypedMatrix &other) const
+    {
+        return _rows == other._rows && _cols == other._cols &&
+               std::equal(_data, _data + _size(), other._data);
+    }
+
+    /**
+     * @param other the matrix to compare with
+     * @return true if matrix's are not equal as determined in the == operator
+     */
+    bool operator!=(const TypedMatrix &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/**
+ * writes a matrix to an output stream in the layout of Matrix, elements as numbers
+ * @param ostream the stream to write to
+ * @param matrix the matrix to write
+ * @return the output stream
+ */
+template<class T>
+std::ostream &operator<<(std::ostream &ostream, const TypedMatrix<T> &matrix)
+{
+    for (int i = 0; i < matrix.getRows(); ++ i)
+    {
+        const T *row = matrix.rowData(i);
+        for (int j = 0; j < matrix.getCols(); ++ j)
+        {
+            // + promotes bytes, which would otherwise be written as characters
+            ostream << + row[j];
+            if (j < matrix.getCols() - 1)
+            {
+                ostream << " ";
+            }
+        }
+        if (i < matrix.getRows() - 1)
+        {
+            ostream << std::endl;
+        }
+    }
+    return ostream;
+}
+
+/**
+ * reads the elements of a matrix from an input stream of numbers, saturating each of them
+ * @param istream the stream to read from
+ * @param matrix the matrix to read into
+ * @return the input stream
+ */
+template<class T>
+std::istream &operator>>(std::istream &istream, TypedMatrix<T> &matrix)
+{
+    if (!istream)
+    {
+        std::cerr << TYPED_STREAM_ERR_MSG;
+        exit(1);
+    }
+    T *data = matrix.data();
+    for (long i = 0; i < (long) matrix.getRows() * matrix.getCols(); ++ i)
+    {
+        double value = 0;
+        istream >> value;
+        data[i] = saturateCast<T>(value);
+    }
+    return istream;
+}
+
+typedef TypedMatrix<uint8_t> ByteMatrix;
+
+#endif //EX5_TYPEDMATRIX_H